@@ -0,0 +1,176 @@
+#!/bin/bash
+# Throughput and latency through the internal loopback of the card: no cable, no switch, no link partner
+# The driver must be loaded in loopback mode: insmod r8139d_naive.ko txrx=7
+# Works the same on real cards and on QEMU's emulated rtl8139 (-device rtl8139)
+#
+# For each frame size:
+# - pktgen sends frames to ourselves as fast as it can: they all come back through our RX ring
+#   pps and Mbit/s are what we received, IRQs / frame from /proc/interrupts, CPU cycles / frame from perf (whole system)
+# - lbk-pingpong sends one frame at a time: p50 / p99 / p999 round trip latency
+#
+# Output is CSV, one line per size, so that runs of different driver builds can be compared (-L to tell them apart)
+
+set -e
+
+PGDIR=/proc/net/pktgen
+HERE=$(dirname "$(readlink -f "$0")")
+PINGPONG=$HERE/lbk-pingpong
+
+SIZES="60 64 128 256 512 1024 1280 1514"
+FRAMES=1000000
+ROUNDTRIPS=10000
+LABEL=
+OUTPUT=/dev/stdout
+CPU=
+
+usage()
+{
+    cat >&2 <<EOF
+Usage: $0 [options] interface
+  -s "SIZES"  Frame sizes, without FCS (default: "$SIZES")
+  -n FRAMES   pktgen frames per size (default: $FRAMES)
+  -r TRIPS    Ping-pong round trips per size (default: $ROUNDTRIPS)
+  -c CPU      Run pktgen and the ping-pong on this CPU (default: 0)
+  -L LABEL    Driver build this run is for (default: module srcversion)
+  -o FILE     Write the CSV there (default: stdout)
+EOF
+    exit 1
+}
+
+while getopts "s:n:r:c:L:o:h" opt
+do
+    case $opt in
+        s) SIZES=$OPTARG ;;
+        n) FRAMES=$OPTARG ;;
+        r) ROUNDTRIPS=$OPTARG ;;
+        c) CPU=$OPTARG ;;
+        L) LABEL=$OPTARG ;;
+        o) OUTPUT=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || usage
+IFACE=$1
+CPU=${CPU:-0}
+
+die()
+{
+    echo "$*" >&2
+    exit 1
+}
+
+[ "$(id -u)" -eq 0 ] || die "pktgen and packet sockets need root"
+[ -x "$PINGPONG" ] || die "$PINGPONG not found: run make in $HERE"
+[ -d "/sys/class/net/$IFACE" ] || die "No such interface: $IFACE"
+[ -d $PGDIR ] || modprobe pktgen || die "pktgen is not available"
+
+DRIVER=$(basename "$(readlink -f "/sys/class/net/$IFACE/device/driver")")
+LABEL=${LABEL:-$(cat "/sys/module/$DRIVER/srcversion" 2>/dev/null || echo unknown)}
+MAC=$(cat "/sys/class/net/$IFACE/address")
+
+ip link set dev "$IFACE" up
+
+# Nothing coming back means we're not in loopback mode
+"$PINGPONG" -s 60 -n 10 -w 0 "$IFACE" > /dev/null ||
+    die "No frame came back on $IFACE: is the driver loaded with txrx=7?"
+
+counter()
+{
+    cat "/sys/class/net/$IFACE/statistics/$1"
+}
+
+# Interrupts of our IRQ line (request_irq names it after the interface, shared lines list all their devices), all CPUs
+irqs()
+{
+    awk -v dev="$IFACE" '{
+        for ( f = 2 ; f <= NF ; f++ ) if ( $f == dev || $f == dev "," ) mine = 1
+        if ( mine ) for ( i = 2 ; i <= NF && $i ~ /^[0-9]+$/ ; i++ ) n += $i
+        mine = 0
+    } END { print n + 0 }' /proc/interrupts
+}
+
+pgset()
+{
+    echo "$2" > "$PGDIR/$1"
+}
+
+# One pktgen thread, bound to our interface, sending to ourselves
+pktgen_setup()
+{
+    local thread=kpktgend_$CPU
+
+    [ -e "$PGDIR/$thread" ] || die "pktgen has no thread on CPU $CPU"
+    pgset pgctrl reset
+    pgset "$thread" rem_device_all
+    pgset "$thread" "add_device $IFACE"
+    pgset "$IFACE" "count $FRAMES"
+    pgset "$IFACE" "pkt_size $1"
+    pgset "$IFACE" "dst_mac $MAC"
+    pgset "$IFACE" "dst 10.139.0.1"
+    pgset "$IFACE" "clone_skb 0"
+    pgset "$IFACE" "delay 0"
+}
+
+# System-wide CPU cycles of a command, empty if perf can't tell (no PMU in the VM...)
+cycles()
+{
+    local out
+
+    out=$(mktemp)
+    if command -v perf > /dev/null && perf stat -a -x, -e cycles -o "$out" -- "$@" 2> /dev/null
+    then
+        awk -F, '$3 ~ /^cycles/ && $1 ~ /^[0-9]+$/ { print $1 }' "$out"
+    else
+        "$@"
+    fi
+    rm -f "$out"
+}
+
+# Wait until the last looped back frames went through NAPI
+settle()
+{
+    local prev=-1 cur
+
+    cur=$(counter rx_packets)
+    while [ "$cur" != "$prev" ]
+    do
+        sleep 0.1
+        prev=$cur
+        cur=$(counter rx_packets)
+    done
+}
+
+echo "label,kernel,driver,interface,size,frames,rx_frames,lost,pps,mbps,irqs_per_frame,cycles_per_frame,lat_p50_ns,lat_p99_ns,lat_p999_ns" > "$OUTPUT"
+
+for size in $SIZES
+do
+    pktgen_setup "$size"
+
+    rx0=$(counter rx_packets)
+    bytes0=$(counter rx_bytes)
+    irq0=$(irqs)
+    t0=$(date +%s%N)
+
+    # Returns when pktgen sent everything
+    cyc=$(cycles sh -c "echo start > $PGDIR/pgctrl")
+
+    t1=$(date +%s%N)
+    settle
+    rx=$(( $(counter rx_packets) - rx0 ))
+    bytes=$(( $(counter rx_bytes) - bytes0 ))
+    irq=$(( $(irqs) - irq0 ))
+
+    lat=$("$PINGPONG" -s "$size" -n "$ROUNDTRIPS" -c "$CPU" "$IFACE" | cut -d, -f5-7) || true
+
+    awk -v label="$LABEL" -v kernel="$(uname -r)" -v driver="$DRIVER" -v iface="$IFACE" -v size="$size" \
+        -v frames="$FRAMES" -v rx="$rx" -v bytes="$bytes" -v irq="$irq" -v cyc="$cyc" -v ns=$((t1 - t0)) -v lat="$lat" \
+        'BEGIN {
+            n = rx ? rx : 1
+            printf "%s,%s,%s,%s,%d,%d,%d,%d,%.0f,%.1f,%.3f,%s,%s\n", label, kernel, driver, iface, size, frames, rx,
+                frames - rx, rx * 1e9 / ns, bytes * 8e3 / ns, irq / n, cyc == "" ? "" : sprintf ( "%.0f", cyc / n ),
+                lat == "" ? ",," : lat
+        }' >> "$OUTPUT"
+done
+
+pgset pgctrl reset
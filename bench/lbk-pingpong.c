@@ -0,0 +1,263 @@
+// Round trip latency through the internal loopback of the card (txrx=7: TCR_LBK_ENABLE)
+// Sends one frame to ourselves through a packet socket, waits for it to come back from the RX ring, and so on
+// Prints: size,frames,lost,min_ns,p50_ns,p99_ns,p999_ns,max_ns
+// What it measures is the whole path, user space included: send, driver TX, hardware, IRQ, NAPI, socket wakeup
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+// Local experimental EtherType: nothing else on the interface answers to it
+#define PINGPONG_ETH_P 0x88b5
+
+// Our frames, so that we can tell them from anything else coming back
+#define PINGPONG_MAGIC 0x8139d00d
+
+// Frames older than this are lost
+#define PINGPONG_TIMEOUT_MS 1000
+
+// Since Linux 4.20: our packet socket doesn't see our own frames leaving
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+struct pingpong_frame
+{
+    uint8_t dst [ ETH_ALEN ];
+    uint8_t src [ ETH_ALEN ];
+    uint16_t proto;
+    uint32_t magic;
+    uint64_t seq;
+} __attribute__ ( ( packed ) );
+
+static int _pingpong_open ( const char * ifname, uint8_t * mac );
+static void _pingpong_usage ( const char * name );
+
+static inline uint64_t _pingpong_now ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int _pingpong_cmp ( const void * a, const void * b )
+{
+    uint64_t x = * ( const uint64_t * ) a, y = * ( const uint64_t * ) b;
+
+    return ( x > y ) - ( x < y );
+}
+
+// Value below which a fraction (per thousand) of the samples are
+static inline uint64_t _pingpong_percentile ( const uint64_t * sorted, unsigned int nb, unsigned int permil )
+{
+    unsigned int i = ( ( uint64_t ) nb * permil + 999 ) / 1000;
+
+    return sorted [ i ? i - 1 : 0 ];
+}
+
+// Packet socket bound to our EtherType on the interface, and the interface MAC address
+static int _pingpong_open ( const char * ifname, uint8_t * mac )
+{
+    struct sockaddr_ll sll = { 0 };
+    struct timeval timeout = { PINGPONG_TIMEOUT_MS / 1000, ( PINGPONG_TIMEOUT_MS % 1000 ) * 1000 };
+    struct ifreq ifr = { 0 };
+    int one = 1;
+    int fd;
+
+    fd = socket ( AF_PACKET, SOCK_RAW, htons ( PINGPONG_ETH_P ) );
+    if ( fd < 0 )
+    {
+        perror ( "socket" );
+        return -1;
+    }
+
+    snprintf ( ifr.ifr_name, sizeof ( ifr.ifr_name ), "%s", ifname );
+    if ( ioctl ( fd, SIOCGIFHWADDR, & ifr ) )
+    {
+        perror ( ifname );
+        goto err_open;
+    }
+    memcpy ( mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN );
+
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons ( PINGPONG_ETH_P );
+    sll.sll_ifindex = if_nametoindex ( ifname );
+    if ( bind ( fd, ( struct sockaddr * ) & sll, sizeof ( sll ) ) )
+    {
+        perror ( "bind" );
+        goto err_open;
+    }
+
+    // Older kernels show us our own frames leaving as well: we skip them (PACKET_OUTGOING)
+    setsockopt ( fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, & one, sizeof ( one ) );
+
+    if ( setsockopt ( fd, SOL_SOCKET, SO_RCVTIMEO, & timeout, sizeof ( timeout ) ) )
+    {
+        perror ( "SO_RCVTIMEO" );
+        goto err_open;
+    }
+
+    return fd;
+
+err_open:
+    close ( fd );
+    return -1;
+}
+
+static void _pingpong_usage ( const char * name )
+{
+    fprintf ( stderr,
+        "Usage: %s [-s size] [-n frames] [-w warmup] [-c cpu] [-H] interface\n"
+        "  -s  Frame size, without FCS (60 -> 1514, default: 60)\n"
+        "  -n  Measured round trips (default: 10000)\n"
+        "  -w  Round trips before measuring (default: 100)\n"
+        "  -c  Run on this CPU\n"
+        "  -H  Print the CSV header first\n",
+        name );
+}
+
+int main ( int argc, char ** argv )
+{
+    uint8_t tx [ ETH_FRAME_LEN ] = { 0 }, rx [ ETH_FRAME_LEN ];
+    struct pingpong_frame * frame = ( struct pingpong_frame * ) tx;
+    const struct pingpong_frame * back = ( const struct pingpong_frame * ) rx;
+    struct sockaddr_ll from;
+    socklen_t fromlen;
+    unsigned int size = ETH_ZLEN, nb = 10000, warmup = 100, lost = 0, done = 0;
+    uint64_t * samples, seq, start;
+    bool header = false;
+    cpu_set_t cpus;
+    uint8_t mac [ ETH_ALEN ];
+    ssize_t len;
+    int opt, fd;
+
+    while ( ( opt = getopt ( argc, argv, "s:n:w:c:H" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 's':
+                size = strtoul ( optarg, NULL, 0 );
+                break;
+
+            case 'n':
+                nb = strtoul ( optarg, NULL, 0 );
+                break;
+
+            case 'w':
+                warmup = strtoul ( optarg, NULL, 0 );
+                break;
+
+            case 'c':
+                CPU_ZERO ( & cpus );
+                CPU_SET ( atoi ( optarg ), & cpus );
+                if ( sched_setaffinity ( 0, sizeof ( cpus ), & cpus ) )
+                {
+                    perror ( "sched_setaffinity" );
+                    return 1;
+                }
+                break;
+
+            case 'H':
+                header = true;
+                break;
+
+            default:
+                _pingpong_usage ( argv [ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( optind != argc - 1 || size < ETH_ZLEN || size > ETH_FRAME_LEN || ! nb )
+    {
+        _pingpong_usage ( argv [ 0 ] );
+        return 1;
+    }
+
+    samples = calloc ( nb, sizeof ( * samples ) );
+    fd = _pingpong_open ( argv [ optind ], mac );
+    if ( ! samples || fd < 0 )
+    {
+        return 1;
+    }
+
+    // To ourselves: the RX filters let it in as a physical match
+    memcpy ( frame -> dst, mac, ETH_ALEN );
+    memcpy ( frame -> src, mac, ETH_ALEN );
+    frame -> proto = htons ( PINGPONG_ETH_P );
+    frame -> magic = PINGPONG_MAGIC;
+
+    for ( seq = 0; seq < warmup + nb ; ++seq )
+    {
+        frame -> seq = seq;
+        start = _pingpong_now ( );
+
+        if ( send ( fd, tx, size, 0 ) != size )
+        {
+            perror ( "send" );
+            return 1;
+        }
+
+        // Skip whatever isn't this very frame: late ones we gave up on, our own frames leaving (older kernels)
+        for ( ;; )
+        {
+            fromlen = sizeof ( from );
+            len = recvfrom ( fd, rx, sizeof ( rx ), 0, ( struct sockaddr * ) & from, & fromlen );
+            if ( len < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+
+                lost++;
+                break;
+            }
+
+            if ( from.sll_pkttype != PACKET_OUTGOING && len >= ( ssize_t ) sizeof ( * back ) &&
+                 back -> magic == PINGPONG_MAGIC && back -> seq == seq )
+            {
+                if ( seq >= warmup )
+                {
+                    samples [ done++ ] = _pingpong_now ( ) - start;
+                }
+                break;
+            }
+        }
+    }
+
+    close ( fd );
+
+    if ( header )
+    {
+        printf ( "size,frames,lost,min_ns,p50_ns,p99_ns,p999_ns,max_ns\n" );
+    }
+
+    if ( ! done )
+    {
+        printf ( "%u,%u,%u,,,,,\n", size, nb, lost );
+        return 1;
+    }
+
+    qsort ( samples, done, sizeof ( * samples ), _pingpong_cmp );
+    printf ( "%u,%u,%u,%llu,%llu,%llu,%llu,%llu\n", size, nb, lost, ( unsigned long long ) samples [ 0 ],
+             ( unsigned long long ) _pingpong_percentile ( samples, done, 500 ),
+             ( unsigned long long ) _pingpong_percentile ( samples, done, 990 ),
+             ( unsigned long long ) _pingpong_percentile ( samples, done, 999 ),
+             ( unsigned long long ) samples [ done - 1 ] );
+
+    return 0;
+}
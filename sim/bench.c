@@ -0,0 +1,788 @@
+// Userspace simulator: benchmark harness
+// Runs the driver against the register model (model.c) and measures what its datapath costs per frame:
+// - rx: frames injected in the RX ring, cost of the IRQ handler and the NAPI poll (r8139dn_net_interrupt, r8139dn_net_poll)
+// - tx: cost of r8139dn_net_start_xmit, then of the TX completion (IRQ handler and NAPI poll)
+// - loopback: both, TX frames coming back through the RX ring (txrx=7, TCR_LBK_ENABLE)
+// Injecting frames and building sk_buffs is not measured: it stands for the hardware and the network stack
+
+#define _GNU_SOURCE
+#include <sim/kernel.h>
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <x86intrin.h>
+
+#include "model.h"
+#include "net.h"
+
+// What we'd ask the stack for: a single sk_buff is never bigger than this
+#define BENCH_MAX_FRAME ( ETH_FRAME_LEN )
+
+// Frames handed to the driver between two TX completions
+#define BENCH_BURST_DEFAULT 16
+
+// Give up waiting for the driver after this long without any progress
+#define BENCH_STUCK_NS ( 1000 * 1000 * 1000ULL )
+
+// Frame sizes of --sweep (without FCS)
+static const unsigned int bench_sweep [ ] = { 60, 64, 128, 256, 512, 1024, 1280, 1514 };
+
+enum bench_mode
+{
+    BENCH_RX,
+    BENCH_TX,
+    BENCH_LOOPBACK,
+};
+
+static const char * const bench_mode_str [ ] =
+{
+    [ BENCH_RX ] = "rx",
+    [ BENCH_TX ] = "tx",
+    [ BENCH_LOOPBACK ] = "loopback",
+};
+
+// Cost of a code path: accumulated over all the times it ran
+struct bench_meter
+{
+    const char * path;
+    u64 ns;
+    u64 cycles;
+    u64 misses;
+    u64 mmio_reads;
+    u64 mmio_writes;
+    u64 irqs;
+
+    // While running
+    u64 start_ns;
+    u64 start_tsc;
+    u64 start_reads;
+    u64 start_writes;
+};
+
+// Hardware counters (perf_event_open), for our own process, user space only
+// Without them (perf_event_paranoid, no PMU in a VM), cycles come from the TSC, and cache misses are unknown
+static struct
+{
+    int leader;     // CPU cycles
+    int misses;     // Cache misses
+    bool ok;
+} bench_perf = { -1, -1, false };
+
+static struct
+{
+    enum bench_mode mode;
+    unsigned int size;
+    bool sweep;
+    u64 frames;
+    unsigned int burst;
+    u64 rate;
+    bool verify;
+    bool csv;
+
+    // Frames replayed from a pcap file, in a loop
+    u8 ** pcap;
+    unsigned int * pcap_len;
+    unsigned int pcap_nb;
+} bench =
+{
+    .mode = BENCH_RX,
+    .size = 1514,
+    .frames = 100000,
+    .burst = BENCH_BURST_DEFAULT,
+};
+
+// What we got back (from the stack or the wire), in order
+static struct
+{
+    u64 frames;
+    u64 bad;
+} bench_rx, bench_wire;
+
+static struct net_device * bench_ndev;
+
+static inline u64 _bench_now ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// Hardware counters
+//
+
+static int _bench_perf_open ( u64 config, int group )
+{
+    struct perf_event_attr attr;
+
+    memset ( & attr, 0, sizeof ( attr ) );
+    attr.size = sizeof ( attr );
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    return syscall ( SYS_perf_event_open, & attr, 0, -1, group, 0 );
+}
+
+static void _bench_perf_init ( void )
+{
+    bench_perf.leader = _bench_perf_open ( PERF_COUNT_HW_CPU_CYCLES, -1 );
+    if ( bench_perf.leader < 0 )
+    {
+        return;
+    }
+
+    bench_perf.misses = _bench_perf_open ( PERF_COUNT_HW_CACHE_MISSES, bench_perf.leader );
+    if ( bench_perf.misses < 0 )
+    {
+        close ( bench_perf.leader );
+        return;
+    }
+
+    bench_perf.ok = true;
+}
+
+// Current values of { cycles, cache misses }
+static void _bench_perf_read ( u64 * cycles, u64 * misses )
+{
+    struct
+    {
+        u64 nr;
+        u64 values [ 2 ];
+    } data;
+
+    if ( read ( bench_perf.leader, & data, sizeof ( data ) ) != sizeof ( data ) )
+    {
+        data.values [ 0 ] = data.values [ 1 ] = 0;
+    }
+
+    * cycles = data.values [ 0 ];
+    * misses = data.values [ 1 ];
+}
+
+static void _bench_meter_start ( struct bench_meter * meter )
+{
+    u64 misses;
+
+    meter -> start_reads = model_counters.mmio_reads;
+    meter -> start_writes = model_counters.mmio_writes;
+
+    if ( bench_perf.ok )
+    {
+        ioctl ( bench_perf.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+        _bench_perf_read ( & meter -> start_tsc, & misses );
+        meter -> misses -= misses;
+    }
+    else
+    {
+        meter -> start_tsc = __rdtsc ( );
+    }
+
+    meter -> start_ns = _bench_now ( );
+}
+
+static void _bench_meter_stop ( struct bench_meter * meter )
+{
+    u64 ns = _bench_now ( );
+    u64 cycles, misses;
+
+    if ( bench_perf.ok )
+    {
+        _bench_perf_read ( & cycles, & misses );
+        ioctl ( bench_perf.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+        meter -> misses += misses;
+    }
+    else
+    {
+        cycles = __rdtsc ( );
+    }
+
+    meter -> ns += ns - meter -> start_ns;
+    meter -> cycles += cycles - meter -> start_tsc;
+    meter -> mmio_reads += model_counters.mmio_reads - meter -> start_reads;
+    meter -> mmio_writes += model_counters.mmio_writes - meter -> start_writes;
+}
+
+//
+// Frames
+//
+
+// Frame number seq: from the pcap file, or ours (to our MAC, made up EtherType, seq and a pattern depending on it)
+static unsigned int _bench_frame ( u64 seq, unsigned int size, u8 * buf )
+{
+    static const u8 mac [ ETH_ALEN ] = MODEL_MAC;
+    static const u8 src [ ETH_ALEN ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    unsigned int i;
+
+    if ( bench.pcap_nb )
+    {
+        i = seq % bench.pcap_nb;
+        memcpy ( buf, bench.pcap [ i ], bench.pcap_len [ i ] );
+        return bench.pcap_len [ i ];
+    }
+
+    memcpy ( buf, mac, ETH_ALEN );
+    memcpy ( buf + ETH_ALEN, src, ETH_ALEN );
+    buf [ 12 ] = 0x88;
+    buf [ 13 ] = 0xb5;
+    memcpy ( buf + ETH_HLEN, & seq, sizeof ( seq ) );
+    for ( i = ETH_HLEN + sizeof ( seq ) ; i < size ; ++i )
+    {
+        buf [ i ] = seq + i;
+    }
+
+    return size;
+}
+
+// A frame came back: is it frame number seq? Short frames come back padded (ETH_ZLEN)
+static bool _bench_frame_check ( u64 seq, unsigned int size, const u8 * data, unsigned int len )
+{
+    u8 buf [ BENCH_MAX_FRAME ];
+    unsigned int expected = _bench_frame ( seq, size, buf );
+
+    if ( len != expected && ! ( expected < ETH_ZLEN && len == ETH_ZLEN ) )
+    {
+        return false;
+    }
+
+    return ! memcmp ( buf, data, expected );
+}
+
+// The stack got a frame from the driver
+static void _bench_rx_handler ( struct sk_buff * skb )
+{
+    // eth_type_trans pulled the Ethernet header
+    if ( bench.verify && ! _bench_frame_check ( bench_rx.frames, bench.size, skb -> data - ETH_HLEN, skb -> len + ETH_HLEN ) )
+    {
+        bench_rx.bad++;
+    }
+
+    bench_rx.frames++;
+}
+
+// A frame left on the wire
+static void _bench_wire ( const void * frame, unsigned int len )
+{
+    if ( bench.verify && ! _bench_frame_check ( bench_wire.frames, bench.size, frame, len ) )
+    {
+        bench_wire.bad++;
+    }
+
+    bench_wire.frames++;
+}
+
+// Classic pcap file (microsecond or nanosecond timestamps, either endianness), Ethernet frames only
+static int _bench_pcap_load ( const char * path )
+{
+    struct
+    {
+        u32 magic;
+        u16 major, minor;
+        u32 zone, sigfigs, snaplen, linktype;
+    } fh;
+    struct
+    {
+        u32 sec, frac, caplen, len;
+    } ph;
+    FILE * f = fopen ( path, "r" );
+    bool swap;
+    u8 * frame;
+
+    if ( ! f )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    if ( fread ( & fh, sizeof ( fh ), 1, f ) != 1 )
+    {
+        goto err_pcap;
+    }
+
+    swap = fh.magic == 0xd4c3b2a1 || fh.magic == 0x4d3cb2a1;
+    if ( ! swap && fh.magic != 0xa1b2c3d4 && fh.magic != 0xa1b23c4d )
+    {
+        goto err_pcap;
+    }
+
+    if ( ( swap ? __builtin_bswap32 ( fh.linktype ) : fh.linktype ) != 1 )
+    {
+        fprintf ( stderr, "%s: not an Ethernet capture\n", path );
+        fclose ( f );
+        return -1;
+    }
+
+    while ( fread ( & ph, sizeof ( ph ), 1, f ) == 1 )
+    {
+        if ( swap )
+        {
+            ph.caplen = __builtin_bswap32 ( ph.caplen );
+        }
+
+        frame = malloc ( ph.caplen );
+        if ( ! frame || fread ( frame, ph.caplen, 1, f ) != 1 )
+        {
+            free ( frame );
+            goto err_pcap;
+        }
+
+        // What the hardware can't send or receive (jumbo frames, truncated captures)
+        if ( ph.caplen < ETH_HLEN || ph.caplen > BENCH_MAX_FRAME )
+        {
+            free ( frame );
+            continue;
+        }
+
+        bench.pcap = realloc ( bench.pcap, ( bench.pcap_nb + 1 ) * sizeof ( * bench.pcap ) );
+        bench.pcap_len = realloc ( bench.pcap_len, ( bench.pcap_nb + 1 ) * sizeof ( * bench.pcap_len ) );
+        bench.pcap [ bench.pcap_nb ] = frame;
+        bench.pcap_len [ bench.pcap_nb ] = ph.caplen;
+        bench.pcap_nb++;
+    }
+
+    fclose ( f );
+
+    if ( ! bench.pcap_nb )
+    {
+        fprintf ( stderr, "%s: no frame we can replay\n", path );
+        return -1;
+    }
+
+    return 0;
+
+err_pcap:
+    fprintf ( stderr, "%s: not a valid pcap file\n", path );
+    fclose ( f );
+    return -1;
+}
+
+// --rate: wait until frame number seq is due
+static void _bench_pace ( u64 start, u64 seq )
+{
+    u64 due;
+
+    if ( ! bench.rate )
+    {
+        return;
+    }
+
+    due = start + seq * 1000000000ULL / bench.rate;
+    while ( _bench_now ( ) < due )
+    {
+        __builtin_ia32_pause ( );
+    }
+}
+
+//
+// Runs
+//
+
+// Let the driver handle whatever the model has for it, until the stack got rx_target frames
+// With interrupt coalescing, nothing happens until the hardware timer fires: only the IRQ handler and the poll are measured
+static int _bench_drain ( struct bench_meter * meter, u64 rx_target, u64 tx_target )
+{
+    u64 progress = _bench_now ( );
+    u64 rx = bench_rx.frames, tx = model_counters.tx_frames;
+    int irqs;
+
+    while ( bench_rx.frames < rx_target || model_counters.tx_frames < tx_target )
+    {
+        // The hardware sends what it has been given
+        model_tx_process ( );
+
+        if ( model_irq_asserted ( ) )
+        {
+            _bench_meter_start ( meter );
+            irqs = sim_irq_run ( );
+            sim_napi_run ( );
+            _bench_meter_stop ( meter );
+            meter -> irqs += irqs;
+        }
+
+        // Link check, DIM...
+        sim_work_run ( );
+
+        if ( bench_rx.frames != rx || model_counters.tx_frames != tx )
+        {
+            rx = bench_rx.frames;
+            tx = model_counters.tx_frames;
+            progress = _bench_now ( );
+        }
+        else if ( _bench_now ( ) - progress > BENCH_STUCK_NS )
+        {
+            fprintf ( stderr, "Driver stuck: %llu/%llu frames received, %llu/%llu sent\n",
+                      bench_rx.frames, rx_target, model_counters.tx_frames, tx_target );
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// RX: fill the RX ring with a burst of frames, and let the driver empty it
+static int _bench_run_rx ( struct bench_meter * meter, u64 frames )
+{
+    u8 buf [ BENCH_MAX_FRAME ];
+    u64 start = _bench_now ( );
+    u64 seq = 0, target = 0;
+    unsigned int len, n;
+
+    bench_rx.frames = 0;
+
+    while ( seq < frames )
+    {
+        for ( n = 0; n < bench.burst && seq < frames ; ++n, ++seq )
+        {
+            _bench_pace ( start, seq );
+
+            len = _bench_frame ( seq, bench.size, buf );
+            if ( ! model_rx_fits ( len ) )
+            {
+                break;
+            }
+
+            // Filtered frames never make it to the stack: renumber them (see _bench_rx_handler)
+            if ( model_rx_frame ( buf, len ) )
+            {
+                target++;
+            }
+        }
+
+        if ( _bench_drain ( meter, target, 0 ) )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// TX (and loopback): hand a burst of frames to the driver, then let the hardware send them
+static int _bench_run_tx ( struct bench_meter * xmit, struct bench_meter * complete, u64 frames )
+{
+    struct sk_buff * skbs [ bench.burst ];
+    u64 start = _bench_now ( );
+    u64 seq = 0, tx_target = model_counters.tx_frames;
+    unsigned int len, n, i;
+
+    bench_rx.frames = 0;
+    bench_wire.frames = 0;
+
+    while ( seq < frames )
+    {
+        // What the stack would have built
+        for ( n = 0; n < bench.burst && seq + n < frames ; ++n )
+        {
+            skbs [ n ] = sim_skb_alloc ( BENCH_MAX_FRAME );
+            len = _bench_frame ( seq + n, bench.size, skbs [ n ] -> data );
+            skb_put ( skbs [ n ], len );
+            skbs [ n ] -> dev = bench_ndev;
+        }
+
+        _bench_pace ( start, seq );
+
+        // The stack stops at the first frame we can't take
+        _bench_meter_start ( xmit );
+        for ( i = 0; i < n && ! netif_queue_stopped ( bench_ndev ) ; ++i )
+        {
+            sim_xmit_more = i < n - 1;
+            if ( bench_ndev -> netdev_ops -> ndo_start_xmit ( skbs [ i ], bench_ndev ) != NETDEV_TX_OK )
+            {
+                break;
+            }
+        }
+        _bench_meter_stop ( xmit );
+
+        for ( n = i; n < bench.burst && seq + n < frames ; ++n )
+        {
+            sim_skb_free ( skbs [ n ] );
+        }
+        seq += i;
+        tx_target += i;
+
+        if ( _bench_drain ( complete, bench.mode == BENCH_LOOPBACK ? seq : 0, tx_target ) )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void _bench_report_header ( void )
+{
+    if ( bench.csv )
+    {
+        printf ( "mode,path,size,frames,ns_per_frame,cycles_per_frame,cache_misses_per_frame,"
+                 "mmio_reads_per_frame,mmio_writes_per_frame,irqs_per_frame,errors\n" );
+        return;
+    }
+
+    printf ( "%-9s %-11s %5s %9s %9s %11s %8s %7s %7s %6s %6s\n", "mode", "path", "size", "frames",
+             "ns/frame", bench_perf.ok ? "cycles/frm" : "tsc/frame", "miss/frm", "rd/frm", "wr/frm", "irq/fr", "errors" );
+}
+
+static void _bench_report ( const struct bench_meter * meter, unsigned int size, u64 frames, u64 errors )
+{
+    char misses [ 32 ] = "n/a";
+    double n = frames ? frames : 1;
+
+    if ( bench_perf.ok )
+    {
+        snprintf ( misses, sizeof ( misses ), "%.2f", meter -> misses / n );
+    }
+
+    printf ( bench.csv ? "%s,%s,%u,%llu,%.1f,%.1f,%s,%.2f,%.2f,%.3f,%llu\n" :
+                         "%-9s %-11s %5u %9llu %9.1f %11.1f %8s %7.2f %7.2f %6.3f %6llu\n",
+             bench_mode_str [ bench.mode ], meter -> path, size, frames, meter -> ns / n, meter -> cycles / n,
+             misses, meter -> mmio_reads / n, meter -> mmio_writes / n, meter -> irqs / n, errors );
+}
+
+// One frame size: a warm up run (caches, page pool, sk_buff cache), then the measured run
+static int _bench_size ( unsigned int size )
+{
+    struct bench_meter m1 = { 0 }, m2 = { 0 };
+    u64 frames = bench.frames, errors;
+    int err;
+
+    bench.size = size;
+    m1.path = bench.mode == BENCH_RX ? "irq+poll" : "start_xmit";
+    m2.path = "irq+poll";
+
+    err = bench.mode == BENCH_RX ? _bench_run_rx ( & m1, bench.burst * 8 ) : _bench_run_tx ( & m1, & m2, bench.burst * 8 );
+    if ( err )
+    {
+        return err;
+    }
+
+    memset ( & m1, 0, sizeof ( m1 ) );
+    memset ( & m2, 0, sizeof ( m2 ) );
+    m1.path = bench.mode == BENCH_RX ? "irq+poll" : "start_xmit";
+    m2.path = "irq+poll";
+    bench_rx.bad = bench_wire.bad = 0;
+
+    err = bench.mode == BENCH_RX ? _bench_run_rx ( & m1, frames ) : _bench_run_tx ( & m1, & m2, frames );
+    if ( err )
+    {
+        return err;
+    }
+
+    errors = bench_rx.bad + bench_wire.bad;
+    if ( bench.mode != BENCH_TX && bench_rx.frames != frames )
+    {
+        errors += frames - bench_rx.frames;
+    }
+
+    _bench_report ( & m1, size, frames, errors );
+    if ( bench.mode != BENCH_RX )
+    {
+        _bench_report ( & m2, size, frames, errors );
+    }
+
+    return errors ? -1 : 0;
+}
+
+static void _bench_usage ( const char * name )
+{
+    fprintf ( stderr,
+        "Usage: %s [options]\n"
+        "  -m, --mode rx|tx|loopback  What to measure (default: rx)\n"
+        "  -s, --size N               Frame size, without FCS (default: 1514)\n"
+        "  -S, --sweep                Sizes from 60 to 1514 bytes\n"
+        "  -n, --frames N             Frames per size (default: 100000)\n"
+        "  -b, --burst N              Frames injected / handed to the driver at once (default: %d)\n"
+        "  -r, --rate PPS             Frames per second (default: as fast as possible)\n"
+        "  -p, --pcap FILE            Replay the frames of a pcap file (promiscuous mode)\n"
+        "  -P, --param NAME=VALUE     Driver module parameter (txrx, early_rx, debug...)\n"
+        "  -V, --verify               Check every frame byte for byte (on RX, measured with the poll)\n"
+        "  -c, --csv                  Machine readable output\n"
+        "  -v, --verbose              Driver messages\n",
+        name, BENCH_BURST_DEFAULT );
+}
+
+int main ( int argc, char ** argv )
+{
+    static const struct option options [ ] =
+    {
+        { "mode", required_argument, NULL, 'm' },
+        { "size", required_argument, NULL, 's' },
+        { "sweep", no_argument, NULL, 'S' },
+        { "frames", required_argument, NULL, 'n' },
+        { "burst", required_argument, NULL, 'b' },
+        { "rate", required_argument, NULL, 'r' },
+        { "pcap", required_argument, NULL, 'p' },
+        { "param", required_argument, NULL, 'P' },
+        { "verify", no_argument, NULL, 'V' },
+        { "csv", no_argument, NULL, 'c' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    struct pci_dev pdev = { .irq = MODEL_IRQ };
+    char * value;
+    u64 total = 0;
+    unsigned int i;
+    int opt, err = 0;
+
+    // Quiet driver, unless asked otherwise
+    sim_param_set ( "debug", 0 );
+
+    while ( ( opt = getopt_long ( argc, argv, "m:s:Sn:b:r:p:P:Vcvh", options, NULL ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'm':
+                i = 0;
+                while ( i < ARRAY_SIZE ( bench_mode_str ) && strcmp ( optarg, bench_mode_str [ i ] ) )
+                {
+                    ++i;
+                }
+                if ( i == ARRAY_SIZE ( bench_mode_str ) )
+                {
+                    _bench_usage ( argv [ 0 ] );
+                    return 1;
+                }
+                bench.mode = i;
+                break;
+
+            case 's':
+                bench.size = strtoul ( optarg, NULL, 0 );
+                break;
+
+            case 'S':
+                bench.sweep = true;
+                break;
+
+            case 'n':
+                bench.frames = strtoull ( optarg, NULL, 0 );
+                break;
+
+            case 'b':
+                bench.burst = strtoul ( optarg, NULL, 0 );
+                break;
+
+            case 'r':
+                bench.rate = strtoull ( optarg, NULL, 0 );
+                break;
+
+            case 'p':
+                if ( _bench_pcap_load ( optarg ) )
+                {
+                    return 1;
+                }
+                break;
+
+            case 'P':
+                value = strchr ( optarg, '=' );
+                if ( ! value )
+                {
+                    _bench_usage ( argv [ 0 ] );
+                    return 1;
+                }
+                * value++ = '\0';
+                if ( sim_param_set ( optarg, strtol ( value, NULL, 0 ) ) )
+                {
+                    fprintf ( stderr, "Unknown module parameter: %s\n", optarg );
+                    return 1;
+                }
+                break;
+
+            case 'V':
+                bench.verify = true;
+                break;
+
+            case 'c':
+                bench.csv = true;
+                break;
+
+            case 'v':
+                sim_verbose = true;
+                sim_param_set ( "debug", -1 );
+                break;
+
+            default:
+                _bench_usage ( argv [ 0 ] );
+                return opt != 'h';
+        }
+    }
+
+    if ( bench.size < ETH_HLEN + sizeof ( u64 ) || bench.size > BENCH_MAX_FRAME || ! bench.burst || ! bench.frames )
+    {
+        _bench_usage ( argv [ 0 ] );
+        return 1;
+    }
+
+    // With a pcap file, the size we report is the mean frame size
+    if ( bench.pcap_nb )
+    {
+        for ( i = 0; i < bench.pcap_nb ; ++i )
+        {
+            total += bench.pcap_len [ i ];
+        }
+        bench.size = total / bench.pcap_nb;
+    }
+
+    // Loopback needs both directions, and TCR_LBK_ENABLE
+    if ( bench.mode == BENCH_LOOPBACK )
+    {
+        sim_param_set ( "txrx", 7 );
+    }
+
+    // Probe and bring the interface up, as the PCI core and ip link would
+    model_init ( );
+    model_set_wire ( _bench_wire );
+    sim_rx_handler = _bench_rx_handler;
+
+    err = r8139dn_net_init ( & pdev, model_mmio ( ) );
+    if ( err )
+    {
+        fprintf ( stderr, "Probe failed: %d\n", err );
+        return 1;
+    }
+
+    bench_ndev = pci_get_drvdata ( & pdev );
+    if ( bench.pcap_nb )
+    {
+        bench_ndev -> flags |= IFF_PROMISC;
+    }
+
+    err = bench_ndev -> netdev_ops -> ndo_open ( bench_ndev );
+    if ( err )
+    {
+        fprintf ( stderr, "Open failed: %d\n", err );
+        return 1;
+    }
+    bench_ndev -> running = true;
+
+    _bench_perf_init ( );
+    _bench_report_header ( );
+
+    if ( bench.sweep && ! bench.pcap_nb )
+    {
+        for ( i = 0; i < ARRAY_SIZE ( bench_sweep ) && ! err ; ++i )
+        {
+            err = _bench_size ( bench_sweep [ i ] );
+        }
+    }
+    else
+    {
+        err = _bench_size ( bench.size );
+    }
+
+    if ( model_counters.rx_overflows )
+    {
+        fprintf ( stderr, "RX ring overflowed %llu times\n", model_counters.rx_overflows );
+    }
+
+    bench_ndev -> netdev_ops -> ndo_stop ( bench_ndev );
+
+    return err ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+// Userspace simulator: the kernel API the driver needs is in <sim/kernel.h>
+#include <sim/kernel.h>
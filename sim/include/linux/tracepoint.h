@@ -0,0 +1,20 @@
+// Userspace simulator: tracepoints are never enabled
+// TRACE_EVENT only declares trace_<name> (which does nothing) and trace_<name>_enabled (always false)
+#ifndef _R8139DN_SIM_TRACEPOINT_H
+#define _R8139DN_SIM_TRACEPOINT_H
+
+#include <sim/kernel.h>
+
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+    static inline void trace_##name ( proto ) \
+    { \
+    } \
+    static inline bool trace_##name##_enabled ( void ) \
+    { \
+        return false; \
+    }
+
+#endif
@@ -0,0 +1,967 @@
+#ifndef _R8139DN_SIM_KERNEL_H
+#define _R8139DN_SIM_KERNEL_H
+
+// Just enough of the kernel API for net.c, hw.c, cp.c and stats.c to build and run in userspace
+// Every <linux/...> header the driver includes ends up here (see the one-liners next to this file)
+// The hardware behind ioread* / iowrite* and the DMA addresses is our register model (model.c)
+// Everything runs on a single thread: locks are no-ops, there is one CPU, "IRQs" and "softirqs"
+// are the harness calling our handlers (kernel.c)
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// uapi headers: the same constants and structures as the kernel (ETH_*, MII / BMCR_* / LPA_*, ethtool, iphdr...)
+#include <linux/types.h>
+#include <linux/if_ether.h>
+#include <linux/mii.h>
+#include <linux/ethtool.h>
+#include <linux/ip.h>
+#include <linux/if_link.h>
+
+//
+// Types, attributes and helpers
+//
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+
+typedef u64 dma_addr_t;
+typedef u64 netdev_features_t;
+typedef unsigned int gfp_t;
+typedef s64 ktime_t;
+
+#define __iomem
+#define __percpu
+#define __force
+#define __rcu
+#define __aligned(x) __attribute__ ( ( aligned ( x ) ) )
+#define __packed __attribute__ ( ( packed ) )
+#define __always_unused __attribute__ ( ( unused ) )
+#define fallthrough __attribute__ ( ( __fallthrough__ ) )
+
+#define likely(x) __builtin_expect ( !! ( x ), 1 )
+#define unlikely(x) __builtin_expect ( !! ( x ), 0 )
+
+#define BIT(nr) ( 1UL << ( nr ) )
+#define ARRAY_SIZE(a) ( sizeof ( a ) / sizeof ( ( a ) [ 0 ] ) )
+#define BUILD_BUG_ON(cond) ( ( void ) sizeof ( char [ 1 - 2 * !! ( cond ) ] ) )
+#define container_of(ptr, type, member) ( ( type * ) ( ( char * ) ( ptr ) - offsetof ( type, member ) ) )
+#define IS_ALIGNED(x, a) ( ( ( x ) & ( ( typeof ( x ) ) ( a ) - 1 ) ) == 0 )
+#define ALIGN(x, a) ( ( ( x ) + ( a ) - 1 ) & ~ ( ( typeof ( x ) ) ( a ) - 1 ) )
+
+#define min(a, b) ( ( a ) < ( b ) ? ( a ) : ( b ) )
+#define max(a, b) ( ( a ) > ( b ) ? ( a ) : ( b ) )
+#define min_t(type, a, b) ( ( type ) ( a ) < ( type ) ( b ) ? ( type ) ( a ) : ( type ) ( b ) )
+#define max_t(type, a, b) ( ( type ) ( a ) > ( type ) ( b ) ? ( type ) ( a ) : ( type ) ( b ) )
+
+#define lower_32_bits(n) ( ( u32 ) ( ( n ) & 0xffffffff ) )
+#define upper_32_bits(n) ( ( u32 ) ( ( ( u64 ) ( n ) ) >> 32 ) )
+
+#define ilog2(n) ( 63 - __builtin_clzll ( n ) )
+#define is_power_of_2(n) ( ( n ) != 0 && ( ( ( n ) & ( ( n ) - 1 ) ) == 0 ) )
+
+static inline int fls64 ( u64 x )
+{
+    return x ? 64 - __builtin_clzll ( x ) : 0;
+}
+
+// Little endian host only, just like the model (see model.c)
+#define cpu_to_le16(x) ( ( __le16 ) ( x ) )
+#define cpu_to_le32(x) ( ( __le32 ) ( x ) )
+#define cpu_to_le64(x) ( ( __le64 ) ( x ) )
+#define le16_to_cpu(x) ( ( u16 ) ( x ) )
+#define le32_to_cpu(x) ( ( u32 ) ( x ) )
+#define le64_to_cpu(x) ( ( u64 ) ( x ) )
+#define swab16(x) __builtin_bswap16 ( x )
+
+#define MAX_ERRNO 4095
+#define IS_ERR(ptr) ( ( unsigned long ) ( ptr ) >= ( unsigned long ) - MAX_ERRNO )
+#define ERR_PTR(err) ( ( void * ) ( long ) ( err ) )
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 0
+
+#define PAGE_SIZE 4096UL
+#define SMP_CACHE_BYTES 64
+#define NET_SKB_PAD 64
+#define NET_IP_ALIGN 2
+#define SKB_DATA_ALIGN(x) ( ( ( x ) + ( SMP_CACHE_BYTES - 1 ) ) & ~ ( SMP_CACHE_BYTES - 1 ) )
+#define MAX_SKB_FRAGS 17
+
+//
+// Memory ordering: x86-64 semantics through the compiler builtins
+//
+
+#define READ_ONCE(x) ( * ( const volatile typeof ( x ) * ) & ( x ) )
+#define WRITE_ONCE(x, val) do { * ( volatile typeof ( x ) * ) & ( x ) = ( val ); } while ( 0 )
+#define smp_load_acquire(p) __atomic_load_n ( p, __ATOMIC_ACQUIRE )
+#define smp_store_release(p, v) __atomic_store_n ( p, v, __ATOMIC_RELEASE )
+#define smp_mb() __atomic_thread_fence ( __ATOMIC_SEQ_CST )
+#define smp_wmb() __atomic_thread_fence ( __ATOMIC_RELEASE )
+#define smp_rmb() __atomic_thread_fence ( __ATOMIC_ACQUIRE )
+#define mb() __atomic_thread_fence ( __ATOMIC_SEQ_CST )
+#define wmb() __atomic_thread_fence ( __ATOMIC_RELEASE )
+#define rmb() __atomic_thread_fence ( __ATOMIC_ACQUIRE )
+#define dma_wmb() __atomic_signal_fence ( __ATOMIC_SEQ_CST )
+#define dma_rmb() __atomic_signal_fence ( __ATOMIC_SEQ_CST )
+#define xchg(p, v) __atomic_exchange_n ( p, v, __ATOMIC_SEQ_CST )
+#define prefetch(p) __builtin_prefetch ( p )
+#define net_prefetch(p) __builtin_prefetch ( p )
+
+//
+// Time: jiffies and ktime come from CLOCK_MONOTONIC, delays don't wait at all
+// (the model completes everything instantly)
+//
+
+#define HZ 1000
+#define NSEC_PER_SEC 1000000000ULL
+
+u64 ktime_get_ns ( void );
+#define jiffies ( ( unsigned long ) ( ktime_get_ns ( ) / ( NSEC_PER_SEC / HZ ) ) )
+#define time_before(a, b) ( ( long ) ( ( a ) - ( b ) ) < 0 )
+#define time_after(a, b) time_before ( b, a )
+#define udelay(us) do { } while ( 0 )
+#define usleep_range(min, max) do { } while ( 0 )
+
+//
+// Locks: single thread, nothing to protect against
+//
+
+typedef struct { int unused; } spinlock_t;
+
+#define spin_lock_init(l) ( ( void ) ( l ) )
+#define spin_lock(l) ( ( void ) ( l ) )
+#define spin_unlock(l) ( ( void ) ( l ) )
+#define spin_lock_bh(l) ( ( void ) ( l ) )
+#define spin_unlock_bh(l) ( ( void ) ( l ) )
+#define spin_lock_irqsave(l, flags) do { ( void ) ( l ); ( flags ) = 0; } while ( 0 )
+#define spin_unlock_irqrestore(l, flags) do { ( void ) ( l ); ( void ) ( flags ); } while ( 0 )
+#define rtnl_lock() do { } while ( 0 )
+#define rtnl_unlock() do { } while ( 0 )
+#define smp_processor_id() 0
+
+//
+// Module parameters: the harness sets them by name before probing (sim_param_set)
+//
+
+void sim_param_register ( const char * name, int * value );
+int sim_param_set ( const char * name, int value );
+
+#define module_param(name, type, perm) \
+    static void __attribute__ ( ( constructor ) ) __sim_param_##name ( void ) \
+    { \
+        sim_param_register ( #name, & name ); \
+    }
+#define MODULE_PARM_DESC(name, desc) \
+    static const char __sim_param_desc_##name [ ] __attribute__ ( ( unused ) ) = desc
+
+//
+// Logging
+//
+
+extern bool sim_verbose;
+
+#ifndef pr_fmt
+#define pr_fmt(fmt) fmt
+#endif
+#define pr_info(fmt, ...) do { if ( sim_verbose ) fprintf ( stderr, pr_fmt ( fmt ), ##__VA_ARGS__ ); } while ( 0 )
+#define pr_warn(fmt, ...) fprintf ( stderr, pr_fmt ( fmt ), ##__VA_ARGS__ )
+#define pr_err(fmt, ...) fprintf ( stderr, pr_fmt ( fmt ), ##__VA_ARGS__ )
+#define netdev_info(ndev, fmt, ...) do { if ( sim_verbose ) fprintf ( stderr, "%s: " fmt, ( ndev ) -> name, ##__VA_ARGS__ ); } while ( 0 )
+#define netdev_warn(ndev, fmt, ...) fprintf ( stderr, "%s: " fmt, ( ndev ) -> name, ##__VA_ARGS__ )
+#define netdev_err(ndev, fmt, ...) fprintf ( stderr, "%s: " fmt, ( ndev ) -> name, ##__VA_ARGS__ )
+#define netdev_dbg(ndev, fmt, ...) do { if ( 0 ) fprintf ( stderr, "%s: " fmt, ( ndev ) -> name, ##__VA_ARGS__ ); } while ( 0 )
+
+#define NETIF_MSG_DRV       0x0001
+#define NETIF_MSG_PROBE     0x0002
+#define NETIF_MSG_LINK      0x0004
+#define NETIF_MSG_TIMER     0x0008
+#define NETIF_MSG_IFDOWN    0x0010
+#define NETIF_MSG_IFUP      0x0020
+#define NETIF_MSG_RX_ERR    0x0040
+#define NETIF_MSG_TX_ERR    0x0080
+
+static inline u32 netif_msg_init ( int debug_value, int default_msg_enable_bits )
+{
+    if ( debug_value < 0 || debug_value >= 32 )
+    {
+        return default_msg_enable_bits;
+    }
+
+    return debug_value ? ( 1U << debug_value ) - 1 : 0;
+}
+
+#define netif_msg_drv(p)        ( ( p ) -> msg_enable & NETIF_MSG_DRV )
+#define netif_msg_probe(p)      ( ( p ) -> msg_enable & NETIF_MSG_PROBE )
+#define netif_msg_link(p)       ( ( p ) -> msg_enable & NETIF_MSG_LINK )
+#define netif_msg_timer(p)      ( ( p ) -> msg_enable & NETIF_MSG_TIMER )
+#define netif_msg_ifdown(p)     ( ( p ) -> msg_enable & NETIF_MSG_IFDOWN )
+#define netif_msg_ifup(p)       ( ( p ) -> msg_enable & NETIF_MSG_IFUP )
+#define netif_msg_rx_err(p)     ( ( p ) -> msg_enable & NETIF_MSG_RX_ERR )
+#define netif_msg_tx_err(p)     ( ( p ) -> msg_enable & NETIF_MSG_TX_ERR )
+
+//
+// Memory
+//
+
+#define kmalloc(size, gfp) malloc ( size )
+#define kzalloc(size, gfp) calloc ( 1, size )
+#define kcalloc(n, size, gfp) calloc ( n, size )
+#define kfree(p) free ( p )
+
+// Per-CPU memory: we only have CPU 0
+#define alloc_percpu(type) ( ( type * ) calloc ( 1, sizeof ( type ) ) )
+#define devm_alloc_percpu(dev, type) alloc_percpu ( type )
+#define free_percpu(p) free ( p )
+#define this_cpu_ptr(p) ( p )
+#define per_cpu_ptr(p, cpu) ( ( void ) ( cpu ), ( p ) )
+#define this_cpu_inc(x) ( ( x ) ++ )
+#define for_each_possible_cpu(cpu) for ( ( cpu ) = 0; ( cpu ) < 1 ; ++ ( cpu ) )
+
+// u64_stats_sync: 64 bit counters are atomic on 64 bit CPUs, there's nothing to sync
+struct u64_stats_sync { int unused; };
+typedef struct { u64 v; } u64_stats_t;
+
+#define u64_stats_init(s) ( ( void ) ( s ) )
+#define u64_stats_update_begin(s) ( ( void ) ( s ) )
+#define u64_stats_update_end(s) ( ( void ) ( s ) )
+#define u64_stats_update_begin_irqsave(s) ( ( void ) ( s ), 0UL )
+#define u64_stats_update_end_irqrestore(s, flags) ( ( void ) ( s ), ( void ) ( flags ) )
+#define u64_stats_fetch_begin_irq(s) ( ( void ) ( s ), 0U )
+#define u64_stats_fetch_retry_irq(s, start) ( ( void ) ( s ), ( void ) ( start ), false )
+#define u64_stats_read(p) ( ( p ) -> v )
+#define u64_stats_add(p, val) ( ( p ) -> v += ( val ) )
+#define u64_stats_inc(p) ( ( p ) -> v ++ )
+
+//
+// Devices
+//
+
+struct device
+{
+    void * driver_data;
+};
+
+struct pci_dev
+{
+    struct device dev;
+    int irq;
+};
+
+#define pci_set_drvdata(pdev, data) ( ( pdev ) -> dev.driver_data = ( data ) )
+#define pci_get_drvdata(pdev) ( ( struct net_device * ) ( pdev ) -> dev.driver_data )
+#define dev_get_drvdata(dev) ( ( dev ) -> driver_data )
+#define dev_to_node(dev) 0
+
+struct dentry;
+
+//
+// MMIO: our register model (model.c)
+//
+
+u8 ioread8 ( const void __iomem * addr );
+u16 ioread16 ( const void __iomem * addr );
+u32 ioread32 ( const void __iomem * addr );
+void iowrite8 ( u8 val, void __iomem * addr );
+void iowrite16 ( u16 val, void __iomem * addr );
+void iowrite32 ( u32 val, void __iomem * addr );
+#define __raw_writew(val, addr) iowrite16 ( val, addr )
+#define __raw_writel(val, addr) iowrite32 ( val, addr )
+
+// Poll a register until cond is true (sleeping is a no-op here: give the model a fixed number of tries)
+#define readx_poll_timeout(op, addr, val, cond, sleep_us, timeout_us) \
+    ( { \
+        int __tries = ( timeout_us ) / ( ( sleep_us ) ? ( sleep_us ) : 1 ) + 1; \
+        for ( ;; ) \
+        { \
+            ( val ) = op ( addr ); \
+            if ( ( cond ) || ! __tries -- ) \
+            { \
+                break; \
+            } \
+        } \
+        ( cond ) ? 0 : - ETIMEDOUT; \
+    } )
+
+//
+// DMA: the driver's DMA memory comes from an arena in the first 4G of our address space,
+// so that a bus address is the CPU address itself (see sim_dma_alloc). The model reads it right away
+//
+
+enum dma_data_direction
+{
+    DMA_BIDIRECTIONAL,
+    DMA_TO_DEVICE,
+    DMA_FROM_DEVICE,
+};
+
+#define DMA_MAPPING_ERROR ( ~ ( dma_addr_t ) 0 )
+
+void * sim_dma_alloc ( size_t size, size_t align );
+void sim_dma_free ( void * ptr, size_t size );
+
+static inline void * dma_alloc_coherent ( struct device * dev, size_t size, dma_addr_t * dma, gfp_t gfp )
+{
+    void * ptr = sim_dma_alloc ( size, PAGE_SIZE );
+
+    if ( ptr )
+    {
+        memset ( ptr, 0, size );
+        * dma = ( dma_addr_t ) ( uintptr_t ) ptr;
+    }
+
+    return ptr;
+}
+
+static inline void dma_free_coherent ( struct device * dev, size_t size, void * ptr, dma_addr_t dma )
+{
+    sim_dma_free ( ptr, size );
+}
+
+static inline dma_addr_t dma_map_single ( struct device * dev, void * ptr, size_t size, enum dma_data_direction dir )
+{
+    uintptr_t addr = ( uintptr_t ) ptr;
+
+    // The RTL8139 only has 32 bit DMA
+    return addr + size <= 0xffffffffUL ? addr : DMA_MAPPING_ERROR;
+}
+
+#define dma_unmap_single(dev, dma, size, dir) ( ( void ) ( dev ), ( void ) ( dma ) )
+#define dma_unmap_page(dev, dma, size, dir) ( ( void ) ( dev ), ( void ) ( dma ) )
+#define dma_mapping_error(dev, dma) ( ( dma ) == DMA_MAPPING_ERROR )
+
+//
+// Pages and page pools
+//
+
+// Our pages are PAGE_SIZE aligned: the struct page is stored right after the data
+struct page_pool;
+struct page
+{
+    struct page_pool * pool;
+    struct page * next;
+};
+
+#define page_address(page) ( ( void * ) ( ( char * ) ( page ) - PAGE_SIZE ) )
+#define virt_to_page(addr) ( ( struct page * ) ( ( ( uintptr_t ) ( addr ) & ~ ( PAGE_SIZE - 1 ) ) + PAGE_SIZE ) )
+
+struct page_pool_params
+{
+    unsigned int flags;
+    unsigned int order;
+    unsigned int pool_size;
+    int nid;
+    struct device * dev;
+    enum dma_data_direction dma_dir;
+    unsigned int max_len;
+    unsigned int offset;
+};
+
+#define PP_FLAG_PAGE_FRAG ( 1 << 2 )
+
+struct page_pool * page_pool_create ( const struct page_pool_params * params );
+void page_pool_destroy ( struct page_pool * pool );
+struct page * page_pool_dev_alloc_pages ( struct page_pool * pool );
+struct page * page_pool_dev_alloc_frag ( struct page_pool * pool, unsigned int * offset, unsigned int size );
+void page_pool_recycle_direct ( struct page_pool * pool, struct page * page );
+#define page_pool_put_full_page(pool, page, allow_direct) page_pool_recycle_direct ( pool, page )
+
+//
+// sk_buff
+//
+
+typedef struct
+{
+    struct page * page;
+    unsigned int offset;
+    unsigned int size;
+} skb_frag_t;
+
+struct skb_shared_info
+{
+    u8 nr_frags;
+    unsigned short gso_size;
+    unsigned short gso_segs;
+    skb_frag_t frags [ MAX_SKB_FRAGS ];
+};
+
+enum
+{
+    CHECKSUM_NONE,
+    CHECKSUM_UNNECESSARY,
+    CHECKSUM_COMPLETE,
+    CHECKSUM_PARTIAL,
+};
+
+struct sk_buff
+{
+    struct sk_buff * next;
+    struct net_device * dev;
+
+    unsigned int len;
+    unsigned int data_len;
+    unsigned char * head;
+    unsigned char * data;
+    unsigned char * tail;
+    unsigned char * end;
+
+    __be16 protocol;
+    u8 ip_summed;
+    bool pp_recycle;
+    bool vlan_present;
+    u16 vlan_tci;
+
+    // Our own buffer. The data may live elsewhere: in a page pool page (napi_build_skb)
+    unsigned char * buf;
+
+    struct skb_shared_info shinfo;
+};
+
+struct sk_buff * sim_skb_alloc ( unsigned int size );
+void sim_skb_free ( struct sk_buff * skb );
+
+#define skb_shinfo(skb) ( & ( skb ) -> shinfo )
+#define skb_headlen(skb) ( ( skb ) -> len - ( skb ) -> data_len )
+#define skb_is_nonlinear(skb) ( ( skb ) -> data_len != 0 )
+#define skb_is_gso(skb) ( skb_shinfo ( skb ) -> gso_size != 0 )
+#define skb_frag_size(frag) ( ( frag ) -> size )
+#define skb_mark_for_recycle(skb) ( ( skb ) -> pp_recycle = true )
+#define skb_vlan_tag_present(skb) ( ( skb ) -> vlan_present )
+#define skb_vlan_tag_get(skb) ( ( skb ) -> vlan_tci )
+#define ip_hdr(skb) ( ( struct iphdr * ) ( ( skb ) -> data + ETH_HLEN ) )
+
+static inline void * skb_put ( struct sk_buff * skb, unsigned int len )
+{
+    void * tail = skb -> tail;
+
+    skb -> tail += len;
+    skb -> len += len;
+    return tail;
+}
+
+static inline void skb_reserve ( struct sk_buff * skb, int len )
+{
+    skb -> data += len;
+    skb -> tail += len;
+}
+
+static inline void * skb_pull ( struct sk_buff * skb, unsigned int len )
+{
+    skb -> len -= len;
+    return skb -> data += len;
+}
+
+static inline void skb_copy_to_linear_data ( struct sk_buff * skb, const void * from, unsigned int len )
+{
+    memcpy ( skb -> data, from, len );
+}
+
+static inline void __vlan_hwaccel_put_tag ( struct sk_buff * skb, __be16 proto, u16 tci )
+{
+    skb -> vlan_present = true;
+    skb -> vlan_tci = tci;
+}
+
+static inline dma_addr_t skb_frag_dma_map ( struct device * dev, const skb_frag_t * frag, size_t offset,
+                                            size_t size, enum dma_data_direction dir )
+{
+    return dma_map_single ( dev, ( char * ) page_address ( frag -> page ) + frag -> offset + offset, size, dir );
+}
+
+// Gather the head and the fragments (the harness never asks for a checksum: CHECKSUM_PARTIAL is not handled)
+void skb_copy_and_csum_dev ( const struct sk_buff * skb, u8 * to );
+
+#define skb_checksum_help(skb) 0
+#define dev_kfree_skb(skb) sim_skb_free ( skb )
+#define dev_kfree_skb_any(skb) sim_skb_free ( skb )
+#define dev_consume_skb_any(skb) sim_skb_free ( skb )
+#define dev_consume_skb_irq(skb) sim_skb_free ( skb )
+#define kfree_skb(skb) sim_skb_free ( skb )
+#define consume_skb(skb) sim_skb_free ( skb )
+
+static inline int eth_skb_pad ( struct sk_buff * skb )
+{
+    if ( skb -> len < ETH_ZLEN )
+    {
+        memset ( skb -> tail, 0, ETH_ZLEN - skb -> len );
+        skb_put ( skb, ETH_ZLEN - skb -> len );
+    }
+
+    return 0;
+}
+
+//
+// Network devices
+//
+
+#define IFNAMSIZ 16
+#define IFF_PROMISC 0x100
+#define IFF_ALLMULTI 0x200
+
+#define NETIF_F_SG              BIT ( 0 )
+#define NETIF_F_IP_CSUM         BIT ( 1 )
+#define NETIF_F_HW_CSUM         BIT ( 3 )
+#define NETIF_F_HIGHDMA         BIT ( 5 )
+#define NETIF_F_HW_VLAN_CTAG_TX BIT ( 7 )
+#define NETIF_F_HW_VLAN_CTAG_RX BIT ( 8 )
+#define NETIF_F_TSO             BIT ( 16 )
+#define NETIF_F_GSO_MASK        ( 0xffffUL << 16 )
+#define NETIF_F_RXCSUM          BIT ( 32 )
+#define NETIF_F_LOOPBACK        BIT ( 34 )
+
+typedef enum
+{
+    NETDEV_TX_OK = 0x00,
+    NETDEV_TX_BUSY = 0x10,
+} netdev_tx_t;
+
+struct net_device;
+struct napi_struct;
+struct netdev_bpf;
+struct xdp_frame;
+struct ethtool_ops
+{
+    int unused;
+};
+
+struct net_device_ops
+{
+    int ( * ndo_open ) ( struct net_device * ndev );
+    int ( * ndo_stop ) ( struct net_device * ndev );
+    netdev_tx_t ( * ndo_start_xmit ) ( struct sk_buff * skb, struct net_device * ndev );
+    void ( * ndo_tx_timeout ) ( struct net_device * ndev, unsigned int txqueue );
+    int ( * ndo_set_mac_address ) ( struct net_device * ndev, void * addr );
+    void ( * ndo_set_rx_mode ) ( struct net_device * ndev );
+    int ( * ndo_change_mtu ) ( struct net_device * ndev, int mtu );
+    int ( * ndo_set_features ) ( struct net_device * ndev, netdev_features_t features );
+    netdev_features_t ( * ndo_features_check ) ( struct sk_buff * skb, struct net_device * ndev,
+                                                 netdev_features_t features );
+    void ( * ndo_get_stats64 ) ( struct net_device * ndev, struct rtnl_link_stats64 * s );
+    int ( * ndo_bpf ) ( struct net_device * ndev, struct netdev_bpf * bpf );
+    int ( * ndo_xdp_xmit ) ( struct net_device * ndev, int n, struct xdp_frame ** frames, u32 flags );
+};
+
+struct netdev_hw_addr
+{
+    struct netdev_hw_addr * next;
+    unsigned char addr [ 32 ];
+};
+
+struct netdev_queue
+{
+    bool stopped;
+
+    // Byte Queue Limits: bytes handed to the driver and not completed yet
+    unsigned int inflight;
+};
+
+struct net_device
+{
+    char name [ IFNAMSIZ ];
+    const struct net_device_ops * netdev_ops;
+    const struct ethtool_ops * ethtool_ops;
+    struct device * parent;
+
+    netdev_features_t features;
+    netdev_features_t hw_features;
+    netdev_features_t vlan_features;
+    unsigned int flags;
+    unsigned int mtu;
+    unsigned int min_mtu;
+    unsigned int max_mtu;
+    int irq;
+    unsigned long watchdog_timeo;
+    unsigned char dev_addr [ 32 ] __aligned ( 8 );
+
+    // Multicast list (netdev_for_each_mc_addr)
+    struct netdev_hw_addr * mc_list;
+    int mc_count;
+
+    bool running;
+    bool carrier;
+    struct netdev_queue tx_queue;
+
+    char priv [ ] __aligned ( SMP_CACHE_BYTES );
+};
+
+struct net_device * alloc_etherdev ( int sizeof_priv );
+void free_netdev ( struct net_device * ndev );
+
+#define netdev_priv(ndev) ( ( void * ) ( ndev ) -> priv )
+#define SET_NETDEV_DEV(ndev, pdev) ( ( ndev ) -> parent = ( pdev ) )
+#define register_netdev(ndev) 0
+#define unregister_netdev(ndev) do { } while ( 0 )
+
+#define netif_running(ndev) ( ( ndev ) -> running )
+#define dev_close(ndev) ( ( ndev ) -> running = false )
+#define netif_carrier_ok(ndev) ( ( ndev ) -> carrier )
+#define netif_carrier_on(ndev) ( ( ndev ) -> carrier = true )
+#define netif_carrier_off(ndev) ( ( ndev ) -> carrier = false )
+#define netif_start_queue(ndev) ( ( ndev ) -> tx_queue.stopped = false )
+#define netif_wake_queue(ndev) ( ( ndev ) -> tx_queue.stopped = false )
+#define netif_stop_queue(ndev) ( ( ndev ) -> tx_queue.stopped = true )
+#define netif_queue_stopped(ndev) ( ( ndev ) -> tx_queue.stopped )
+#define netif_tx_disable(ndev) netif_stop_queue ( ndev )
+#define netif_device_present(ndev) true
+#define netif_device_detach(ndev) netif_stop_queue ( ndev )
+#define netif_device_attach(ndev) do { if ( netif_running ( ndev ) ) netif_wake_queue ( ndev ); } while ( 0 )
+#define netif_xmit_stopped(txq) ( ( txq ) -> stopped )
+#define netif_trans_update(ndev) do { } while ( 0 )
+#define netdev_get_tx_queue(ndev, i) ( & ( ndev ) -> tx_queue )
+#define __netif_tx_lock(txq, cpu) ( ( void ) ( txq ) )
+#define __netif_tx_unlock(txq) ( ( void ) ( txq ) )
+#define netif_tx_lock_bh(ndev) do { } while ( 0 )
+#define netif_tx_unlock_bh(ndev) do { } while ( 0 )
+#define netif_addr_lock_bh(ndev) do { } while ( 0 )
+#define netif_addr_unlock_bh(ndev) do { } while ( 0 )
+
+#define netdev_mc_count(ndev) ( ( ndev ) -> mc_count )
+#define netdev_mc_empty(ndev) ( ( ndev ) -> mc_count == 0 )
+#define netdev_for_each_mc_addr(ha, ndev) for ( ( ha ) = ( ndev ) -> mc_list; ( ha ) ; ( ha ) = ( ha ) -> next )
+
+// The value start_xmit sees from netdev_xmit_more (set by the harness)
+extern bool sim_xmit_more;
+#define netdev_xmit_more() sim_xmit_more
+
+static inline void netdev_sent_queue ( struct net_device * ndev, unsigned int bytes )
+{
+    ndev -> tx_queue.inflight += bytes;
+}
+
+static inline void netdev_completed_queue ( struct net_device * ndev, unsigned int pkts, unsigned int bytes )
+{
+    ndev -> tx_queue.inflight -= bytes;
+}
+
+static inline void netdev_reset_queue ( struct net_device * ndev )
+{
+    ndev -> tx_queue.inflight = 0;
+}
+
+#define vlan_features_check(skb, features) ( features )
+
+static inline bool is_valid_ether_addr ( const void * addr )
+{
+    static const u8 zero [ ETH_ALEN ];
+
+    return ! ( * ( const u8 * ) addr & 1 ) && memcmp ( addr, zero, ETH_ALEN );
+}
+
+__be16 eth_type_trans ( struct sk_buff * skb, struct net_device * ndev );
+u32 ether_crc ( int length, const unsigned char * data );
+
+//
+// NAPI: the harness runs the scheduled poll functions (sim_napi_run), just like net_rx_action
+//
+
+#define NAPI_POLL_WEIGHT 64
+
+struct napi_struct
+{
+    struct net_device * dev;
+    int ( * poll ) ( struct napi_struct * napi, int budget );
+    int weight;
+    unsigned int napi_id;
+    bool scheduled;
+    bool disabled;
+    struct napi_struct * next;
+};
+
+void netif_napi_add ( struct net_device * ndev, struct napi_struct * napi,
+                      int ( * poll ) ( struct napi_struct *, int ), int weight );
+bool napi_schedule_prep ( struct napi_struct * napi );
+void __napi_schedule ( struct napi_struct * napi );
+bool napi_complete_done ( struct napi_struct * napi, int work_done );
+#define napi_enable(napi) ( ( napi ) -> disabled = false )
+#define napi_disable(napi) ( ( napi ) -> disabled = true )
+
+struct sk_buff * napi_alloc_skb ( struct napi_struct * napi, unsigned int len );
+struct sk_buff * napi_build_skb ( void * data, unsigned int frag_size );
+struct sk_buff * netdev_alloc_skb_ip_align ( struct net_device * ndev, unsigned int len );
+
+// The network stack: the harness gets every frame (sim_rx_handler)
+enum gro_result { GRO_NORMAL };
+enum gro_result napi_gro_receive ( struct napi_struct * napi, struct sk_buff * skb );
+
+//
+// Interrupts: the harness calls our handler while the model asserts the IRQ line (sim_irq_run)
+//
+
+typedef enum
+{
+    IRQ_NONE,
+    IRQ_HANDLED,
+} irqreturn_t;
+
+typedef irqreturn_t ( * irq_handler_t ) ( int irq, void * dev );
+
+#define IRQF_SHARED 0x80
+
+int request_irq ( unsigned int irq, irq_handler_t handler, unsigned long flags, const char * name, void * dev );
+void free_irq ( unsigned int irq, void * dev );
+void disable_irq ( unsigned int irq );
+#define synchronize_irq(irq) do { } while ( 0 )
+void enable_irq ( unsigned int irq );
+
+//
+// Workqueues: the harness runs the pending works (sim_work_run)
+//
+
+struct work_struct;
+typedef void ( * work_func_t ) ( struct work_struct * work );
+
+struct work_struct
+{
+    work_func_t func;
+    bool pending;
+    u64 expires;        // ns, delayed works only
+    struct work_struct * next;
+};
+
+struct delayed_work
+{
+    struct work_struct work;
+};
+
+#define INIT_WORK(w, f) do { ( w ) -> func = ( f ); ( w ) -> pending = false; } while ( 0 )
+#define INIT_DELAYED_WORK(w, f) INIT_WORK ( & ( w ) -> work, f )
+
+bool schedule_work ( struct work_struct * work );
+bool schedule_delayed_work ( struct delayed_work * dwork, unsigned long delay );
+bool cancel_work_sync ( struct work_struct * work );
+#define cancel_delayed_work_sync(dwork) cancel_work_sync ( & ( dwork ) -> work )
+
+//
+// Dynamic interrupt moderation (net_dim): the harness doesn't turn adaptive-rx on, it only has to build
+//
+
+enum
+{
+    DIM_CQ_PERIOD_MODE_START_FROM_EQE,
+    DIM_CQ_PERIOD_MODE_START_FROM_CQE,
+};
+
+enum
+{
+    DIM_START_MEASURE,
+    DIM_MEASURE_IN_PROGRESS,
+    DIM_APPLY_NEW_PROFILE,
+};
+
+struct dim_sample
+{
+    ktime_t time;
+    u32 pkt_ctr;
+    u32 byte_ctr;
+    u16 event_ctr;
+    u32 comp_ctr;
+};
+
+struct dim_cq_moder
+{
+    u16 usec;
+    u16 pkts;
+    u16 comps;
+    u8 cq_period_mode;
+};
+
+struct dim
+{
+    u8 state;
+    u8 profile_ix;
+    u8 mode;
+    struct work_struct work;
+};
+
+static inline void dim_update_sample ( u16 event_ctr, u64 packets, u64 bytes, struct dim_sample * s )
+{
+    s -> time = ktime_get_ns ( );
+    s -> pkt_ctr = packets;
+    s -> byte_ctr = bytes;
+    s -> event_ctr = event_ctr;
+}
+
+#define net_dim(dim, sample) do { ( void ) ( dim ); ( void ) ( sample ); } while ( 0 )
+
+static inline struct dim_cq_moder net_dim_get_rx_moderation ( u8 mode, int ix )
+{
+    struct dim_cq_moder moder = { .usec = 8 * ( ix + 1 ) };
+
+    return moder;
+}
+
+//
+// XDP: a program is a plain C function here
+//
+
+enum xdp_action
+{
+    XDP_ABORTED,
+    XDP_DROP,
+    XDP_PASS,
+    XDP_TX,
+    XDP_REDIRECT,
+};
+
+#define XDP_XMIT_FLUSH ( 1U << 0 )
+#define XDP_XMIT_FLAGS_MASK XDP_XMIT_FLUSH
+
+struct xdp_buff;
+
+struct bpf_prog
+{
+    u32 ( * run ) ( struct xdp_buff * xdp );
+};
+
+struct xdp_rxq_info
+{
+    struct net_device * dev;
+    u32 queue_index;
+    bool reg;
+};
+
+struct xdp_buff
+{
+    void * data;
+    void * data_end;
+    void * data_meta;
+    void * data_hard_start;
+    struct xdp_rxq_info * rxq;
+    u32 frame_sz;
+};
+
+struct xdp_frame
+{
+    void * data;
+    u16 len;
+};
+
+enum bpf_netdev_command
+{
+    XDP_SETUP_PROG,
+};
+
+struct netlink_ext_ack;
+
+struct netdev_bpf
+{
+    enum bpf_netdev_command command;
+    struct bpf_prog * prog;
+    struct netlink_ext_ack * extack;
+};
+
+#define NL_SET_ERR_MSG_MOD(extack, msg) do { ( void ) ( extack ); } while ( 0 )
+
+static inline int xdp_rxq_info_reg ( struct xdp_rxq_info * rxq, struct net_device * ndev, u32 queue_index,
+                                     unsigned int napi_id )
+{
+    rxq -> dev = ndev;
+    rxq -> queue_index = queue_index;
+    rxq -> reg = true;
+    return 0;
+}
+
+#define xdp_rxq_info_unreg(rxq) ( ( rxq ) -> reg = false )
+#define xdp_rxq_info_is_reg(rxq) ( ( rxq ) -> reg )
+
+static inline void xdp_init_buff ( struct xdp_buff * xdp, u32 frame_sz, struct xdp_rxq_info * rxq )
+{
+    xdp -> frame_sz = frame_sz;
+    xdp -> rxq = rxq;
+}
+
+static inline void xdp_prepare_buff ( struct xdp_buff * xdp, unsigned char * hard_start, int headroom,
+                                      int data_len, const bool meta_valid )
+{
+    unsigned char * data = hard_start + headroom;
+
+    xdp -> data_hard_start = hard_start;
+    xdp -> data = data;
+    xdp -> data_end = data + data_len;
+    xdp -> data_meta = meta_valid ? data : data + 1;
+}
+
+#define bpf_prog_run_xdp(prog, xdp) ( ( prog ) -> run ( xdp ) )
+#define bpf_prog_put(prog) do { } while ( 0 )
+#define bpf_warn_invalid_xdp_action(act) do { } while ( 0 )
+#define trace_xdp_exception(ndev, prog, act) do { } while ( 0 )
+#define xdp_return_frame(frame) do { } while ( 0 )
+
+//
+// MII library
+//
+
+struct mii_if_info
+{
+    int phy_id;
+    int advertising;
+    int phy_id_mask;
+    int reg_num_mask;
+
+    unsigned int full_duplex : 1;
+    unsigned int force_media : 1;
+    unsigned int supports_gmii : 1;
+
+    struct net_device * dev;
+    int ( * mdio_read ) ( struct net_device * dev, int phy_id, int location );
+    void ( * mdio_write ) ( struct net_device * dev, int phy_id, int location, int val );
+};
+
+static inline unsigned int mii_nway_result ( unsigned int negotiated )
+{
+    if ( negotiated & LPA_100FULL )
+    {
+        return LPA_100FULL;
+    }
+
+    if ( negotiated & LPA_100BASE4 )
+    {
+        return LPA_100BASE4;
+    }
+
+    if ( negotiated & LPA_100HALF )
+    {
+        return LPA_100HALF;
+    }
+
+    if ( negotiated & LPA_10FULL )
+    {
+        return LPA_10FULL;
+    }
+
+    return LPA_10HALF;
+}
+
+unsigned int mii_check_media ( struct mii_if_info * mii, unsigned int ok_to_print, unsigned int init_media );
+
+//
+// Harness side (kernel.c)
+//
+
+// Called with every frame the driver gives to the stack, which is freed on return
+extern void ( * sim_rx_handler ) ( struct sk_buff * skb );
+
+// Call the IRQ handler while the model asserts the IRQ line, returns how many times it ran
+int sim_irq_run ( void );
+
+// Run the scheduled NAPI poll functions until they're all done, returns the number of frames processed
+int sim_napi_run ( void );
+
+// Run the pending works (and the delayed ones whose delay expired)
+void sim_work_run ( void );
+
+#endif
@@ -0,0 +1 @@
+// Userspace simulator: our tracepoints are no-ops (see <linux/tracepoint.h>), there is nothing to define
@@ -0,0 +1,631 @@
+// Userspace simulator: the runtime part of our kernel API (see <sim/kernel.h>)
+// Memory the hardware reaches, sk_buffs and page pools, NAPI, IRQs, works and module parameters
+
+#include <sim/kernel.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "model.h"
+
+// Everything the model may DMA to or from lives in this arena, in the first 4G (32 bit DMA)
+#define SIM_ARENA_SIZE ( 256UL << 20 )
+
+// Our sk_buffs buffers: enough for the biggest frame the driver handles, plus headroom
+#define SIM_SKB_BUF_SIZE ( NET_SKB_PAD + NET_IP_ALIGN + 2048 )
+
+#define SIM_PARAMS_MAX 8
+#define SIM_IRQ_LOOPS_MAX 64
+
+static void * _sim_arena_bump ( size_t size, size_t align );
+
+bool sim_verbose;
+bool sim_xmit_more;
+void ( * sim_rx_handler ) ( struct sk_buff * skb );
+
+static struct
+{
+    char * base;
+    size_t used;
+
+    // Freed blocks, reused for the same size
+    struct sim_block
+    {
+        struct sim_block * next;
+        size_t size;
+    } * free;
+} sim_arena;
+
+// sk_buffs the driver is done with, with their buffer
+static struct sk_buff * sim_skb_cache;
+
+struct page_pool
+{
+    struct page * free;
+    unsigned int inflight;  // Pages out of the pool
+    bool destroyed;
+};
+
+static struct
+{
+    irq_handler_t handler;
+    void * dev;
+    bool disabled;
+} sim_irq;
+
+static struct napi_struct * sim_napi_list;
+static struct work_struct * sim_work_list;
+
+static struct
+{
+    const char * name;
+    int * value;
+} sim_params [ SIM_PARAMS_MAX ];
+static int sim_params_nb;
+
+u64 ktime_get_ns ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+//
+// Module parameters
+//
+
+void sim_param_register ( const char * name, int * value )
+{
+    if ( sim_params_nb < SIM_PARAMS_MAX )
+    {
+        sim_params [ sim_params_nb ].name = name;
+        sim_params [ sim_params_nb ].value = value;
+        sim_params_nb++;
+    }
+}
+
+int sim_param_set ( const char * name, int value )
+{
+    int i;
+
+    for ( i = 0; i < sim_params_nb ; ++i )
+    {
+        if ( ! strcmp ( sim_params [ i ].name, name ) )
+        {
+            * sim_params [ i ].value = value;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+//
+// DMA memory
+//
+
+static void * _sim_arena_bump ( size_t size, size_t align )
+{
+    size_t start;
+
+    if ( ! sim_arena.base )
+    {
+        // MAP_32BIT: our bus addresses are our CPU addresses, the model needs them to fit in 32 bits
+        sim_arena.base = mmap ( NULL, SIM_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0 );
+        if ( sim_arena.base == MAP_FAILED || ( uintptr_t ) sim_arena.base + SIM_ARENA_SIZE > 0xffffffffUL )
+        {
+            fprintf ( stderr, "Unable to map the DMA arena below 4G\n" );
+            abort ( );
+        }
+    }
+
+    start = ALIGN ( sim_arena.used, align );
+    if ( start + size > SIM_ARENA_SIZE )
+    {
+        return NULL;
+    }
+
+    sim_arena.used = start + size;
+    return sim_arena.base + start;
+}
+
+void * sim_dma_alloc ( size_t size, size_t align )
+{
+    struct sim_block ** b, * block;
+
+    size = ALIGN ( size, align );
+
+    for ( b = & sim_arena.free; * b ; b = & ( * b ) -> next )
+    {
+        if ( ( * b ) -> size == size && IS_ALIGNED ( ( uintptr_t ) * b, align ) )
+        {
+            block = * b;
+            * b = block -> next;
+            return block;
+        }
+    }
+
+    return _sim_arena_bump ( size, align );
+}
+
+void sim_dma_free ( void * ptr, size_t size )
+{
+    struct sim_block * block = ptr;
+
+    if ( ! ptr )
+    {
+        return;
+    }
+
+    block -> size = ALIGN ( size, PAGE_SIZE );
+    block -> next = sim_arena.free;
+    sim_arena.free = block;
+}
+
+//
+// Page pools
+// A page is 2 pages of the arena: the data, and then its struct page
+//
+
+struct page_pool * page_pool_create ( const struct page_pool_params * params )
+{
+    struct page_pool * pool = calloc ( 1, sizeof ( * pool ) );
+
+    return pool ? pool : ERR_PTR ( -ENOMEM );
+}
+
+static void _sim_page_pool_release ( struct page_pool * pool )
+{
+    struct page * page;
+
+    while ( ( page = pool -> free ) )
+    {
+        pool -> free = page -> next;
+        sim_dma_free ( page_address ( page ), 2 * PAGE_SIZE );
+    }
+
+    free ( pool );
+}
+
+void page_pool_destroy ( struct page_pool * pool )
+{
+    // Pages still used by sk_buffs come back later (see page_pool_recycle_direct)
+    pool -> destroyed = true;
+    if ( ! pool -> inflight )
+    {
+        _sim_page_pool_release ( pool );
+    }
+}
+
+struct page * page_pool_dev_alloc_pages ( struct page_pool * pool )
+{
+    struct page * page = pool -> free;
+    void * data;
+
+    if ( page )
+    {
+        pool -> free = page -> next;
+    }
+    else
+    {
+        data = sim_dma_alloc ( 2 * PAGE_SIZE, PAGE_SIZE );
+        if ( ! data )
+        {
+            return NULL;
+        }
+        page = virt_to_page ( data );
+        page -> pool = pool;
+    }
+
+    pool -> inflight++;
+    return page;
+}
+
+// One fragment per page: the pool doesn't pack them, the driver can't tell the difference
+struct page * page_pool_dev_alloc_frag ( struct page_pool * pool, unsigned int * offset, unsigned int size )
+{
+    * offset = 0;
+    return size <= PAGE_SIZE ? page_pool_dev_alloc_pages ( pool ) : NULL;
+}
+
+void page_pool_recycle_direct ( struct page_pool * pool, struct page * page )
+{
+    page -> next = pool -> free;
+    pool -> free = page;
+    pool -> inflight--;
+
+    if ( pool -> destroyed && ! pool -> inflight )
+    {
+        _sim_page_pool_release ( pool );
+    }
+}
+
+//
+// sk_buffs
+//
+
+struct sk_buff * sim_skb_alloc ( unsigned int size )
+{
+    struct sk_buff * skb = sim_skb_cache;
+    unsigned char * buf;
+
+    if ( size > SIM_SKB_BUF_SIZE )
+    {
+        return NULL;
+    }
+
+    if ( skb )
+    {
+        sim_skb_cache = skb -> next;
+        buf = skb -> buf;
+    }
+    else
+    {
+        skb = malloc ( sizeof ( * skb ) );
+        buf = sim_dma_alloc ( SIM_SKB_BUF_SIZE, SMP_CACHE_BYTES );
+        if ( ! skb || ! buf )
+        {
+            free ( skb );
+            return NULL;
+        }
+    }
+
+    // Everything but the fragments (only nr_frags matters)
+    memset ( skb, 0, offsetof ( struct sk_buff, shinfo.frags ) );
+    skb -> buf = skb -> head = skb -> data = skb -> tail = buf;
+    skb -> end = buf + SIM_SKB_BUF_SIZE;
+
+    return skb;
+}
+
+void sim_skb_free ( struct sk_buff * skb )
+{
+    struct page * page;
+
+    if ( skb -> pp_recycle )
+    {
+        page = virt_to_page ( skb -> head );
+        page_pool_recycle_direct ( page -> pool, page );
+    }
+
+    skb -> next = sim_skb_cache;
+    sim_skb_cache = skb;
+}
+
+struct sk_buff * napi_alloc_skb ( struct napi_struct * napi, unsigned int len )
+{
+    struct sk_buff * skb = sim_skb_alloc ( NET_SKB_PAD + NET_IP_ALIGN + len );
+
+    if ( skb )
+    {
+        skb_reserve ( skb, NET_SKB_PAD + NET_IP_ALIGN );
+    }
+
+    return skb;
+}
+
+struct sk_buff * netdev_alloc_skb_ip_align ( struct net_device * ndev, unsigned int len )
+{
+    return napi_alloc_skb ( NULL, len );
+}
+
+struct sk_buff * napi_build_skb ( void * data, unsigned int frag_size )
+{
+    struct sk_buff * skb = sim_skb_alloc ( 0 );
+
+    if ( skb )
+    {
+        skb -> head = skb -> data = skb -> tail = data;
+        skb -> end = ( unsigned char * ) data + frag_size - SKB_DATA_ALIGN ( sizeof ( struct skb_shared_info ) );
+    }
+
+    return skb;
+}
+
+void skb_copy_and_csum_dev ( const struct sk_buff * skb, u8 * to )
+{
+    const skb_frag_t * frag;
+    unsigned int len = skb_headlen ( skb );
+    int i;
+
+    memcpy ( to, skb -> data, len );
+    to += len;
+
+    for ( i = 0; i < skb_shinfo ( skb ) -> nr_frags ; ++i )
+    {
+        frag = & skb_shinfo ( skb ) -> frags [ i ];
+        memcpy ( to, ( u8 * ) page_address ( frag -> page ) + frag -> offset, frag -> size );
+        to += frag -> size;
+    }
+}
+
+//
+// Network devices
+//
+
+struct net_device * alloc_etherdev ( int sizeof_priv )
+{
+    size_t size = ALIGN ( sizeof ( struct net_device ) + sizeof_priv, SMP_CACHE_BYTES );
+    struct net_device * ndev = aligned_alloc ( SMP_CACHE_BYTES, size );
+
+    if ( ! ndev )
+    {
+        return NULL;
+    }
+
+    memset ( ndev, 0, size );
+    strcpy ( ndev -> name, "sim0" );
+    ndev -> mtu = ETH_DATA_LEN;
+
+    return ndev;
+}
+
+void free_netdev ( struct net_device * ndev )
+{
+    free ( ndev );
+}
+
+__be16 eth_type_trans ( struct sk_buff * skb, struct net_device * ndev )
+{
+    struct ethhdr * eth = ( struct ethhdr * ) skb -> data;
+
+    skb -> dev = ndev;
+    skb_pull ( skb, ETH_HLEN );
+
+    return eth -> h_proto;
+}
+
+// Same as the kernel: the CRC32 of the data, bit reversed (what the hardware hashes multicast addresses with)
+u32 ether_crc ( int length, const unsigned char * data )
+{
+    u32 crc = ~ 0U, rev = 0;
+    int bit;
+
+    while ( length-- > 0 )
+    {
+        crc ^= * data++;
+        for ( bit = 0; bit < 8 ; ++bit )
+        {
+            crc = ( crc >> 1 ) ^ ( crc & 1 ? 0xedb88320 : 0 );
+        }
+    }
+
+    for ( bit = 0; bit < 32 ; ++bit )
+    {
+        rev |= ( ( crc >> bit ) & 1 ) << ( 31 - bit );
+    }
+
+    return rev;
+}
+
+unsigned int mii_check_media ( struct mii_if_info * mii, unsigned int ok_to_print, unsigned int init_media )
+{
+    struct net_device * ndev = mii -> dev;
+    bool old_carrier = netif_carrier_ok ( ndev );
+    bool new_carrier;
+    unsigned int media, duplex;
+
+    // BMSR_LSTATUS is latched low: read it twice
+    mii -> mdio_read ( ndev, mii -> phy_id, MII_BMSR );
+    new_carrier = mii -> mdio_read ( ndev, mii -> phy_id, MII_BMSR ) & BMSR_LSTATUS;
+
+    if ( ! init_media && old_carrier == new_carrier )
+    {
+        return 0;
+    }
+
+    if ( ! new_carrier )
+    {
+        netif_carrier_off ( ndev );
+        return 0;
+    }
+
+    netif_carrier_on ( ndev );
+
+    media = mii_nway_result ( mii -> mdio_read ( ndev, mii -> phy_id, MII_ADVERTISE ) &
+                              mii -> mdio_read ( ndev, mii -> phy_id, MII_LPA ) );
+    duplex = ( media & ( LPA_100FULL | LPA_10FULL ) ) ? 1 : 0;
+
+    if ( init_media || mii -> full_duplex != duplex )
+    {
+        mii -> full_duplex = duplex;
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// NAPI
+//
+
+void netif_napi_add ( struct net_device * ndev, struct napi_struct * napi,
+                      int ( * poll ) ( struct napi_struct *, int ), int weight )
+{
+    napi -> dev = ndev;
+    napi -> poll = poll;
+    napi -> weight = weight;
+    napi -> napi_id = 1;
+
+    // Just like the kernel, NAPI starts disabled
+    napi -> disabled = true;
+}
+
+bool napi_schedule_prep ( struct napi_struct * napi )
+{
+    if ( napi -> disabled || napi -> scheduled )
+    {
+        return false;
+    }
+
+    napi -> scheduled = true;
+    return true;
+}
+
+void __napi_schedule ( struct napi_struct * napi )
+{
+    struct napi_struct ** n = & sim_napi_list;
+
+    while ( * n )
+    {
+        n = & ( * n ) -> next;
+    }
+
+    napi -> next = NULL;
+    * n = napi;
+}
+
+bool napi_complete_done ( struct napi_struct * napi, int work_done )
+{
+    napi -> scheduled = false;
+    return true;
+}
+
+enum gro_result napi_gro_receive ( struct napi_struct * napi, struct sk_buff * skb )
+{
+    if ( sim_rx_handler )
+    {
+        sim_rx_handler ( skb );
+    }
+
+    sim_skb_free ( skb );
+    return GRO_NORMAL;
+}
+
+int sim_napi_run ( void )
+{
+    struct napi_struct * napi;
+    int work_done = 0;
+
+    // Just like net_rx_action: a poll function that used its whole budget is polled again
+    while ( ( napi = sim_napi_list ) )
+    {
+        sim_napi_list = napi -> next;
+        work_done += napi -> poll ( napi, napi -> weight );
+
+        if ( napi -> scheduled )
+        {
+            __napi_schedule ( napi );
+        }
+    }
+
+    return work_done;
+}
+
+//
+// Interrupts
+//
+
+int request_irq ( unsigned int irq, irq_handler_t handler, unsigned long flags, const char * name, void * dev )
+{
+    if ( sim_irq.handler )
+    {
+        return -EBUSY;
+    }
+
+    sim_irq.handler = handler;
+    sim_irq.dev = dev;
+    sim_irq.disabled = false;
+
+    return 0;
+}
+
+void free_irq ( unsigned int irq, void * dev )
+{
+    sim_irq.handler = NULL;
+}
+
+void disable_irq ( unsigned int irq )
+{
+    sim_irq.disabled = true;
+}
+
+void enable_irq ( unsigned int irq )
+{
+    sim_irq.disabled = false;
+}
+
+int sim_irq_run ( void )
+{
+    int n = 0;
+
+    // Level triggered: as long as the model asserts the line, the handler runs again
+    while ( sim_irq.handler && ! sim_irq.disabled && model_irq_asserted ( ) && n < SIM_IRQ_LOOPS_MAX )
+    {
+        sim_irq.handler ( MODEL_IRQ, sim_irq.dev );
+        n++;
+    }
+
+    return n;
+}
+
+//
+// Works
+//
+
+bool schedule_work ( struct work_struct * work )
+{
+    if ( work -> pending )
+    {
+        return false;
+    }
+
+    work -> pending = true;
+    work -> expires = 0;
+    work -> next = sim_work_list;
+    sim_work_list = work;
+
+    return true;
+}
+
+bool schedule_delayed_work ( struct delayed_work * dwork, unsigned long delay )
+{
+    if ( ! schedule_work ( & dwork -> work ) )
+    {
+        return false;
+    }
+
+    dwork -> work.expires = ktime_get_ns ( ) + delay * ( NSEC_PER_SEC / HZ );
+    return true;
+}
+
+bool cancel_work_sync ( struct work_struct * work )
+{
+    struct work_struct ** w;
+
+    for ( w = & sim_work_list; * w ; w = & ( * w ) -> next )
+    {
+        if ( * w == work )
+        {
+            * w = work -> next;
+            work -> pending = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void sim_work_run ( void )
+{
+    struct work_struct ** w, * work;
+    u64 now = ktime_get_ns ( );
+
+    // A work may schedule works again (even itself): start over after each one
+    w = & sim_work_list;
+    while ( * w )
+    {
+        work = * w;
+        if ( work -> expires > now )
+        {
+            w = & work -> next;
+            continue;
+        }
+
+        * w = work -> next;
+        work -> pending = false;
+        work -> func ( work );
+        w = & sim_work_list;
+    }
+}
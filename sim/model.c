@@ -0,0 +1,563 @@
+// Userspace simulator: software model of the RTL8139D registers (see model.h)
+// Everything happens instantly: DMA is a memcpy to / from the bus address (our CPU address, see sim_dma_alloc),
+// frames are received when the harness injects them, and sent when it calls model_tx_process
+
+#include <sim/kernel.h>
+
+#include "hw.h"
+#include "model.h"
+
+// Power on values of the PHY registers: 100 Mbps full duplex, auto-negotiation complete with a link partner
+// that can do everything we can, PAUSE included
+#define MODEL_BMCR ( BMCR_ANENABLE | BMCR_SPEED100 | BMCR_FULLDPLX )
+#define MODEL_BMSR ( BMSR_100FULL | BMSR_100HALF | BMSR_10FULL | BMSR_10HALF | BMSR_ANEGCOMPLETE | \
+                     BMSR_ANEGCAPABLE | BMSR_LSTATUS | BMSR_ERCAP )
+#define MODEL_ANAR ( ADVERTISE_PAUSE_CAP | ADVERTISE_ALL | ADVERTISE_CSMA )
+#define MODEL_ANLPAR ( LPA_LPACK | LPA_PAUSE_CAP | ADVERTISE_ALL | ADVERTISE_CSMA )
+
+// Our RX ring size, from RCR_RBLEN (RCR_RBLEN_64K has all its bits set)
+#define MODEL_RX_LEN(rcr) ( R8139DN_RX_BUFLEN_MIN << ( ( ( rcr ) & RCR_RBLEN_64K ) >> RCR_RBLEN_SHIFT ) )
+
+static void _model_reset ( void );
+static u32 _model_read ( unsigned int reg, int size );
+static void _model_write ( unsigned int reg, u32 val, int size );
+static void _model_eeprom ( u8 val );
+static bool _model_rx_accept ( const u8 * dst, u16 * status );
+static u32 _model_crc32 ( const u8 * data, unsigned int len );
+
+struct model_counters model_counters;
+
+static struct
+{
+    // Register file, as the driver sees it when nothing special happens on access
+    u8 regs [ R8139DN_IO_SIZE ];
+
+    // Where the hardware writes the next frame in the RX ring (CBR)
+    u16 cbr;
+
+    // TX descriptors the driver handed to us (TSD written with TSD_OWN clear), and the next one we send
+    bool tx_pending [ R8139DN_TX_DESC_NB ];
+    int tx_next;
+
+    // General purpose timer: when TCTR was last reset, and whether INT_TIMEOUT has been raised since
+    u64 tctr_start;
+    bool timer_fired;
+
+    // 93C46: command being shifted in, then data being shifted out
+    struct
+    {
+        u16 words [ R8139DN_EEPROM_WORDS ];
+        u8 last;        // Last EE_CR value (to catch the EESK rising edges)
+        u16 cmd;
+        int cmd_bits;
+        u16 data;
+        int data_bits;  // Data bits left to shift out (-1: receiving the command)
+        bool eedo;
+    } eeprom;
+
+    void ( * wire ) ( const void * frame, unsigned int len );
+} model;
+
+// What we answer to addresses ioread / iowrite get: their offset in here
+static u8 model_mmio_base [ R8139DN_IO_SIZE ];
+
+static inline u16 _model_r16 ( unsigned int reg )
+{
+    u16 val;
+
+    memcpy ( & val, model.regs + reg, sizeof ( val ) );
+    return val;
+}
+
+static inline u32 _model_r32 ( unsigned int reg )
+{
+    u32 val;
+
+    memcpy ( & val, model.regs + reg, sizeof ( val ) );
+    return val;
+}
+
+static inline void _model_w16 ( unsigned int reg, u16 val )
+{
+    memcpy ( model.regs + reg, & val, sizeof ( val ) );
+}
+
+static inline void _model_w32 ( unsigned int reg, u32 val )
+{
+    memcpy ( model.regs + reg, & val, sizeof ( val ) );
+}
+
+static inline void _model_raise ( u16 irq )
+{
+    _model_w16 ( ISR, _model_r16 ( ISR ) | irq );
+}
+
+void model_init ( void )
+{
+    static const u8 mac [ ETH_ALEN ] = MODEL_MAC;
+    int i;
+
+    memset ( & model, 0, sizeof ( model ) );
+    memset ( & model_counters, 0, sizeof ( model_counters ) );
+
+    // EEPROM: RTL8139 signature, PCI IDs and our MAC address (little endian words)
+    model.eeprom.words [ 0 ] = 0x8129;
+    model.eeprom.words [ 1 ] = 0x10ec;
+    model.eeprom.words [ 2 ] = 0x8139;
+    model.eeprom.words [ 3 ] = 0x10ec;
+    model.eeprom.words [ 4 ] = 0x8139;
+    for ( i = 0; i < 3 ; ++i )
+    {
+        model.eeprom.words [ EE_DATA_MAC + i ] = mac [ 2 * i ] | mac [ 2 * i + 1 ] << 8;
+    }
+    model.eeprom.data_bits = -1;
+
+    // The chip loads its MAC address from the EEPROM at power on
+    memcpy ( model.regs + IDR0, mac, ETH_ALEN );
+
+    _model_w16 ( BMCR, MODEL_BMCR );
+    _model_w16 ( ANAR, MODEL_ANAR );
+    _model_w16 ( ANLPAR, MODEL_ANLPAR );
+    _model_w16 ( ANER, 1 );
+
+    _model_reset ( );
+}
+
+void __iomem * model_mmio ( void )
+{
+    return model_mmio_base;
+}
+
+void model_set_wire ( void ( * wire ) ( const void * frame, unsigned int len ) )
+{
+    model.wire = wire;
+}
+
+// Software reset (CR_RST): what the datasheet says is reset, the rest (MAC, PHY, configuration) stays
+static void _model_reset ( void )
+{
+    int i;
+
+    model.regs [ CR ] = 0;
+    _model_w16 ( IMR, 0 );
+    _model_w16 ( ISR, 0 );
+    _model_w32 ( TCR, 0 );
+    _model_w32 ( RCR, 0 );
+    _model_w32 ( MPC, 0 );
+    _model_w32 ( TIMERINT, 0 );
+    model.regs [ ERSR ] = 0;
+
+    for ( i = 0; i < R8139DN_TX_DESC_NB ; ++i )
+    {
+        _model_w32 ( TSD0 + i * TSD_GAP, TSD_OWN );
+        model.tx_pending [ i ] = false;
+    }
+    model.tx_next = 0;
+
+    // Empty RX ring: CAPR reads 16 bytes behind CBR
+    model.cbr = 0;
+    _model_w16 ( CAPR, - R8139DN_RX_PAD );
+}
+
+//
+// Register accesses
+//
+
+static inline unsigned int _model_reg ( const void __iomem * addr, int size )
+{
+    uintptr_t reg = ( const u8 * ) addr - model_mmio_base;
+
+    if ( reg + size > R8139DN_IO_SIZE )
+    {
+        fprintf ( stderr, "MMIO access out of our registers (%p)\n", addr );
+        abort ( );
+    }
+
+    return reg;
+}
+
+u8 ioread8 ( const void __iomem * addr )
+{
+    return _model_read ( _model_reg ( addr, 1 ), 1 );
+}
+
+u16 ioread16 ( const void __iomem * addr )
+{
+    return _model_read ( _model_reg ( addr, 2 ), 2 );
+}
+
+u32 ioread32 ( const void __iomem * addr )
+{
+    return _model_read ( _model_reg ( addr, 4 ), 4 );
+}
+
+void iowrite8 ( u8 val, void __iomem * addr )
+{
+    _model_write ( _model_reg ( addr, 1 ), val, 1 );
+}
+
+void iowrite16 ( u16 val, void __iomem * addr )
+{
+    _model_write ( _model_reg ( addr, 2 ), val, 2 );
+}
+
+void iowrite32 ( u32 val, void __iomem * addr )
+{
+    _model_write ( _model_reg ( addr, 4 ), val, 4 );
+}
+
+static u32 _model_read ( unsigned int reg, int size )
+{
+    u32 rx_len = MODEL_RX_LEN ( _model_r32 ( RCR ) );
+    u32 val = 0;
+
+    model_counters.mmio_reads++;
+
+    switch ( reg )
+    {
+        case CR:
+            // The RX ring is empty when the driver has read everything up to CBR
+            val = model.regs [ CR ] & ~ CR_BUFE;
+            if ( model.cbr == ( ( _model_r16 ( CAPR ) + R8139DN_RX_PAD ) & ( rx_len - 1 ) ) )
+            {
+                val |= CR_BUFE;
+            }
+            return val;
+
+        case CBR:
+            return model.cbr;
+
+        case TCR:
+            return _model_r32 ( TCR ) | RTL8100B_8139D;
+
+        case TCTR:
+            return ( ktime_get_ns ( ) - model.tctr_start ) * R8139DN_TIMER_MHZ / 1000;
+
+        case EE_CR:
+            val = model.regs [ EE_CR ] & ~ EE_CR_EEDO;
+            return model.eeprom.eedo ? val | EE_CR_EEDO : val;
+
+        case BMSR:
+            return MODEL_BMSR;
+
+        case MSR:
+            // Link OK at 100 Mbps: only the flow control bits are set
+            return model.regs [ MSR ] & ( MSR_RXFCE | MSR_TXFCE );
+    }
+
+    memcpy ( & val, model.regs + reg, size );
+    return val;
+}
+
+static void _model_write ( unsigned int reg, u32 val, int size )
+{
+    int desc;
+
+    model_counters.mmio_writes++;
+
+    switch ( reg )
+    {
+        case CR:
+            if ( val & CR_RST )
+            {
+                // Our reset completes instantly: CR_RST is already clear when the driver polls it
+                _model_reset ( );
+                return;
+            }
+
+            // Disabling the receiver brings the RX ring back to its beginning
+            if ( ! ( val & CR_RE ) )
+            {
+                model.cbr = 0;
+            }
+            model.regs [ CR ] = val & ( CR_RE | CR_TE );
+            return;
+
+        case ISR:
+            _model_w16 ( ISR, _model_r16 ( ISR ) & ~ val );
+            return;
+
+        case ERSR:
+            model.regs [ ERSR ] &= ~ val;
+            return;
+
+        case TSD0:
+        case TSD1:
+        case TSD2:
+        case TSD3:
+            // TSD_OWN clear: the descriptor is ours, send it (see model_tx_process)
+            desc = ( reg - TSD0 ) / TSD_GAP;
+            _model_w32 ( reg, val & ( TSD_ERTXTH | TSD_SIZE ) );
+            model.tx_pending [ desc ] = ! ( val & TSD_OWN );
+            return;
+
+        case TCR:
+            _model_w32 ( TCR, val & ~ TCR_HWVERID_MASK );
+            return;
+
+        case TCTR:
+            model.tctr_start = ktime_get_ns ( );
+            model.timer_fired = false;
+            return;
+
+        case MPC:
+            _model_w32 ( MPC, 0 );
+            return;
+
+        case EE_CR:
+            _model_eeprom ( val );
+            return;
+
+        case BMCR:
+            // Auto-negotiation restarts and completes right away
+            _model_w16 ( BMCR, val & ~ ( BMCR_ANRESTART | BMCR_RESET ) );
+            return;
+
+        case CBR:
+        case BMSR:
+            return;
+    }
+
+    memcpy ( model.regs + reg, & val, size );
+}
+
+bool model_irq_asserted ( void )
+{
+    u32 timerint = _model_r32 ( TIMERINT );
+
+    // The general purpose timer reached TIMERINT
+    if ( timerint && ! model.timer_fired && _model_read ( TCTR, 4 ) >= timerint )
+    {
+        model.timer_fired = true;
+        _model_raise ( INT_TIMEOUT );
+    }
+
+    return _model_r16 ( ISR ) & _model_r16 ( IMR );
+}
+
+//
+// 93C46 EEPROM, bit-banged through EE_CR
+// The command (start bit, opcode, 6 bit address) is sampled on the EESK rising edges,
+// and the 16 data bits of a READ come out on the next rising edges, MSB first, after a dummy 0
+//
+
+static void _model_eeprom ( u8 val )
+{
+    bool rising = ( val & EE_CR_EESK ) && ! ( model.eeprom.last & EE_CR_EESK );
+
+    model.regs [ EE_CR ] = val;
+    model.eeprom.last = val;
+
+    if ( ( val & EE_CR_CFG_WRITE_ENABLE ) != EE_CR_PROGRAM || ! ( val & EE_CR_EECS ) )
+    {
+        model.eeprom.cmd = 0;
+        model.eeprom.cmd_bits = 0;
+        model.eeprom.data_bits = -1;
+        model.eeprom.eedo = false;
+        return;
+    }
+
+    if ( ! rising )
+    {
+        return;
+    }
+
+    if ( model.eeprom.data_bits >= 0 )
+    {
+        if ( model.eeprom.data_bits > 0 )
+        {
+            model.eeprom.data_bits--;
+            model.eeprom.eedo = ( model.eeprom.data >> model.eeprom.data_bits ) & 1;
+        }
+        return;
+    }
+
+    model.eeprom.cmd = ( model.eeprom.cmd << 1 ) | ( val & EE_CR_EEDI ? 1 : 0 );
+    if ( ++ model.eeprom.cmd_bits < EE_CMD_READ_LEN )
+    {
+        return;
+    }
+
+    // Only READ is modelled
+    if ( model.eeprom.cmd >> EE_ADDRLEN == EE_CMD_READ )
+    {
+        model.eeprom.data = model.eeprom.words [ model.eeprom.cmd & ( R8139DN_EEPROM_WORDS - 1 ) ];
+        model.eeprom.data_bits = 16;
+        model.eeprom.eedo = false;
+    }
+}
+
+//
+// RX
+//
+
+// The RCR filters, and the address bits of the receive status
+static bool _model_rx_accept ( const u8 * dst, u16 * status )
+{
+    u32 rcr = _model_r32 ( RCR );
+    u32 bit;
+
+    if ( ! memcmp ( dst, "\xff\xff\xff\xff\xff\xff", ETH_ALEN ) )
+    {
+        * status = RSR_BAR;
+        return rcr & ( RCR_AB | RCR_AAP );
+    }
+
+    if ( dst [ 0 ] & 1 )
+    {
+        * status = RSR_MAR;
+        bit = ether_crc ( ETH_ALEN, dst ) >> 26;
+        return rcr & RCR_AAP || ( rcr & RCR_AM && model.regs [ MAR0 + ( bit >> 3 ) ] & ( 1 << ( bit & 7 ) ) );
+    }
+
+    if ( ! memcmp ( dst, model.regs + IDR0, ETH_ALEN ) )
+    {
+        * status = RSR_PAM;
+        return rcr & ( RCR_APM | RCR_AAP );
+    }
+
+    * status = 0;
+    return rcr & RCR_AAP;
+}
+
+// Room a frame takes in the RX ring: RTL RX header, frame, FCS, and then 32 bit alignment
+static inline u32 _model_rx_room ( unsigned int len )
+{
+    return R8139DN_RX_ALIGN ( R8139DN_RX_HEADER_SIZE + len + ETH_FCS_LEN );
+}
+
+bool model_rx_fits ( unsigned int len )
+{
+    u32 rx_len = MODEL_RX_LEN ( _model_r32 ( RCR ) );
+    u32 used = ( model.cbr - ( _model_r16 ( CAPR ) + R8139DN_RX_PAD ) ) & ( rx_len - 1 );
+
+    // We never fill the ring completely: CBR catching up with CAPR would look like an empty ring
+    return used + _model_rx_room ( len ) < rx_len;
+}
+
+bool model_rx_frame ( const void * frame, unsigned int len )
+{
+    u32 rcr = _model_r32 ( RCR );
+    u32 rx_len = MODEL_RX_LEN ( rcr );
+    u8 * ring = ( u8 * ) ( uintptr_t ) _model_r32 ( RBSTART );
+    u8 buf [ R8139DN_RX_HEADER_SIZE + R8139DN_MAX_ETH_SIZE ];
+    struct r8139dn_rx_header * rxh = ( struct r8139dn_rx_header * ) buf;
+    u32 size = len + ETH_FCS_LEN;
+    u32 fcs, head;
+    u16 status;
+
+    if ( ! ( model.regs [ CR ] & CR_RE ) || size > R8139DN_MAX_ETH_SIZE || ! _model_rx_accept ( frame, & status ) )
+    {
+        model_counters.rx_filtered++;
+        return false;
+    }
+
+    // No room: the frame is lost, and the driver told about it
+    if ( ! model_rx_fits ( len ) )
+    {
+        model_counters.rx_overflows++;
+        _model_w32 ( MPC, ( _model_r32 ( MPC ) + 1 ) & 0xffffff );
+        _model_raise ( INT_RXOVW );
+        return false;
+    }
+
+    // RTL RX header, frame and FCS, as the hardware DMAs them
+    rxh -> status = status | RSR_ROK;
+    rxh -> size = size;
+    memcpy ( rxh + 1, frame, len );
+    fcs = _model_crc32 ( frame, len );
+    memcpy ( buf + R8139DN_RX_HEADER_SIZE + len, & fcs, ETH_FCS_LEN );
+
+    // With RCR_WRAP, the frame goes on past the end of the ring. Without, its end goes to the beginning
+    head = min_t ( u32, R8139DN_RX_HEADER_SIZE + size, rx_len - model.cbr );
+    if ( rcr & RCR_WRAP )
+    {
+        head = R8139DN_RX_HEADER_SIZE + size;
+    }
+    memcpy ( ring + model.cbr, buf, head );
+    memcpy ( ring, buf + head, R8139DN_RX_HEADER_SIZE + size - head );
+
+    model.cbr = ( model.cbr + _model_rx_room ( len ) ) & ( rx_len - 1 );
+    model_counters.rx_frames++;
+
+    // Early RX mode: only the completion is modelled, the frame is always complete and good
+    if ( rcr & RCR_ERTH )
+    {
+        model.regs [ ERSR ] |= ERSR_ERGOOD;
+    }
+
+    _model_raise ( INT_ROK );
+    return true;
+}
+
+// Ethernet FCS (CRC32, sent least significant byte first)
+static u32 _model_crc32 ( const u8 * data, unsigned int len )
+{
+    static u32 table [ 256 ];
+    u32 crc = ~ 0U;
+    int i, bit;
+
+    if ( ! table [ 1 ] )
+    {
+        for ( i = 0; i < 256 ; ++i )
+        {
+            crc = i;
+            for ( bit = 0; bit < 8 ; ++bit )
+            {
+                crc = ( crc >> 1 ) ^ ( crc & 1 ? 0xedb88320 : 0 );
+            }
+            table [ i ] = crc;
+        }
+        crc = ~ 0U;
+    }
+
+    while ( len-- )
+    {
+        crc = ( crc >> 8 ) ^ table [ ( crc ^ * data++ ) & 0xff ];
+    }
+
+    return ~ crc;
+}
+
+//
+// TX
+//
+
+int model_tx_process ( void )
+{
+    u32 tsd, reg;
+    const void * frame;
+    int sent = 0;
+
+    if ( ! ( model.regs [ CR ] & CR_TE ) )
+    {
+        return 0;
+    }
+
+    // The hardware goes through its descriptors in order, and stops at the first one it doesn't own
+    while ( model.tx_pending [ model.tx_next ] )
+    {
+        reg = TSD0 + model.tx_next * TSD_GAP;
+        tsd = _model_r32 ( reg );
+        frame = ( const void * ) ( uintptr_t ) _model_r32 ( TSAD0 + model.tx_next * TSAD_GAP );
+
+        if ( ( _model_r32 ( TCR ) & TCR_LBK_ENABLE ) == TCR_LBK_ENABLE )
+        {
+            model_rx_frame ( frame, tsd & TSD_SIZE );
+        }
+        else if ( model.wire )
+        {
+            model.wire ( frame, tsd & TSD_SIZE );
+        }
+
+        _model_w32 ( reg, tsd | TSD_OWN | TSD_TOK );
+        model.tx_pending [ model.tx_next ] = false;
+        model.tx_next = ( model.tx_next + 1 ) & ( R8139DN_TX_DESC_NB - 1 );
+
+        model_counters.tx_frames++;
+        sent++;
+        _model_raise ( INT_TOK );
+    }
+
+    return sent;
+}
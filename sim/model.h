@@ -0,0 +1,52 @@
+#ifndef _R8139DN_SIM_MODEL_H
+#define _R8139DN_SIM_MODEL_H
+
+#include <sim/kernel.h>
+
+// Software model of an RTL8139D register file, behind ioread* / iowrite*
+// What the datapath relies on is modelled: the RX ring (RBSTART, CBR, CAPR, CR_BUFE, RCR filters and RBLEN / WRAP),
+// the 4 TX descriptors (TSD / TSAD, always completed in order), ISR / IMR (write 1 to clear), the general purpose timer,
+// the 93C46 EEPROM and a PHY with a 100 Mbps full duplex link. C+ mode is not: the model is an RTL8139D
+
+// IRQ line of our fake PCI device
+#define MODEL_IRQ 11
+
+// MAC address in the EEPROM
+#define MODEL_MAC { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 }
+
+// What happened since model_init (the harness reads them around what it measures)
+struct model_counters
+{
+    u64 mmio_reads;
+    u64 mmio_writes;
+    u64 rx_frames;      // Frames written to the RX ring
+    u64 rx_overflows;   // Frames dropped because the RX ring was full (INT_RXOVW)
+    u64 rx_filtered;    // Frames dropped by the RCR filters, or because the receiver is off
+    u64 tx_frames;      // Frames sent (to the wire or looped back)
+};
+
+extern struct model_counters model_counters;
+
+// Power on: registers to their reset values, EEPROM contents
+void model_init ( void );
+
+// Base address of our registers, for r8139dn_net_init
+void __iomem * model_mmio ( void );
+
+// Whether the IRQ line is asserted (ISR & IMR), after raising INT_TIMEOUT if the timer expired
+bool model_irq_asserted ( void );
+
+// Whether a frame of len bytes (without FCS) fits in the RX ring right now
+bool model_rx_fits ( unsigned int len );
+
+// A frame (without FCS) comes from the wire. Returns false if it was filtered or didn't fit
+bool model_rx_frame ( const void * frame, unsigned int len );
+
+// Send what the driver handed to the TX descriptors, in order. Returns the number of frames sent
+// In loopback mode (TCR_LBK_ENABLE) they come back through model_rx_frame, otherwise they go to the wire
+int model_tx_process ( void );
+
+// Called with every frame leaving on the wire
+void model_set_wire ( void ( * wire ) ( const void * frame, unsigned int len ) );
+
+#endif
@@ -0,0 +1,25 @@
+// Userspace simulator: what the datapath links against, but that has no use outside of the kernel
+// (ethtool and debugfs are not built, see Makefile)
+
+#include "common.h"
+#include "debugfs.h"
+#include "net.h"
+
+const struct ethtool_ops r8139dn_ethtool_ops;
+
+// Histograms are allocated (the datapath updates them when enabled) but never shown
+int r8139dn_debugfs_init ( struct r8139dn_priv * priv )
+{
+    priv -> hists = alloc_percpu ( struct r8139dn_hists );
+    if ( ! priv -> hists )
+    {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void r8139dn_debugfs_release ( struct r8139dn_priv * priv )
+{
+    free_percpu ( priv -> hists );
+}
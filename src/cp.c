@@ -0,0 +1,770 @@
+#include "common.h"
+#include "cp.h"
+#include "net.h"
+#include "hw.h"
+
+#include <linux/ip.h>           // ip_hdr
+#include <linux/if_vlan.h>      // skb_vlan_tag_present, __vlan_hwaccel_put_tag
+
+static int _r8139dn_cp_rx_map ( struct r8139dn_priv * priv, int i, struct sk_buff * skb );
+static void _r8139dn_cp_rx_give ( struct r8139dn_cp * cp, int i );
+static int _r8139dn_cp_rx ( struct net_device * ndev, struct napi_struct * napi, int budget );
+static void _r8139dn_cp_rx_error_stats ( struct r8139dn_priv * priv, u32 status );
+static bool _r8139dn_cp_rx_csum_ok ( u32 status );
+static u16 _r8139dn_cp_offloads ( netdev_features_t features );
+static int _r8139dn_cp_tx_free ( struct r8139dn_cp * cp );
+static void _r8139dn_cp_interrupt_tx ( struct net_device * ndev );
+static void _r8139dn_cp_tx_stats ( struct r8139dn_priv * priv, u32 status, struct sk_buff * skb );
+static int _r8139dn_cp_tx_opts ( struct sk_buff * skb, u32 * opts );
+static void _r8139dn_cp_tx_slot ( struct r8139dn_cp * cp, int i, dma_addr_t dma, u32 len, bool page );
+static void _r8139dn_cp_tx_give ( struct r8139dn_cp * cp, int i, u32 opts1, u32 opts2 );
+static struct sk_buff * _r8139dn_cp_tx_unmap ( struct r8139dn_priv * priv, int i );
+static void _r8139dn_cp_tx_unwind ( struct r8139dn_priv * priv, int first, int last );
+
+// Allocate the descriptor rings, give every RX descriptor a buffer and start the C+ mode engine
+// Called by r8139dn_net_open, once the chip has been reset
+int r8139dn_cp_open ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_cp * cp = & priv -> cp;
+    struct sk_buff * skb;
+    int i;
+
+    // Let's break the build if the assumptions we heavily rely on are wrong
+    BUILD_BUG_ON ( sizeof ( struct r8139dn_cp_desc ) != 16 );
+    BUILD_BUG_ON ( ! is_power_of_2 ( R8139DN_CP_RX_RING_SIZE ) || ! is_power_of_2 ( R8139DN_CP_TX_RING_SIZE ) );
+
+    // Coherent memory is page aligned: way more than the 256 bytes the hardware needs
+    cp -> rx_desc = dma_alloc_coherent ( & ( priv -> pdev -> dev ), R8139DN_CP_RINGS_SIZE, & cp -> dma, GFP_KERNEL );
+    if ( ! cp -> rx_desc )
+    {
+        return -ENOMEM;
+    }
+    cp -> tx_desc = cp -> rx_desc + R8139DN_CP_RX_RING_SIZE;
+
+    // Every RX descriptor gets its own buffer: the hardware moves each frame right into a sk_buff
+    for ( i = 0; i < R8139DN_CP_RX_RING_SIZE ; ++i )
+    {
+        skb = netdev_alloc_skb_ip_align ( ndev, R8139DN_CP_RX_BUF_SIZE );
+        if ( ! skb )
+        {
+            goto err_open_rx_fill;
+        }
+
+        if ( _r8139dn_cp_rx_map ( priv, i, skb ) )
+        {
+            dev_kfree_skb ( skb );
+            goto err_open_rx_fill;
+        }
+
+        _r8139dn_cp_rx_give ( cp, i );
+    }
+
+    cp -> rx_cpu = 0;
+    cp -> tx_cpu = 0;
+    cp -> tx_hw = 0;
+
+    // The RX ring is not a contiguous buffer anymore: no RCR_RBLEN, no RCR_WRAP, no early RX
+    priv -> rcr = priv -> fifo.rcr | RCR_APM | RCR_AB;
+    cp -> cpcr = CPCR_MULRW | CPCR_RX_ENABLE | CPCR_TX_ENABLE | _r8139dn_cp_offloads ( ndev -> features );
+
+    r8139dn_hw_setup_cp ( priv );
+
+    netif_start_queue ( ndev );
+    priv -> interrupts |= INT_TX | INT_RX;
+
+    return 0;
+
+err_open_rx_fill:
+    r8139dn_cp_release_rings ( priv );
+    return -ENOMEM;
+}
+
+// Free the descriptor rings, and the buffers the hardware still had
+// The hardware must be stopped
+void r8139dn_cp_release_rings ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_cp * cp = & priv -> cp;
+    struct device * dev = & priv -> pdev -> dev;
+    struct r8139dn_cp_slot * slot;
+    int i;
+
+    for ( i = 0; i < R8139DN_CP_RX_RING_SIZE ; ++i )
+    {
+        slot = & cp -> rx_slots [ i ];
+        if ( slot -> skb )
+        {
+            dma_unmap_single ( dev, slot -> dma, R8139DN_CP_RX_BUF_SIZE, DMA_FROM_DEVICE );
+            dev_kfree_skb ( slot -> skb );
+            slot -> skb = NULL;
+        }
+    }
+
+    // Frames the hardware will never send
+    for ( i = 0; i < R8139DN_CP_TX_RING_SIZE ; ++i )
+    {
+        if ( cp -> tx_slots [ i ].len )
+        {
+            dev_kfree_skb ( _r8139dn_cp_tx_unmap ( priv, i ) );
+        }
+    }
+
+    if ( cp -> rx_desc )
+    {
+        dma_free_coherent ( dev, R8139DN_CP_RINGS_SIZE, cp -> rx_desc, cp -> dma );
+        cp -> rx_desc = NULL;
+        cp -> tx_desc = NULL;
+    }
+}
+
+// Map the buffer of a new sk_buff for RX descriptor i
+static int _r8139dn_cp_rx_map ( struct r8139dn_priv * priv, int i, struct sk_buff * skb )
+{
+    struct r8139dn_cp_slot * slot = & priv -> cp.rx_slots [ i ];
+    struct device * dev = & priv -> pdev -> dev;
+    dma_addr_t dma;
+
+    dma = dma_map_single ( dev, skb -> data, R8139DN_CP_RX_BUF_SIZE, DMA_FROM_DEVICE );
+    if ( dma_mapping_error ( dev, dma ) )
+    {
+        return -ENOMEM;
+    }
+
+    slot -> skb = skb;
+    slot -> dma = dma;
+
+    return 0;
+}
+
+// Hand RX descriptor i (back) to the hardware, with the buffer of its slot
+static void _r8139dn_cp_rx_give ( struct r8139dn_cp * cp, int i )
+{
+    struct r8139dn_cp_desc * desc = & cp -> rx_desc [ i ];
+    u32 opts1 = CP_DESC_OWN | R8139DN_CP_RX_BUF_SIZE;
+
+    if ( i == R8139DN_CP_RX_RING_SIZE - 1 )
+    {
+        opts1 |= CP_DESC_EOR;
+    }
+
+    desc -> addr = cpu_to_le64 ( cp -> rx_slots [ i ].dma );
+    desc -> opts2 = 0;
+
+    // The hardware may take the descriptor as soon as it sees CP_DESC_OWN: the address must be there before
+    dma_wmb ( );
+    desc -> opts1 = cpu_to_le32 ( opts1 );
+}
+
+// The kernel gives us a frame to send
+// No copy, no staging: the descriptors point right to the sk_buff, one for its head and one per fragment
+// With TSO, the frame can be a 64K TCP super-frame: the hardware cuts it into segments by itself
+netdev_tx_t r8139dn_cp_start_xmit ( struct sk_buff * skb, struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_cp * cp = & priv -> cp;
+    struct device * dev = & priv -> pdev -> dev;
+    int first = cp -> tx_cpu, i = first;
+    int nfrags, f;
+    u32 opts, opts2, len;
+    dma_addr_t dma;
+
+    // The hardware doesn't pad short frames by itself. eth_skb_pad frees the sk_buff if it fails
+    if ( eth_skb_pad ( skb ) )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_DROPPED, 1 );
+        return NETDEV_TX_OK;
+    }
+
+    if ( ! skb_is_gso ( skb ) && skb -> len + ETH_FCS_LEN > R8139DN_MAX_ETH_SIZE )
+    {
+        goto err_xmit_drop;
+    }
+
+    // We stop the queue while there is room for a whole frame: this should never happen
+    nfrags = skb_shinfo ( skb ) -> nr_frags;
+    if ( unlikely ( _r8139dn_cp_tx_free ( cp ) < nfrags + 1 ) )
+    {
+        netif_stop_queue ( ndev );
+        netdev_err ( ndev, "TX ring full while the queue was awake\n" );
+        return NETDEV_TX_BUSY;
+    }
+
+    if ( _r8139dn_cp_tx_opts ( skb, & opts ) )
+    {
+        goto err_xmit_drop;
+    }
+
+    // Let the hardware insert the 802.1Q tag (NETIF_F_HW_VLAN_CTAG_TX). The TCI is big endian in the descriptor
+    opts2 = skb_vlan_tag_present ( skb ) ? CP_TX_VLAN_TAG | swab16 ( skb_vlan_tag_get ( skb ) ) : 0;
+
+    len = skb_headlen ( skb );
+    dma = dma_map_single ( dev, skb -> data, len, DMA_TO_DEVICE );
+    if ( dma_mapping_error ( dev, dma ) )
+    {
+        goto err_xmit_drop;
+    }
+    _r8139dn_cp_tx_slot ( cp, first, dma, len, false );
+
+    // The fragments descriptors are handed to the hardware right away, but it can't reach them
+    // before the descriptor of the head, which we hand to it last
+    for ( f = 0; f < nfrags ; ++f )
+    {
+        const skb_frag_t * frag = & skb_shinfo ( skb ) -> frags [ f ];
+
+        i = ( i + 1 ) & ( R8139DN_CP_TX_RING_SIZE - 1 );
+        len = skb_frag_size ( frag );
+        dma = skb_frag_dma_map ( dev, frag, 0, len, DMA_TO_DEVICE );
+        if ( dma_mapping_error ( dev, dma ) )
+        {
+            _r8139dn_cp_tx_unwind ( priv, first, i );
+            goto err_xmit_drop;
+        }
+        _r8139dn_cp_tx_slot ( cp, i, dma, len, true );
+
+        _r8139dn_cp_tx_give ( cp, i, opts | ( f == nfrags - 1 ? CP_DESC_LS : 0 ), opts2 );
+    }
+
+    // The TX IRQ handler frees the sk_buff along with the last descriptor of the frame
+    cp -> tx_slots [ i ].skb = skb;
+
+    // Tell BQL before the hardware can complete the frame
+    netdev_sent_queue ( ndev, skb -> len );
+
+    _r8139dn_cp_tx_give ( cp, first, opts | CP_DESC_FS | ( nfrags ? 0 : CP_DESC_LS ), opts2 );
+
+    // The TX IRQ handler reads our position locklessly, to know which descriptors it can check
+    smp_store_release ( & cp -> tx_cpu, ( i + 1 ) & ( R8139DN_CP_TX_RING_SIZE - 1 ) );
+
+    // No room for another frame with all its fragments: stop the queue
+    // Pairs with the barrier in the TX IRQ handler: either it sees the queue stopped, or we see its new position
+    if ( _r8139dn_cp_tx_free ( cp ) < R8139DN_CP_TX_STOP )
+    {
+        netif_stop_queue ( ndev );
+        smp_mb ( );
+        if ( _r8139dn_cp_tx_free ( cp ) >= R8139DN_CP_TX_STOP )
+        {
+            netif_wake_queue ( ndev );
+        }
+    }
+
+    // Only tell the hardware to look at its TX ring once the kernel is done with its batch
+    // (or can't give us more: queue stopped by us or by BQL)
+    if ( ! netdev_xmit_more ( ) || netif_xmit_stopped ( netdev_get_tx_queue ( ndev, 0 ) ) )
+    {
+        r8139dn_w8 ( TPPOLL, TPPOLL_NPQ );
+    }
+
+    return NETDEV_TX_OK;
+
+err_xmit_drop:
+    dev_kfree_skb_any ( skb );
+    r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_DROPPED, 1 );
+    return NETDEV_TX_OK;
+}
+
+// Offloads of a frame, for its TX descriptors
+// The hardware only knows about TCP and UDP over IPv4 (NETIF_F_IP_CSUM, NETIF_F_TSO):
+// anything else the kernel asks us to checksum is checksummed here, in software
+static int _r8139dn_cp_tx_opts ( struct sk_buff * skb, u32 * opts )
+{
+    * opts = 0;
+
+    if ( skb_is_gso ( skb ) )
+    {
+        // r8139dn_cp_features_check made sure the MSS fits
+        * opts = CP_TX_LARGE_SEND | ( skb_shinfo ( skb ) -> gso_size << CP_TX_MSS_SHIFT );
+        return 0;
+    }
+
+    if ( skb -> ip_summed != CHECKSUM_PARTIAL )
+    {
+        return 0;
+    }
+
+    if ( skb -> protocol == htons ( ETH_P_IP ) )
+    {
+        switch ( ip_hdr ( skb ) -> protocol )
+        {
+            case IPPROTO_TCP:
+                * opts = CP_TX_IPCS | CP_TX_TCPCS;
+                return 0;
+
+            case IPPROTO_UDP:
+                * opts = CP_TX_IPCS | CP_TX_UDPCS;
+                return 0;
+        }
+    }
+
+    return skb_checksum_help ( skb );
+}
+
+// Remember what TX descriptor i points to
+static void _r8139dn_cp_tx_slot ( struct r8139dn_cp * cp, int i, dma_addr_t dma, u32 len, bool page )
+{
+    struct r8139dn_cp_slot * slot = & cp -> tx_slots [ i ];
+
+    slot -> skb = NULL;
+    slot -> dma = dma;
+    slot -> len = len;
+    slot -> page = page;
+}
+
+// Hand TX descriptor i to the hardware, with the buffer of its slot
+static void _r8139dn_cp_tx_give ( struct r8139dn_cp * cp, int i, u32 opts1, u32 opts2 )
+{
+    struct r8139dn_cp_desc * desc = & cp -> tx_desc [ i ];
+
+    opts1 |= CP_DESC_OWN | cp -> tx_slots [ i ].len;
+
+    if ( i == R8139DN_CP_TX_RING_SIZE - 1 )
+    {
+        opts1 |= CP_DESC_EOR;
+    }
+
+    desc -> addr = cpu_to_le64 ( cp -> tx_slots [ i ].dma );
+    desc -> opts2 = cpu_to_le32 ( opts2 );
+
+    // The hardware may take the descriptor as soon as it sees CP_DESC_OWN: the address must be there before
+    dma_wmb ( );
+    desc -> opts1 = cpu_to_le32 ( opts1 );
+}
+
+// Unmap the buffer of TX descriptor i
+// Returns the sk_buff to free if this was the last descriptor of its frame, NULL otherwise
+static struct sk_buff * _r8139dn_cp_tx_unmap ( struct r8139dn_priv * priv, int i )
+{
+    struct r8139dn_cp_slot * slot = & priv -> cp.tx_slots [ i ];
+    struct device * dev = & priv -> pdev -> dev;
+    struct sk_buff * skb = slot -> skb;
+
+    if ( slot -> page )
+    {
+        dma_unmap_page ( dev, slot -> dma, slot -> len, DMA_TO_DEVICE );
+    }
+    else
+    {
+        dma_unmap_single ( dev, slot -> dma, slot -> len, DMA_TO_DEVICE );
+    }
+
+    slot -> skb = NULL;
+    slot -> len = 0;
+
+    return skb;
+}
+
+// A fragment couldn't be mapped: unmap what we've mapped so far, from descriptor first to descriptor last (excluded)
+// None of them belongs to the hardware yet: the descriptor of the head is handed over last
+static void _r8139dn_cp_tx_unwind ( struct r8139dn_priv * priv, int first, int last )
+{
+    int i;
+
+    for ( i = first; i != last ; i = ( i + 1 ) & ( R8139DN_CP_TX_RING_SIZE - 1 ) )
+    {
+        _r8139dn_cp_tx_unmap ( priv, i );
+
+        // Fragments descriptors may already be marked as owned by the hardware: take them back
+        priv -> cp.tx_desc [ i ].opts1 = 0;
+    }
+}
+
+// Only keep TSO for the frames the hardware can cut by itself:
+// each buffer must fit in a descriptor, and the MSS in its field. Software GSO takes care of the others
+netdev_features_t r8139dn_cp_features_check ( struct sk_buff * skb, struct net_device * ndev, netdev_features_t features )
+{
+    int f;
+
+    if ( ! skb_is_gso ( skb ) )
+    {
+        return features;
+    }
+
+    if ( skb_shinfo ( skb ) -> gso_size > CP_TX_MSS_MAX || skb_headlen ( skb ) > CP_DESC_SIZE )
+    {
+        return features & ~ NETIF_F_GSO_MASK;
+    }
+
+    for ( f = 0; f < skb_shinfo ( skb ) -> nr_frags ; ++f )
+    {
+        if ( skb_frag_size ( & skb_shinfo ( skb ) -> frags [ f ] ) > CP_DESC_SIZE )
+        {
+            return features & ~ NETIF_F_GSO_MASK;
+        }
+    }
+
+    return features;
+}
+
+// Number of TX descriptors start_xmit can still write to
+static int _r8139dn_cp_tx_free ( struct r8139dn_cp * cp )
+{
+    return ( smp_load_acquire ( & cp -> tx_hw ) - cp -> tx_cpu - 1 ) & ( R8139DN_CP_TX_RING_SIZE - 1 );
+}
+
+irqreturn_t r8139dn_cp_interrupt ( int irq, void * dev )
+{
+    struct net_device * ndev = ( struct net_device * ) dev;
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    u64 start = READ_ONCE ( priv -> hist_enable ) ? ktime_get_ns ( ) : 0;
+    u16 isr = r8139dn_r16 ( ISR );
+
+    // Same as net.c: while NAPI has them masked, our poll function acknowledges the RX interrupts
+    u16 rx_masked = READ_ONCE ( priv -> masked ) & ( INT_ROK | INT_RER );
+
+    // Shared IRQ... Tell the kernel our device was not the trigger for this interrupt
+    if ( ! ( isr & ~ rx_masked ) )
+    {
+        return IRQ_NONE;
+    }
+
+    netdev_dbg ( ndev, "IRQ (ISR: %04x)\n", isr );
+
+    // Acknowledge IRQ as fast as possible, and only care about interrupts we are interested in
+    // Acknowledging a masked INT_ROK would lose a frame completed after our poll function last looked at the RX ring
+    r8139dn_w16 ( ISR, isr & ~ rx_masked );
+    isr &= priv -> interrupts & ~ rx_masked;
+
+    if ( isr & INT_LNKCHG_PUN )
+    {
+        schedule_work ( & priv -> link_work );
+    }
+
+    // In C+ mode, this means no RX descriptor was left: our poll function is late giving them back
+    if ( isr & INT_RXOVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_OVER_ERRORS, 1 );
+    }
+
+    if ( isr & INT_FOVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_FIFO_ERRORS, 1 );
+    }
+
+    // Same as net.c: NAPI polls the RX ring, with RX interrupts masked
+    if ( isr & INT_RX && napi_schedule_prep ( & priv -> napi ) )
+    {
+        r8139dn_hw_mask_irq ( priv, INT_RX );
+        __napi_schedule ( & priv -> napi );
+    }
+
+    if ( isr & INT_TX )
+    {
+        _r8139dn_cp_interrupt_tx ( ndev );
+    }
+
+    if ( start )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_ISR_NS, ktime_get_ns ( ) - start );
+    }
+
+    return IRQ_HANDLED;
+}
+
+// Reclaim the TX descriptors the hardware gave back to us
+static void _r8139dn_cp_interrupt_tx ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_cp * cp = & priv -> cp;
+    unsigned int pkts = 0, bytes = 0;
+    int hw = cp -> tx_hw;
+    int cpu = smp_load_acquire ( & cp -> tx_cpu );
+    struct sk_buff * skb;
+    u32 status;
+
+    while ( hw != cpu )
+    {
+        status = le32_to_cpu ( READ_ONCE ( cp -> tx_desc [ hw ].opts1 ) );
+        if ( status & CP_DESC_OWN )
+        {
+            break;
+        }
+
+        // The status of the frame is in its last descriptor, the one holding the sk_buff
+        skb = _r8139dn_cp_tx_unmap ( priv, hw );
+        if ( skb )
+        {
+            _r8139dn_cp_tx_stats ( priv, status, skb );
+
+            if ( status & CP_TX_ERROR && netif_msg_tx_err ( priv ) )
+            {
+                netdev_err ( ndev, "TX error (desc %d): %08x\n", hw, status );
+            }
+
+            pkts++;
+            bytes += skb -> len;
+
+            // The sk_buff is only queued here: the TX softirq frees all of them at once, in bulk
+            dev_consume_skb_irq ( skb );
+        }
+
+        hw = ( hw + 1 ) & ( R8139DN_CP_TX_RING_SIZE - 1 );
+    }
+
+    // Marks the descriptors as free for start_xmit
+    smp_store_release ( & cp -> tx_hw, hw );
+
+    netdev_completed_queue ( ndev, pkts, bytes );
+
+    if ( READ_ONCE ( priv -> hist_enable ) )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_TX_FRAMES, pkts );
+    }
+
+    // Pairs with the barrier in start_xmit: either we see the queue stopped, or start_xmit sees our new position
+    smp_mb ( );
+    if ( netif_queue_stopped ( ndev ) && _r8139dn_cp_tx_free ( cp ) >= R8139DN_CP_TX_STOP )
+    {
+        netif_wake_queue ( ndev );
+    }
+}
+
+// Account for a frame the hardware is done with, according to the status of its TX descriptor
+// A TSO super-frame counts as the segments the hardware cut it into, histogrammed at their average size
+static void _r8139dn_cp_tx_stats ( struct r8139dn_priv * priv, u32 status, struct sk_buff * skb )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( priv -> stats );
+    u32 segs = skb_shinfo ( skb ) -> gso_segs ? : 1;
+    unsigned long flags;
+
+    flags = u64_stats_update_begin_irqsave ( & stats -> irq_syncp );
+
+    u64_stats_add ( & stats -> irq [ R8139DN_TX_COLLISIONS ], ( status & CP_TX_COLL ) >> CP_TX_COLL_SHIFT );
+
+    if ( status & CP_TX_FIFO_UNDER )
+    {
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_UNDERRUNS ] );
+    }
+
+    if ( ! ( status & CP_TX_ERROR ) )
+    {
+        u64_stats_add ( & stats -> irq [ R8139DN_TX_PACKETS ], segs );
+        u64_stats_add ( & stats -> irq [ R8139DN_TX_BYTES ], skb -> len );
+        u64_stats_add ( & stats -> irq [ R8139DN_TX_SIZE + r8139dn_stats_size_bucket ( skb -> len / segs + ETH_FCS_LEN ) ],
+                        segs );
+    }
+    else
+    {
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_ERRORS ] );
+
+        if ( status & CP_TX_EXCESS_COLL )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_ABORTED ] );
+        }
+
+        if ( status & CP_TX_LINK_FAIL )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_CARRIER_ERRORS ] );
+        }
+
+        if ( status & CP_TX_OWC )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_WINDOW_ERRORS ] );
+        }
+    }
+
+    u64_stats_update_end_irqrestore ( & stats -> irq_syncp, flags );
+}
+
+// NAPI poll function of the C+ mode engine
+int r8139dn_cp_poll ( struct napi_struct * napi, int budget )
+{
+    struct r8139dn_priv * priv = container_of ( napi, struct r8139dn_priv, napi );
+    int work_done;
+
+    // Before looking at the RX descriptors: any descriptor completed from now on raises INT_ROK again
+    r8139dn_w16 ( ISR, INT_ROK | INT_RER );
+
+    work_done = _r8139dn_cp_rx ( napi -> dev, napi, budget );
+
+    if ( READ_ONCE ( priv -> hist_enable ) )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_RX_FRAMES, work_done );
+    }
+
+    if ( work_done < budget && napi_complete_done ( napi, work_done ) )
+    {
+        r8139dn_hw_unmask_irq ( priv, INT_RX );
+    }
+
+    return work_done;
+}
+
+// Give the frames of the RX descriptors the hardware is done with to the kernel
+// The sk_buff the hardware filled goes up the stack as is, and a new one takes its place in the descriptor
+// If we can't get a new one, the frame is dropped and its buffer reused: the hardware never runs out of descriptors
+// Returns the number of descriptors we've processed (never more than budget)
+static int _r8139dn_cp_rx ( struct net_device * ndev, struct napi_struct * napi, int budget )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_cp * cp = & priv -> cp;
+    struct r8139dn_cp_slot * slot;
+    struct sk_buff * skb, * full;
+    int work_done = 0;
+    u32 status, opts2, size;
+    dma_addr_t dma;
+    int i;
+
+    while ( work_done < budget )
+    {
+        i = cp -> rx_cpu;
+        status = le32_to_cpu ( READ_ONCE ( cp -> rx_desc [ i ].opts1 ) );
+        if ( status & CP_DESC_OWN )
+        {
+            break;
+        }
+
+        // Don't read the frame before we know the hardware is done with it
+        dma_rmb ( );
+
+        slot = & cp -> rx_slots [ i ];
+        size = status & CP_DESC_SIZE;
+        opts2 = le32_to_cpu ( cp -> rx_desc [ i ].opts2 );
+
+        // A frame spanning several descriptors is bigger than anything we accept
+        // Once its 802.1Q tag is stripped, a frame can be shorter than ETH_ZLEN: only check for a whole header
+        if ( unlikely ( ( status & ( CP_DESC_FS | CP_DESC_LS ) ) != ( CP_DESC_FS | CP_DESC_LS ) ||
+                        status & CP_RX_ERROR || size < ETH_HLEN + ETH_FCS_LEN ) )
+        {
+            _r8139dn_cp_rx_error_stats ( priv, status );
+            goto next;
+        }
+
+        // No new buffer: keep the old one in the descriptor, and drop its frame
+        skb = napi_alloc_skb ( napi, R8139DN_CP_RX_BUF_SIZE );
+        if ( ! skb )
+        {
+            r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_ALLOC_FAILED, 1 );
+            goto next;
+        }
+
+        full = slot -> skb;
+        dma = slot -> dma;
+        if ( _r8139dn_cp_rx_map ( priv, i, skb ) )
+        {
+            dev_kfree_skb ( skb );
+            r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_ALLOC_FAILED, 1 );
+            goto next;
+        }
+
+        dma_unmap_single ( & ( priv -> pdev -> dev ), dma, R8139DN_CP_RX_BUF_SIZE, DMA_FROM_DEVICE );
+        skb = full;
+
+        r8139dn_stats_rx_frame ( priv -> stats, size );
+
+        // Don't give the Ethernet checksum to the kernel
+        skb_put ( skb, size - ETH_FCS_LEN );
+        skb -> protocol = eth_type_trans ( skb, ndev );
+
+        // NETIF_F_RXCSUM: the hardware checked the IPv4 TCP / UDP checksums, no need to do it again
+        if ( ndev -> features & NETIF_F_RXCSUM && _r8139dn_cp_rx_csum_ok ( status ) )
+        {
+            skb -> ip_summed = CHECKSUM_UNNECESSARY;
+        }
+
+        // NETIF_F_HW_VLAN_CTAG_RX: the hardware stripped the 802.1Q tag and gives it to us in the descriptor
+        if ( opts2 & CP_RX_VLAN_TAGGED )
+        {
+            __vlan_hwaccel_put_tag ( skb, htons ( ETH_P_8021Q ), swab16 ( opts2 & CP_VLAN_TCI ) );
+        }
+
+        napi_gro_receive ( napi, skb );
+
+next:
+        _r8139dn_cp_rx_give ( cp, i );
+        cp -> rx_cpu = ( i + 1 ) & ( R8139DN_CP_RX_RING_SIZE - 1 );
+        work_done++;
+    }
+
+    return work_done;
+}
+
+// Account for a bad frame, according to the status of its RX descriptor
+static void _r8139dn_cp_rx_error_stats ( struct r8139dn_priv * priv, u32 status )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( priv -> stats );
+
+    // The FIFO overflow counter belongs to the IRQ group
+    if ( status & CP_RX_FIFO_OVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_FIFO_ERRORS, 1 );
+    }
+
+    u64_stats_update_begin ( & stats -> rx_syncp );
+
+    if ( status & CP_RX_CRC )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_CRC_ERRORS ] );
+    }
+
+    if ( status & CP_RX_FAE )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_FRAME_ERRORS ] );
+    }
+
+    if ( status & ( CP_RX_RUNT | CP_RX_LONG ) || ( status & ( CP_DESC_FS | CP_DESC_LS ) ) != ( CP_DESC_FS | CP_DESC_LS ) )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_LENGTH_ERRORS ] );
+    }
+
+    u64_stats_update_end ( & stats -> rx_syncp );
+}
+
+// Did the hardware find the TCP or UDP checksum of the frame, and its IPv4 header checksum, right?
+// Anything else (not IPv4, not TCP / UDP) is left for the kernel to check
+static bool _r8139dn_cp_rx_csum_ok ( u32 status )
+{
+    switch ( status & CP_RX_PROTO )
+    {
+        case CP_RX_PROTO_TCP:
+            return ! ( status & ( CP_RX_IP_FAIL | CP_RX_TCP_FAIL ) );
+
+        case CP_RX_PROTO_UDP:
+            return ! ( status & ( CP_RX_IP_FAIL | CP_RX_UDP_FAIL ) );
+
+        default:
+            return false;
+    }
+}
+
+// CPCR bits of the RX offloads turned on in features
+static u16 _r8139dn_cp_offloads ( netdev_features_t features )
+{
+    u16 cpcr = 0;
+
+    if ( features & NETIF_F_RXCSUM )
+    {
+        cpcr |= CPCR_RX_CHKSUM;
+    }
+
+    if ( features & NETIF_F_HW_VLAN_CTAG_RX )
+    {
+        cpcr |= CPCR_RX_VLAN;
+    }
+
+    return cpcr;
+}
+
+// The kernel turns offloads on or off (ethtool -K), interface up or down
+// TX offloads (checksums, TSO, VLAN tag insertion) are decided per frame by start_xmit: nothing to do for them
+// RX offloads are turned on or off in CPCR, right away if the hardware is running
+void r8139dn_cp_set_features ( struct net_device * ndev, netdev_features_t features )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_cp * cp = & priv -> cp;
+    unsigned long flags;
+    u16 cpcr;
+
+    cpcr = ( cp -> cpcr & ~ ( CPCR_RX_CHKSUM | CPCR_RX_VLAN ) ) | _r8139dn_cp_offloads ( features );
+    if ( cpcr == cp -> cpcr )
+    {
+        return;
+    }
+
+    cp -> cpcr = cpcr;
+
+    if ( netif_running ( ndev ) )
+    {
+        spin_lock_irqsave ( & priv -> lock, flags );
+        r8139dn_w16 ( CPCR, cpcr );
+        spin_unlock_irqrestore ( & priv -> lock, flags );
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef _R8139DN_CP_H
+#define _R8139DN_CP_H
+
+#include <linux/netdevice.h>
+#include <linux/interrupt.h>
+
+struct r8139dn_priv;
+
+// RTL8139C+ in C+ mode: rather than 4 TX descriptors and a contiguous RX ring,
+// the hardware walks through rings of descriptors in our memory, each pointing to its own buffer
+// Warning: ring sizes must be powers of 2
+#define R8139DN_CP_RX_RING_SIZE 64
+#define R8139DN_CP_TX_RING_SIZE 64
+
+// start_xmit stops the queue when there is no room left for a frame with all its fragments
+#define R8139DN_CP_TX_STOP ( MAX_SKB_FRAGS + 1 )
+
+// Both rings live in the same DMA memory: RX descriptors first, then TX descriptors
+// Each ring must be 256 bytes aligned (64 x 16 bytes keeps the TX ring aligned)
+#define R8139DN_CP_RINGS_SIZE \
+    ( ( R8139DN_CP_RX_RING_SIZE + R8139DN_CP_TX_RING_SIZE ) * sizeof ( struct r8139dn_cp_desc ) )
+
+// Size of the buffer of each RX descriptor: the biggest frame we accept, FCS included
+#define R8139DN_CP_RX_BUF_SIZE R8139DN_MAX_ETH_SIZE
+
+// C+ mode descriptor, shared with the hardware (little endian)
+struct r8139dn_cp_desc
+{
+    __le32 opts1;   // Ownership, ring end, segments, size and status (CP_DESC_*, CP_TX_*, CP_RX_*)
+    __le32 opts2;
+    __le64 addr;    // Buffer bus address
+};
+
+// What the hardware doesn't need to know about a descriptor
+struct r8139dn_cp_slot
+{
+    struct sk_buff * skb;
+    dma_addr_t dma;
+    u32 len;        // 0: nothing mapped
+
+    // TX only: the buffer is a fragment (skb_frag_dma_map) rather than the head (dma_map_single)
+    bool page;
+};
+
+struct r8139dn_cp
+{
+    // Descriptor rings (both in the same DMA memory)
+    struct r8139dn_cp_desc * rx_desc;
+    struct r8139dn_cp_desc * tx_desc;
+    dma_addr_t dma;
+
+    struct r8139dn_cp_slot rx_slots [ R8139DN_CP_RX_RING_SIZE ];
+    struct r8139dn_cp_slot tx_slots [ R8139DN_CP_TX_RING_SIZE ];
+
+    // Next RX descriptor the hardware gives back to us (NAPI only)
+    u32 rx_cpu;
+
+    // Next TX descriptor start_xmit writes to, and first TX descriptor the hardware hasn't given back yet
+    // Same lockless scheme as the TX ring of net.c: only start_xmit moves cpu, only the TX IRQ handler moves hw
+    int tx_cpu, tx_hw;
+
+    // C+ Command Register value (offloads)
+    u16 cpcr;
+};
+
+int r8139dn_cp_open ( struct net_device * ndev );
+void r8139dn_cp_release_rings ( struct r8139dn_priv * priv );
+netdev_tx_t r8139dn_cp_start_xmit ( struct sk_buff * skb, struct net_device * ndev );
+void r8139dn_cp_set_features ( struct net_device * ndev, netdev_features_t features );
+netdev_features_t r8139dn_cp_features_check ( struct sk_buff * skb, struct net_device * ndev, netdev_features_t features );
+irqreturn_t r8139dn_cp_interrupt ( int irq, void * dev );
+int r8139dn_cp_poll ( struct napi_struct * napi, int budget );
+
+#endif
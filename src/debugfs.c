@@ -0,0 +1,143 @@
+#include "common.h"
+#include "debugfs.h"
+#include "net.h"
+
+static int _r8139dn_debugfs_enable_get ( void * data, u64 * val );
+static int _r8139dn_debugfs_enable_set ( void * data, u64 val );
+static int _r8139dn_debugfs_show_isr_ns ( struct seq_file * s, void * data );
+static int _r8139dn_debugfs_show_rx_frames ( struct seq_file * s, void * data );
+static int _r8139dn_debugfs_show_tx_frames ( struct seq_file * s, void * data );
+static int _r8139dn_debugfs_show_tx_latency_ns ( struct seq_file * s, void * data );
+
+// /sys/kernel/debug/r8139d_naive/ (KBUILD_MODNAME)
+static struct dentry * r8139dn_debugfs_root;
+
+DEFINE_DEBUGFS_ATTRIBUTE ( r8139dn_debugfs_enable_fops, _r8139dn_debugfs_enable_get,
+        _r8139dn_debugfs_enable_set, "%llu\n" );
+
+// Called when our module is loaded / unloaded
+// If debugfs is not available, the debugfs API does nothing (and so do we)
+void r8139dn_debugfs_mod_init ( void )
+{
+    r8139dn_debugfs_root = debugfs_create_dir ( KBUILD_MODNAME, NULL );
+}
+
+void r8139dn_debugfs_mod_exit ( void )
+{
+    debugfs_remove_recursive ( r8139dn_debugfs_root );
+}
+
+// Create our directory: /sys/kernel/debug/r8139d_naive/<PCI address>/
+// Histograms are off until enabled: echo 1 > enable
+int r8139dn_debugfs_init ( struct r8139dn_priv * priv )
+{
+    struct device * dev = & priv -> pdev -> dev;
+
+    priv -> hists = devm_alloc_percpu ( dev, struct r8139dn_hists );
+    if ( ! priv -> hists )
+    {
+        return -ENOMEM;
+    }
+
+    priv -> debugfs = debugfs_create_dir ( pci_name ( priv -> pdev ), r8139dn_debugfs_root );
+
+    debugfs_create_file_unsafe ( "enable", 0600, priv -> debugfs, priv, & r8139dn_debugfs_enable_fops );
+    debugfs_create_devm_seqfile ( dev, "isr_ns", priv -> debugfs, _r8139dn_debugfs_show_isr_ns );
+    debugfs_create_devm_seqfile ( dev, "rx_frames_per_poll", priv -> debugfs, _r8139dn_debugfs_show_rx_frames );
+    debugfs_create_devm_seqfile ( dev, "tx_frames_per_irq", priv -> debugfs, _r8139dn_debugfs_show_tx_frames );
+    debugfs_create_devm_seqfile ( dev, "tx_latency_ns", priv -> debugfs, _r8139dn_debugfs_show_tx_latency_ns );
+
+    return 0;
+}
+
+void r8139dn_debugfs_release ( struct r8139dn_priv * priv )
+{
+    debugfs_remove_recursive ( priv -> debugfs );
+    priv -> debugfs = NULL;
+}
+
+static int _r8139dn_debugfs_enable_get ( void * data, u64 * val )
+{
+    struct r8139dn_priv * priv = data;
+
+    * val = READ_ONCE ( priv -> hist_enable );
+
+    return 0;
+}
+
+// Enabling the histograms starts them from scratch
+static int _r8139dn_debugfs_enable_set ( void * data, u64 val )
+{
+    struct r8139dn_priv * priv = data;
+    int cpu;
+
+    if ( val && ! priv -> hist_enable )
+    {
+        for_each_possible_cpu ( cpu )
+        {
+            memset ( per_cpu_ptr ( priv -> hists, cpu ), 0, sizeof ( struct r8139dn_hists ) );
+        }
+    }
+
+    WRITE_ONCE ( priv -> hist_enable, !! val );
+
+    return 0;
+}
+
+// Print a histogram, one line per non empty bucket: "<from> <to> <count>" (to is excluded)
+static int _r8139dn_debugfs_show ( struct seq_file * s, int id )
+{
+    struct net_device * ndev = dev_get_drvdata ( s -> private );
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    u64 count;
+    int i, cpu;
+
+    for ( i = 0; i < R8139DN_HIST_BUCKETS ; ++i )
+    {
+        count = 0;
+        for_each_possible_cpu ( cpu )
+        {
+            count += per_cpu_ptr ( priv -> hists, cpu ) -> bucket [ id ] [ i ];
+        }
+
+        if ( ! count )
+        {
+            continue;
+        }
+
+        if ( i == 0 )
+        {
+            seq_printf ( s, "0 1 %llu\n", count );
+        }
+        else if ( i == R8139DN_HIST_BUCKETS - 1 )
+        {
+            seq_printf ( s, "%llu inf %llu\n", 1ULL << ( i - 1 ), count );
+        }
+        else
+        {
+            seq_printf ( s, "%llu %llu %llu\n", 1ULL << ( i - 1 ), 1ULL << i, count );
+        }
+    }
+
+    return 0;
+}
+
+static int _r8139dn_debugfs_show_isr_ns ( struct seq_file * s, void * data )
+{
+    return _r8139dn_debugfs_show ( s, R8139DN_HIST_ISR_NS );
+}
+
+static int _r8139dn_debugfs_show_rx_frames ( struct seq_file * s, void * data )
+{
+    return _r8139dn_debugfs_show ( s, R8139DN_HIST_RX_FRAMES );
+}
+
+static int _r8139dn_debugfs_show_tx_frames ( struct seq_file * s, void * data )
+{
+    return _r8139dn_debugfs_show ( s, R8139DN_HIST_TX_FRAMES );
+}
+
+static int _r8139dn_debugfs_show_tx_latency_ns ( struct seq_file * s, void * data )
+{
+    return _r8139dn_debugfs_show ( s, R8139DN_HIST_TX_LATENCY_NS );
+}
@@ -0,0 +1,43 @@
+#ifndef _R8139DN_DEBUGFS_H
+#define _R8139DN_DEBUGFS_H
+
+#include <linux/debugfs.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+
+struct r8139dn_priv;
+
+// Our latency / batching histograms, in /sys/kernel/debug/r8139d_naive/<PCI address>/
+enum r8139dn_hist_id
+{
+    R8139DN_HIST_ISR_NS,            // Time spent in our IRQ handler
+    R8139DN_HIST_RX_FRAMES,         // Frames processed per run of our poll function
+    R8139DN_HIST_TX_FRAMES,         // Frames reclaimed per TX interrupt
+    R8139DN_HIST_TX_LATENCY_NS,     // Time from start_xmit to TSD_TOK
+    R8139DN_HIST_NB
+};
+
+// Bucket 0 counts the 0 values, bucket i counts values in [2^(i-1), 2^i)
+// The last bucket also counts everything above
+#define R8139DN_HIST_BUCKETS 32
+
+struct r8139dn_hists
+{
+    u64 bucket [ R8139DN_HIST_NB ] [ R8139DN_HIST_BUCKETS ];
+};
+
+void r8139dn_debugfs_mod_init ( void );
+void r8139dn_debugfs_mod_exit ( void );
+int r8139dn_debugfs_init ( struct r8139dn_priv * priv );
+void r8139dn_debugfs_release ( struct r8139dn_priv * priv );
+
+// Account for value in a histogram. Any context
+// Histograms are per-CPU: no lock, no shared cache line on our hot paths
+static inline void r8139dn_hist_add ( struct r8139dn_hists __percpu * hists, int id, u64 value )
+{
+    int i = min_t ( int, fls64 ( value ), R8139DN_HIST_BUCKETS - 1 );
+
+    this_cpu_inc ( hists -> bucket [ id ] [ i ] );
+}
+
+#endif
@@ -0,0 +1,617 @@
+#include "common.h"
+#include "ethtool.h"
+#include "net.h"
+#include "selftest.h"
+
+#include <linux/pci.h>
+
+static void r8139dn_ethtool_get_drvinfo ( struct net_device * ndev, struct ethtool_drvinfo * info );
+static int r8139dn_ethtool_get_link_ksettings ( struct net_device * ndev, struct ethtool_link_ksettings * cmd );
+static int r8139dn_ethtool_set_link_ksettings ( struct net_device * ndev, const struct ethtool_link_ksettings * cmd );
+static int r8139dn_ethtool_nway_reset ( struct net_device * ndev );
+static u32 r8139dn_ethtool_get_msglevel ( struct net_device * ndev );
+static void r8139dn_ethtool_set_msglevel ( struct net_device * ndev, u32 value );
+static int r8139dn_ethtool_get_eeprom_len ( struct net_device * ndev );
+static int r8139dn_ethtool_get_eeprom ( struct net_device * ndev, struct ethtool_eeprom * eeprom, u8 * data );
+static int r8139dn_ethtool_get_coalesce ( struct net_device * ndev, struct ethtool_coalesce * ec,
+        struct kernel_ethtool_coalesce * kec, struct netlink_ext_ack * extack );
+static int r8139dn_ethtool_set_coalesce ( struct net_device * ndev, struct ethtool_coalesce * ec,
+        struct kernel_ethtool_coalesce * kec, struct netlink_ext_ack * extack );
+static void r8139dn_ethtool_get_ringparam ( struct net_device * ndev, struct ethtool_ringparam * ring );
+static int r8139dn_ethtool_set_ringparam ( struct net_device * ndev, struct ethtool_ringparam * ring );
+static void r8139dn_ethtool_get_pauseparam ( struct net_device * ndev, struct ethtool_pauseparam * pause );
+static int r8139dn_ethtool_set_pauseparam ( struct net_device * ndev, struct ethtool_pauseparam * pause );
+static void r8139dn_ethtool_get_pause_stats ( struct net_device * ndev, struct ethtool_pause_stats * pause_stats );
+static int r8139dn_ethtool_get_tunable ( struct net_device * ndev, const struct ethtool_tunable * tuna, void * data );
+static int r8139dn_ethtool_set_tunable ( struct net_device * ndev, const struct ethtool_tunable * tuna, const void * data );
+static int r8139dn_ethtool_get_sset_count ( struct net_device * ndev, int sset );
+static void r8139dn_ethtool_get_strings ( struct net_device * ndev, u32 sset, u8 * data );
+static void r8139dn_ethtool_get_stats ( struct net_device * ndev, struct ethtool_stats * stats, u64 * data );
+static u32 r8139dn_ethtool_get_priv_flags ( struct net_device * ndev );
+static int r8139dn_ethtool_set_priv_flags ( struct net_device * ndev, u32 flags );
+static void r8139dn_ethtool_self_test ( struct net_device * ndev, struct ethtool_test * test, u64 * data );
+
+// Our private flags (ethtool --show-priv-flags eth0)
+// Bit i of the flags is the flag named by the i-th string
+enum
+{
+    R8139DN_PRIV_ADAPTIVE_FIFO = ( 1 << 0 ),
+};
+
+static const char r8139dn_ethtool_priv_flags_str [ ] [ ETH_GSTRING_LEN ] =
+{
+    "adaptive-fifo",
+};
+
+// Our statistics (ethtool -S eth0), in the order r8139dn_ethtool_get_stats fills them:
+// FIFO tuning, flow control state, then the RX, IRQ and hardware counters (see stats.h)
+static const char r8139dn_ethtool_stats_str [ ] [ ETH_GSTRING_LEN ] =
+{
+    // Current FIFO settings, in bytes
+    "tx_early_threshold",
+    "tx_dma_burst",
+    "rx_fifo_threshold",    // 0: whole frame
+    "rx_dma_burst",         // 0: unlimited
+    // FIFO tuning adjustments
+    "tx_threshold_raised",
+    "tx_threshold_lowered",
+    "rx_fifo_tuned",
+    // Flow control, right now
+    "rx_paused",            // The link partner asked us to hold off (MSR_RXPF)
+    "tx_paused",            // We asked the link partner to hold off (MSR_TXPF, or our RX ring watermark)
+};
+
+static const char r8139dn_ethtool_rx_stats_str [ R8139DN_RX_STAT_NB ] [ ETH_GSTRING_LEN ] =
+{
+    [ R8139DN_RX_PACKETS ] = "rx_packets",
+    [ R8139DN_RX_BYTES ] = "rx_bytes",
+    [ R8139DN_RX_CRC_ERRORS ] = "rx_crc_errors",
+    [ R8139DN_RX_FRAME_ERRORS ] = "rx_frame_errors",
+    [ R8139DN_RX_LENGTH_ERRORS ] = "rx_length_errors",
+    [ R8139DN_RX_SYMBOL_ERRORS ] = "rx_symbol_errors",
+    [ R8139DN_RX_ALLOC_FAILED ] = "rx_alloc_failed",
+    [ R8139DN_RX_XDP_DROP ] = "rx_xdp_drop",
+    [ R8139DN_RX_XDP_TX ] = "rx_xdp_tx",
+    [ R8139DN_RX_XDP_TX_ERRORS ] = "rx_xdp_tx_errors",
+    [ R8139DN_RX_RESYNCS ] = "rx_resyncs",
+    [ R8139DN_RX_RESETS ] = "rx_resets",
+    [ R8139DN_RX_SIZE + 0 ] = "rx_size_64",
+    [ R8139DN_RX_SIZE + 1 ] = "rx_size_65_127",
+    [ R8139DN_RX_SIZE + 2 ] = "rx_size_128_255",
+    [ R8139DN_RX_SIZE + 3 ] = "rx_size_256_511",
+    [ R8139DN_RX_SIZE + 4 ] = "rx_size_512_1023",
+    [ R8139DN_RX_SIZE + 5 ] = "rx_size_1024_1518",
+    [ R8139DN_RX_SIZE + 6 ] = "rx_size_1519_max",
+};
+
+static const char r8139dn_ethtool_irq_stats_str [ R8139DN_IRQ_STAT_NB ] [ ETH_GSTRING_LEN ] =
+{
+    [ R8139DN_TX_PACKETS ] = "tx_packets",
+    [ R8139DN_TX_BYTES ] = "tx_bytes",
+    [ R8139DN_TX_ERRORS ] = "tx_errors",
+    [ R8139DN_TX_DROPPED ] = "tx_dropped",
+    [ R8139DN_TX_ABORTED ] = "tx_aborted",
+    [ R8139DN_TX_UNDERRUNS ] = "tx_underruns",
+    [ R8139DN_TX_CARRIER_ERRORS ] = "tx_carrier_errors",
+    [ R8139DN_TX_WINDOW_ERRORS ] = "tx_window_errors",
+    [ R8139DN_TX_HEARTBEAT_ERRORS ] = "tx_heartbeat_errors",
+    [ R8139DN_TX_COLLISIONS ] = "tx_collisions",
+    [ R8139DN_TX_XDP_XMIT ] = "tx_xdp_xmit",
+    [ R8139DN_TX_XDP_XMIT_ERRORS ] = "tx_xdp_xmit_errors",
+    [ R8139DN_TX_PAUSE_XOFF ] = "tx_pause_xoff",
+    [ R8139DN_TX_PAUSE_XON ] = "tx_pause_xon",
+    [ R8139DN_RX_OVER_ERRORS ] = "rx_over_errors",
+    [ R8139DN_RX_FIFO_ERRORS ] = "rx_fifo_errors",
+    [ R8139DN_RX_EARLY_BAD ] = "rx_early_bad",
+    [ R8139DN_TX_TIMEOUTS ] = "tx_timeouts",
+    [ R8139DN_TX_RESTARTS ] = "tx_restarts",
+    [ R8139DN_TX_RESETS ] = "tx_resets",
+    [ R8139DN_TX_SIZE + 0 ] = "tx_size_64",
+    [ R8139DN_TX_SIZE + 1 ] = "tx_size_65_127",
+    [ R8139DN_TX_SIZE + 2 ] = "tx_size_128_255",
+    [ R8139DN_TX_SIZE + 3 ] = "tx_size_256_511",
+    [ R8139DN_TX_SIZE + 4 ] = "tx_size_512_1023",
+    [ R8139DN_TX_SIZE + 5 ] = "tx_size_1024_1518",
+    [ R8139DN_TX_SIZE + 6 ] = "tx_size_1519_max",
+};
+
+static const char r8139dn_ethtool_hw_stats_str [ R8139DN_HW_STAT_NB ] [ ETH_GSTRING_LEN ] =
+{
+    [ R8139DN_HW_MISSED ] = "rx_missed",
+    [ R8139DN_HW_RX_ERRORS ] = "rx_phy_errors",
+    [ R8139DN_HW_FALSE_CARRIER ] = "false_carrier",
+    [ R8139DN_HW_DISCONNECTS ] = "disconnects",
+};
+
+// r8139dn_ethtool_ops stores functors to our ethtool actions,
+// so that the kernel can call the relevant one when userspace runs ethtool
+const struct ethtool_ops r8139dn_ethtool_ops =
+{
+    // Tell the ethtool core which coalescing parameters we understand
+    // It will reject any other parameter for us
+    .supported_coalesce_params = ETHTOOL_COALESCE_RX_USECS |
+                                 ETHTOOL_COALESCE_RX_MAX_FRAMES |
+                                 ETHTOOL_COALESCE_TX_USECS |
+                                 ETHTOOL_COALESCE_USE_ADAPTIVE_RX,
+
+    .get_drvinfo = r8139dn_ethtool_get_drvinfo,
+    .get_link = ethtool_op_get_link,
+    .get_link_ksettings = r8139dn_ethtool_get_link_ksettings,
+    .set_link_ksettings = r8139dn_ethtool_set_link_ksettings,
+    .nway_reset = r8139dn_ethtool_nway_reset,
+    .get_msglevel = r8139dn_ethtool_get_msglevel,
+    .set_msglevel = r8139dn_ethtool_set_msglevel,
+    .get_eeprom_len = r8139dn_ethtool_get_eeprom_len,
+    .get_eeprom = r8139dn_ethtool_get_eeprom,
+
+    .get_coalesce = r8139dn_ethtool_get_coalesce,
+    .set_coalesce = r8139dn_ethtool_set_coalesce,
+
+    .get_ringparam = r8139dn_ethtool_get_ringparam,
+    .set_ringparam = r8139dn_ethtool_set_ringparam,
+
+    .get_pauseparam = r8139dn_ethtool_get_pauseparam,
+    .set_pauseparam = r8139dn_ethtool_set_pauseparam,
+    .get_pause_stats = r8139dn_ethtool_get_pause_stats,
+
+    .get_tunable = r8139dn_ethtool_get_tunable,
+    .set_tunable = r8139dn_ethtool_set_tunable,
+
+    .get_sset_count = r8139dn_ethtool_get_sset_count,
+    .get_strings = r8139dn_ethtool_get_strings,
+    .get_ethtool_stats = r8139dn_ethtool_get_stats,
+
+    .get_priv_flags = r8139dn_ethtool_get_priv_flags,
+    .set_priv_flags = r8139dn_ethtool_set_priv_flags,
+
+    .self_test = r8139dn_ethtool_self_test,
+};
+
+// ethtool -i eth0
+static void r8139dn_ethtool_get_drvinfo ( struct net_device * ndev, struct ethtool_drvinfo * info )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    strlcpy ( info -> driver, KBUILD_MODNAME, sizeof ( info -> driver ) );
+    strlcpy ( info -> bus_info, pci_name ( priv -> pdev ), sizeof ( info -> bus_info ) );
+}
+
+// ethtool eth0
+// The PHY registers tell what has been advertised and negotiated, MSR tells the speed the MAC actually runs at
+// (e.g. with a link partner that doesn't auto-negotiate, ANLPAR may not tell us anything)
+static int r8139dn_ethtool_get_link_ksettings ( struct net_device * ndev, struct ethtool_link_ksettings * cmd )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    mii_ethtool_get_link_ksettings ( & priv -> mii, cmd );
+    ethtool_link_ksettings_add_link_mode ( cmd, supported, Pause );
+
+    if ( netif_carrier_ok ( ndev ) )
+    {
+        cmd -> base.speed = r8139dn_r8 ( MSR ) & MSR_SPD_10 ? SPEED_10 : SPEED_100;
+    }
+
+    return 0;
+}
+
+// ethtool -s eth0 speed 100 duplex full autoneg off
+// ethtool -s eth0 autoneg on advertise 0x008
+// The link goes down and up again: our link work will tell the kernel about the new speed and duplex
+static int r8139dn_ethtool_set_link_ksettings ( struct net_device * ndev, const struct ethtool_link_ksettings * cmd )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    return mii_ethtool_set_link_ksettings ( & priv -> mii, cmd );
+}
+
+// ethtool -r eth0
+static int r8139dn_ethtool_nway_reset ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    return mii_nway_restart ( & priv -> mii );
+}
+
+static u32 r8139dn_ethtool_get_msglevel ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    return priv -> msg_enable;
+}
+
+// ethtool -s eth0 msglvl 0x7fff
+static void r8139dn_ethtool_set_msglevel ( struct net_device * ndev, u32 value )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    priv -> msg_enable = value;
+}
+
+static int r8139dn_ethtool_get_eeprom_len ( struct net_device * ndev )
+{
+    return R8139DN_EEPROM_WORDS * sizeof ( u16 );
+}
+
+// ethtool -e eth0
+// Served from our copy of the EEPROM: no bit-banging here
+// Bytes come out in the EEPROM order (each word is little endian)
+static int r8139dn_ethtool_get_eeprom ( struct net_device * ndev, struct ethtool_eeprom * eeprom, u8 * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    u32 i;
+
+    // Lets ethtool tell which device the dump comes from
+    eeprom -> magic = priv -> pdev -> vendor | ( priv -> pdev -> device << 16 );
+
+    // The kernel already checked offset + len against get_eeprom_len
+    for ( i = 0; i < eeprom -> len ; ++i )
+    {
+        u32 byte = eeprom -> offset + i;
+
+        data [ i ] = priv -> eeprom [ byte / 2 ] >> ( ( byte & 1 ) * 8 );
+    }
+
+    return 0;
+}
+
+// ethtool -c eth0
+// rx-frames is not "frames before an interrupt" here: the hardware has no frame counter to raise one with
+// It is how many frames a poll must find for RX moderation to go on (see r8139dn_ethtool_set_coalesce)
+static int r8139dn_ethtool_get_coalesce ( struct net_device * ndev, struct ethtool_coalesce * ec,
+        struct kernel_ethtool_coalesce * kec, struct netlink_ext_ack * extack )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    ec -> rx_coalesce_usecs = READ_ONCE ( priv -> coal.rx_usecs );
+    ec -> rx_max_coalesced_frames = priv -> coal.rx_frames;
+    ec -> tx_coalesce_usecs = priv -> coal.tx_usecs;
+    ec -> use_adaptive_rx_coalesce = priv -> coal.adaptive_rx;
+
+    return 0;
+}
+
+// ethtool -C eth0 rx-usecs 100 rx-frames 8 tx-usecs 200 adaptive-rx off
+// New values are picked up the next time the coalescing timer gets armed
+// rx-usecs: once a poll is done, how long INT_ROK stays masked, so that the next frames are handled in one batch
+// rx-frames: that only happens after a poll that found at least rx-frames frames (the traffic is busy)
+// After smaller batches, every frame raises its interrupt again (the traffic is light, latency matters more)
+// The RTL8139 can't count frames to raise an interrupt after rx-frames of them, as ethtool usually means it
+static int r8139dn_ethtool_set_coalesce ( struct net_device * ndev, struct ethtool_coalesce * ec,
+        struct kernel_ethtool_coalesce * kec, struct netlink_ext_ack * extack )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    // Our coalescing lives in the poll function and TX IRQ handler of the RTL8139 rings
+    if ( priv -> cplus )
+    {
+        NL_SET_ERR_MSG ( extack, "Interrupt coalescing is not supported in C+ mode" );
+        return -EOPNOTSUPP;
+    }
+
+    if ( ec -> rx_coalesce_usecs > R8139DN_COAL_MAX_USECS ||
+         ec -> tx_coalesce_usecs > R8139DN_COAL_MAX_USECS )
+    {
+        NL_SET_ERR_MSG ( extack, "Coalescing delay is too long" );
+        return -EINVAL;
+    }
+
+    // Turning adaptive coalescing off: a pending net_dim decision must not override the rx-usecs given here
+    // Next time it is turned on, net_dim starts measuring from scratch
+    if ( priv -> coal.adaptive_rx && ! ec -> use_adaptive_rx_coalesce )
+    {
+        WRITE_ONCE ( priv -> coal.adaptive_rx, false );
+        cancel_work_sync ( & priv -> coal.dim.work );
+
+        priv -> coal.dim.state = DIM_START_MEASURE;
+        priv -> coal.dim.profile_ix = 0;
+        priv -> coal.dim.tune_state = DIM_PARKING_ON_TOP;
+        priv -> coal.dim.steps_left = 0;
+        priv -> coal.dim.steps_right = 0;
+        priv -> coal.dim.tired = 0;
+    }
+
+    // Our poll function and TX IRQ handler read them without any lock
+    // 0 frame doesn't make sense, it means "as soon as we got something", that is 1 frame
+    WRITE_ONCE ( priv -> coal.rx_frames, max_t ( u32, ec -> rx_max_coalesced_frames, 1 ) );
+    WRITE_ONCE ( priv -> coal.rx_usecs, ec -> rx_coalesce_usecs );
+    WRITE_ONCE ( priv -> coal.tx_usecs, ec -> tx_coalesce_usecs );
+    WRITE_ONCE ( priv -> coal.adaptive_rx, ec -> use_adaptive_rx_coalesce );
+
+    return 0;
+}
+
+// ethtool -g eth0
+// Our RX ring is a contiguous buffer rather than a ring of descriptors: its size is in bytes
+// Our TX ring is the software staging ring in front of the 4 hardware descriptors: its size is in frames
+// In C+ mode, both are rings of descriptors of fixed size
+static void r8139dn_ethtool_get_ringparam ( struct net_device * ndev, struct ethtool_ringparam * ring )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    if ( priv -> cplus )
+    {
+        ring -> rx_max_pending = ring -> rx_pending = R8139DN_CP_RX_RING_SIZE;
+        ring -> tx_max_pending = ring -> tx_pending = R8139DN_CP_TX_RING_SIZE;
+        return;
+    }
+
+    ring -> rx_max_pending = R8139DN_RX_BUFLEN_MAX;
+    ring -> rx_pending = priv -> rx_ring.len;
+    ring -> tx_max_pending = R8139DN_TX_RING_MAX;
+    ring -> tx_pending = priv -> tx_ring.len;
+}
+
+// ethtool -G eth0 rx 65536 tx 128
+// The RX ring size is rounded up to the next size supported by the hardware (8K, 16K, 32K or 64K)
+// The TX ring size is rounded up to the next power of 2
+// If the interface is up, it is brought down and up again to reallocate the rings
+static int r8139dn_ethtool_set_ringparam ( struct net_device * ndev, struct ethtool_ringparam * ring )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    bool running = netif_running ( ndev );
+    u32 len, tx_len, old_len, old_tx_len;
+    int err;
+
+    if ( priv -> cplus )
+    {
+        return -EOPNOTSUPP;
+    }
+
+    if ( ring -> rx_mini_pending || ring -> rx_jumbo_pending )
+    {
+        return -EINVAL;
+    }
+
+    if ( ring -> rx_pending < R8139DN_RX_BUFLEN_MIN || ring -> rx_pending > R8139DN_RX_BUFLEN_MAX )
+    {
+        return -EINVAL;
+    }
+
+    if ( ring -> tx_pending < R8139DN_TX_RING_MIN || ring -> tx_pending > R8139DN_TX_RING_MAX )
+    {
+        return -EINVAL;
+    }
+
+    len = roundup_pow_of_two ( ring -> rx_pending );
+    tx_len = roundup_pow_of_two ( ring -> tx_pending );
+    if ( len == priv -> rx_ring.len && tx_len == priv -> tx_ring.len )
+    {
+        return 0;
+    }
+
+    if ( ! running )
+    {
+        priv -> rx_ring.len = len;
+        priv -> tx_ring.len = tx_len;
+        return 0;
+    }
+
+    r8139dn_net_detach ( ndev );
+
+    old_len = priv -> rx_ring.len;
+    old_tx_len = priv -> tx_ring.len;
+    priv -> rx_ring.len = len;
+    priv -> tx_ring.len = tx_len;
+
+    // Bigger rings may not fit (DMA memory): go back to the ones we had
+    err = r8139dn_net_open ( ndev );
+    if ( err )
+    {
+        priv -> rx_ring.len = old_len;
+        priv -> tx_ring.len = old_tx_len;
+        r8139dn_net_reopen ( ndev );
+        return err;
+    }
+
+    netif_device_attach ( ndev );
+
+    return 0;
+}
+
+// ethtool -a eth0
+// These are our settings: the kernel logs what is in effect on the link when it comes up
+static void r8139dn_ethtool_get_pauseparam ( struct net_device * ndev, struct ethtool_pauseparam * pause )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    pause -> autoneg = priv -> pause.autoneg;
+    pause -> rx_pause = priv -> pause.rx;
+    pause -> tx_pause = priv -> pause.tx;
+}
+
+// ethtool -A eth0 autoneg on rx on tx on
+// With auto-negotiation, we can only advertise symmetric flow control: rx and tx go together
+// The new advertisement restarts the auto-negotiation, forced settings apply right away
+static int r8139dn_ethtool_set_pauseparam ( struct net_device * ndev, struct ethtool_pauseparam * pause )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    if ( pause -> autoneg && pause -> rx_pause != pause -> tx_pause )
+    {
+        return -EINVAL;
+    }
+
+    priv -> pause.autoneg = pause -> autoneg;
+    priv -> pause.rx = pause -> rx_pause;
+    priv -> pause.tx = pause -> tx_pause;
+
+    if ( ! netif_running ( ndev ) )
+    {
+        return 0;
+    }
+
+    r8139dn_hw_advertise_pause ( priv, priv -> pause.autoneg && priv -> pause.rx );
+
+    if ( netif_carrier_ok ( ndev ) )
+    {
+        r8139dn_net_update_pause ( ndev );
+    }
+
+    return 0;
+}
+
+// ethtool -I -a eth0
+// We only know about the PAUSE frames our poll function sent: the hardware doesn't count its own, nor the received ones
+static void r8139dn_ethtool_get_pause_stats ( struct net_device * ndev, struct ethtool_pause_stats * pause_stats )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_stats sum;
+
+    r8139dn_stats_fold ( priv, & sum );
+    pause_stats -> tx_pause_frames = sum.irq [ R8139DN_TX_PAUSE_XOFF ] + sum.irq [ R8139DN_TX_PAUSE_XON ];
+}
+
+// ethtool --get-tunable eth0 tx-copybreak rx-copybreak
+static int r8139dn_ethtool_get_tunable ( struct net_device * ndev, const struct ethtool_tunable * tuna, void * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    switch ( tuna -> id )
+    {
+        case ETHTOOL_TX_COPYBREAK:
+            * ( u32 * ) data = priv -> tx_ring.copybreak;
+            return 0;
+
+        case ETHTOOL_RX_COPYBREAK:
+            * ( u32 * ) data = priv -> rx_ring.copybreak;
+            return 0;
+
+        default:
+            return -EOPNOTSUPP;
+    }
+}
+
+// ethtool --set-tunable eth0 tx-copybreak 256
+// Frames smaller than tx-copybreak are copied, bigger ones are DMAed from the sk_buff when possible
+// Anything above the biggest frame we can send means "always copy"
+// ethtool --set-tunable eth0 rx-copybreak 256
+// Frames up to rx-copybreak are copied to small sk_buffs, bigger ones to recycled pages
+static int r8139dn_ethtool_set_tunable ( struct net_device * ndev, const struct ethtool_tunable * tuna, const void * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    switch ( tuna -> id )
+    {
+        case ETHTOOL_TX_COPYBREAK:
+            priv -> tx_ring.copybreak = min_t ( u32, * ( const u32 * ) data, R8139DN_MAX_ETH_SIZE );
+            return 0;
+
+        case ETHTOOL_RX_COPYBREAK:
+            WRITE_ONCE ( priv -> rx_ring.copybreak, min_t ( u32, * ( const u32 * ) data, R8139DN_MAX_ETH_SIZE ) );
+            return 0;
+
+        default:
+            return -EOPNOTSUPP;
+    }
+}
+
+// Number of strings of a string set: the ethtool core then asks for them with get_strings
+static int r8139dn_ethtool_get_sset_count ( struct net_device * ndev, int sset )
+{
+    switch ( sset )
+    {
+        case ETH_SS_STATS:
+            return ARRAY_SIZE ( r8139dn_ethtool_stats_str ) + R8139DN_RX_STAT_NB +
+                R8139DN_IRQ_STAT_NB + R8139DN_HW_STAT_NB;
+
+        case ETH_SS_PRIV_FLAGS:
+            return ARRAY_SIZE ( r8139dn_ethtool_priv_flags_str );
+
+        case ETH_SS_TEST:
+            return R8139DN_TEST_NB;
+
+        default:
+            return -EOPNOTSUPP;
+    }
+}
+
+static void r8139dn_ethtool_get_strings ( struct net_device * ndev, u32 sset, u8 * data )
+{
+    switch ( sset )
+    {
+        case ETH_SS_STATS:
+            memcpy ( data, r8139dn_ethtool_stats_str, sizeof ( r8139dn_ethtool_stats_str ) );
+            data += sizeof ( r8139dn_ethtool_stats_str );
+            memcpy ( data, r8139dn_ethtool_rx_stats_str, sizeof ( r8139dn_ethtool_rx_stats_str ) );
+            data += sizeof ( r8139dn_ethtool_rx_stats_str );
+            memcpy ( data, r8139dn_ethtool_irq_stats_str, sizeof ( r8139dn_ethtool_irq_stats_str ) );
+            data += sizeof ( r8139dn_ethtool_irq_stats_str );
+            memcpy ( data, r8139dn_ethtool_hw_stats_str, sizeof ( r8139dn_ethtool_hw_stats_str ) );
+            break;
+
+        case ETH_SS_PRIV_FLAGS:
+            memcpy ( data, r8139dn_ethtool_priv_flags_str, sizeof ( r8139dn_ethtool_priv_flags_str ) );
+            break;
+
+        case ETH_SS_TEST:
+            memcpy ( data, r8139dn_selftest_str, sizeof ( r8139dn_selftest_str ) );
+            break;
+    }
+}
+
+// ethtool -S eth0
+// The FIFO tuning runs in IRQ context: its values are only a snapshot
+static void r8139dn_ethtool_get_stats ( struct net_device * ndev, struct ethtool_stats * stats, u64 * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_fifo * fifo = & priv -> fifo;
+    struct r8139dn_stats sum;
+    u8 ertxth = READ_ONCE ( fifo -> ertxth );
+    u32 tx_mxdma = ( READ_ONCE ( fifo -> tcr ) & TCR_MXDMA ) >> TCR_MXDMA_SHIFT;
+    u32 rcr = READ_ONCE ( fifo -> rcr );
+    u32 rxfth = ( rcr & RCR_RXFTH ) >> RCR_RXFTH_SHIFT;
+    u32 rx_mxdma = ( rcr & RCR_MXDMA ) >> RCR_MXDMA_SHIFT;
+    u8 msr;
+
+    // ERTXTH is in 32 bytes units, except 0 which means 8 bytes
+    * data++ = ertxth ? ertxth * 32 : 8;
+    * data++ = 16 << tx_mxdma;
+    * data++ = rxfth == 7 ? 0 : 16 << rxfth;
+    * data++ = rx_mxdma == 7 ? 0 : 16 << rx_mxdma;
+
+    * data++ = READ_ONCE ( fifo -> tx_raised );
+    * data++ = READ_ONCE ( fifo -> tx_lowered );
+    * data++ = READ_ONCE ( fifo -> rx_tuned );
+
+    msr = r8139dn_r8 ( MSR );
+    * data++ = !! ( msr & MSR_RXPF );
+    * data++ = ( msr & MSR_TXPF ) || READ_ONCE ( priv -> pause.xoff );
+
+    r8139dn_stats_fold ( priv, & sum );
+    memcpy ( data, sum.rx, sizeof ( sum.rx ) );
+    data += R8139DN_RX_STAT_NB;
+    memcpy ( data, sum.irq, sizeof ( sum.irq ) );
+    data += R8139DN_IRQ_STAT_NB;
+    memcpy ( data, sum.hw, sizeof ( sum.hw ) );
+}
+
+static u32 r8139dn_ethtool_get_priv_flags ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    u32 flags = 0;
+
+    if ( priv -> fifo.adaptive )
+    {
+        flags |= R8139DN_PRIV_ADAPTIVE_FIFO;
+    }
+
+    return flags;
+}
+
+// ethtool --set-priv-flags eth0 adaptive-fifo off
+// Turning the FIFO tuning off keeps the settings it has learned so far
+static int r8139dn_ethtool_set_priv_flags ( struct net_device * ndev, u32 flags )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    WRITE_ONCE ( priv -> fifo.adaptive, !! ( flags & R8139DN_PRIV_ADAPTIVE_FIFO ) );
+
+    return 0;
+}
+
+// ethtool -t eth0 [offline]
+// Called under rtnl: nothing else opens or closes the interface meanwhile
+static void r8139dn_ethtool_self_test ( struct net_device * ndev, struct ethtool_test * test, u64 * data )
+{
+    r8139dn_selftest_run ( ndev, test, data );
+}
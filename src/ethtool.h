@@ -0,0 +1,8 @@
+#ifndef _R8139DN_ETHTOOL_H
+#define _R8139DN_ETHTOOL_H
+
+#include <linux/ethtool.h>
+
+extern const struct ethtool_ops r8139dn_ethtool_ops;
+
+#endif
@@ -2,32 +2,39 @@
 #include "hw.h"
 #include "net.h"
 
+#include <linux/mii.h>
+#include <linux/etherdevice.h>  // is_valid_ether_addr
+#include <linux/iopoll.h>       // readx_poll_timeout
+
 static u16 _r8139dn_hw_eeprom_read ( struct r8139dn_priv * priv, u8 word_addr );
 
+// Our PHY is built in: rather than through an MDIO bus, its MII registers are mapped right in our registers
+// Those we don't have read as 0
+static const u8 _r8139dn_hw_mii_regs [ ] =
+{
+    [ MII_BMCR ] = BMCR,
+    [ MII_BMSR ] = BMSR,
+    [ MII_ADVERTISE ] = ANAR,
+    [ MII_LPA ] = ANLPAR,
+    [ MII_EXPANSION ] = ANER,
+};
+
 // Ask the hardware to reset
 // This will disable TX and RX, reset FIFOs,
 // reset TX buffer at TSAD0, and set BUFE (RX buffer is empty)
 // Note: IDR0 -> 5 and MAR0 -> 5 are not reset
+// We sleep while waiting: only call this from process context (probe, ifup)
 int r8139dn_hw_reset ( struct r8139dn_priv * priv )
 {
-    int i = 1000;
+    u8 cr;
 
     // Ask the chip to reset
     r8139dn_w8 ( CR, CR_RST );
 
     // Wait until the reset is complete or timeout
-    // The chip notify us by clearing the bit
-    while ( --i )
-    {
-        if ( ! ( r8139dn_r8 ( CR ) & CR_RST ) )
-        {
-            // Reset is complete!
-            break;
-        }
-        udelay ( 1 );
-    }
-
-    if ( ! i )
+    // The chip notify us by clearing the bit. Meanwhile, let the CPU do something useful
+    if ( readx_poll_timeout ( ioread8, priv -> mmio + CR, cr, ! ( cr & CR_RST ),
+                              R8139DN_RESET_POLL_US, R8139DN_RESET_TIMEOUT_US ) )
     {
         return -ETIMEDOUT;
     }
@@ -35,6 +42,7 @@ int r8139dn_hw_reset ( struct r8139dn_priv * priv )
     // Resetting the chip also resets hardware TX pointer to TSAD0
     // So we need to keep track of this, and we also reset our own position
     priv -> tx_ring.hw = 0;
+    priv -> tx_ring.sent = 0;
     priv -> tx_ring.cpu = 0;
 
     return 0;
@@ -133,7 +141,19 @@ void r8139dn_hw_kernel_mac_to_regs ( struct net_device * ndev )
     r8139dn_w8 ( EE_CR, EE_CR_NORMAL );
 }
 
-// Retrieve the MAC address from device's EEPROM
+// Read the whole EEPROM once, at probe time, and keep it in priv -> eeprom
+// Bit-banging is slow (a few ms for the 64 words): nobody should ever have to wait for it again
+void r8139dn_hw_eeprom_load ( struct r8139dn_priv * priv )
+{
+    int i;
+
+    for ( i = 0 ; i < R8139DN_EEPROM_WORDS ; ++i )
+    {
+        priv -> eeprom [ i ] = _r8139dn_hw_eeprom_read ( priv, i );
+    }
+}
+
+// Retrieve the MAC address from device's EEPROM (our copy of it, see r8139dn_hw_eeprom_load)
 // and update the net device with it to tell the kernel.
 void r8139dn_hw_eeprom_mac_to_kernel ( struct net_device * ndev )
 {
@@ -142,15 +162,84 @@ void r8139dn_hw_eeprom_mac_to_kernel ( struct net_device * ndev )
 
     for ( i = 0 ; i < 3 ; ++i )
     {
-        ( ( u16 * ) ndev -> dev_addr ) [ i ] = _r8139dn_hw_eeprom_read ( priv, EE_DATA_MAC + i );
+        ( ( u16 * ) ndev -> dev_addr ) [ i ] = priv -> eeprom [ EE_DATA_MAC + i ];
     }
 }
 
+// Self-test: does the EEPROM look like ours? (ethtool -t)
+// The RTL8139 layout has no checksum word: we check the ID word and the MAC address of our copy and,
+// if asked, that reading the EEPROM again gives the very same 64 words
+// Reading it switches EE_CR to programming mode, where the chip stops talking to the network and the PCI bus:
+// only reread while the interface is down
+int r8139dn_hw_test_eeprom ( struct r8139dn_priv * priv, bool reread )
+{
+    u8 mac [ ETH_ALEN ];
+    int i;
+
+    if ( priv -> eeprom [ 0 ] != R8139DN_EEPROM_ID )
+    {
+        return -EINVAL;
+    }
+
+    for ( i = 0 ; i < 3 ; ++i )
+    {
+        mac [ 2 * i ] = priv -> eeprom [ EE_DATA_MAC + i ] & 0xff;
+        mac [ 2 * i + 1 ] = priv -> eeprom [ EE_DATA_MAC + i ] >> 8;
+    }
+
+    if ( ! is_valid_ether_addr ( mac ) )
+    {
+        return -EINVAL;
+    }
+
+    for ( i = 0 ; reread && i < R8139DN_EEPROM_WORDS ; ++i )
+    {
+        if ( _r8139dn_hw_eeprom_read ( priv, i ) != priv -> eeprom [ i ] )
+        {
+            return -EIO;
+        }
+    }
+
+    return 0;
+}
+
+// Self-test: registers keep what we write to them (ethtool -t)
+// Only call this on a stopped chip (right after a reset): we scribble on the multicast filter and the DMA addresses,
+// which ifup sets up again anyway. In C+ mode, TSAD0 -> TSAD3 hold the descriptor rings addresses, whose low bits may not stick
+// The chip version must also be one we know: an unplugged card (or a dead bus) reads all ones
+int r8139dn_hw_test_regs ( struct r8139dn_priv * priv )
+{
+    static const u32 patterns [ ] = { 0x00000000, 0xffffffff, 0x55aa55aa, 0xaa55aa55 };
+    static const u8 regs [ ] = { MAR0, MAR4, RBSTART, TSAD0, TSAD1, TSAD2, TSAD3 };
+    int nb = priv -> cplus ? 3 : ARRAY_SIZE ( regs );
+    u32 version = r8139dn_r32 ( TCR ) & TCR_HWVERID_MASK;
+    int i, j;
+
+    if ( ! r8139dn_hw_version_known ( version ) )
+    {
+        return -ENODEV;
+    }
+
+    for ( i = 0 ; i < nb ; ++i )
+    {
+        for ( j = 0 ; j < ARRAY_SIZE ( patterns ) ; ++j )
+        {
+            r8139dn_w32 ( regs [ i ], patterns [ j ] );
+            if ( r8139dn_r32 ( regs [ i ] ) != patterns [ j ] )
+            {
+                return -EIO;
+            }
+        }
+
+        r8139dn_w32 ( regs [ i ], 0 );
+    }
+
+    return 0;
+}
+
 // Enable the transmitter, set up the transmission settings
-// Tell hardware where to DMA
 void r8139dn_hw_setup_tx ( struct r8139dn_priv * priv )
 {
-    int i;
     u8 cr = r8139dn_r8 ( CR );
 
     // Turn the transmitter on
@@ -159,16 +248,12 @@ void r8139dn_hw_setup_tx ( struct r8139dn_priv * priv )
     // Set up the TX settings
     r8139dn_w32 ( TCR, priv -> tcr );
 
-    // We want 8 + (3 x 32) bytes = 104 bytes of early TX threshold
-    // It means we put data on the wire only once FIFO has reached this threshold
-    priv -> tx_flags = ( 3 << TSD_ERTXTH_SHIFT );
+    // Early TX threshold: we put data on the wire only once FIFO has reached this threshold
+    // It starts at 3 x 32 bytes = 96 bytes, and then r8139dn_hw_tune_tx adapts it to our PCI bus
+    priv -> tx_flags = ( priv -> fifo.ertxth << TSD_ERTXTH_SHIFT );
 
-    // Inform the hardware about the DMA location of the TX descriptors
-    // That way, later it can read the frames we want to send
-    for ( i = 0; i < R8139DN_TX_DESC_NB ; ++i )
-    {
-        r8139dn_w32 ( TSAD0 + i * TSAD_GAP, priv -> tx_ring.dma + i * R8139DN_TX_DESC_SIZE );
-    }
+    // The DMA location of each frame is given to the TX descriptors (TSAD) when it is sent:
+    // they don't always point to the same buffer
 }
 
 // Enable the receiver, set up the reception settings
@@ -176,9 +261,13 @@ void r8139dn_hw_setup_tx ( struct r8139dn_priv * priv )
 void r8139dn_hw_setup_rx ( struct r8139dn_priv * priv )
 {
     u8 cr = r8139dn_r8 ( CR );
+    u16 erth = ( priv -> rcr & RCR_ERTH ) >> RCR_ERTH_SHIFT;
 
-    // Disable Multiple Interrupt (we're going to disable early RX mode in RCR)
-    r8139dn_w16 ( MULINT, 0 );
+    // Early RX threshold for protocols the chip doesn't know (RCR_ERTH only applies to IP, IPX...)
+    // MULINT expects a number of bytes rather than a fraction of the frame,
+    // so take the same fraction of a full size frame (bits 1 and 0 must be 0)
+    // When early RX mode is disabled in RCR, this disables Multiple Interrupt
+    r8139dn_w16 ( MULINT, ( erth * ETH_FRAME_LEN / 16 ) & ~ 3 );
 
     // Tell the hardware where to DMA (location of the RX buffer)
     // We do this before enabling RX to avoid the NIC starting DMA before it knows the address
@@ -188,8 +277,124 @@ void r8139dn_hw_setup_rx ( struct r8139dn_priv * priv )
     r8139dn_w8 ( CR, cr | CR_RE );
 
     // Set up the RX settings
-    // We want to receive broadcast frames as well as frames for our own MAC
-    r8139dn_w32 ( RCR, RCR_MXDMA_1024 | RCR_APM | RCR_AB | RCR_RBLEN_16K );
+    r8139dn_w32 ( RCR, priv -> rcr );
+
+    // On RX FIFO overflow, let the hardware throw the FIFO contents away and go on by itself,
+    // rather than waiting for us to notice INT_FOVW. CONFIG4 is write protected
+    r8139dn_w8 ( EE_CR, EE_CR_CFG_WRITE_ENABLE );
+    {
+        r8139dn_w8 ( CONFIG4, r8139dn_r8 ( CONFIG4 ) | CFG4_RX_FIFO_AUTO_CLR );
+    }
+    r8139dn_w8 ( EE_CR, EE_CR_NORMAL );
+}
+
+// Update the RX filters: which frames the RCR accepts (RCR_AAP, RCR_APM, RCR_AM, RCR_AB),
+// and the multicast hash table (MAR0 to MAR7, 64 bits: mc [ 0 ] is MAR0 to MAR3, mc [ 1 ] is MAR4 to MAR7)
+// Can be called while the receiver is running: the FIFO tuning updates RCR too, hence the lock
+void r8139dn_hw_set_rx_filter ( struct r8139dn_priv * priv, u32 rx_mode, const u32 * mc )
+{
+    unsigned long flags;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+
+    // Just like IDR, MAR must be written with 4-byte accesses
+    r8139dn_w32 ( MAR0, mc [ 0 ] );
+    r8139dn_w32 ( MAR4, mc [ 1 ] );
+
+    priv -> rcr = ( priv -> rcr & ~ ( RCR_AAP | RCR_APM | RCR_AM | RCR_AB ) ) | rx_mode;
+    r8139dn_w32 ( RCR, priv -> rcr );
+
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Reset the receiver only, after it wrote garbage in our RX ring
+// Turning the receiver off resets its state machine and brings CBR back to the beginning of the ring
+// The transmitter, the RX filters and the MAC address are left untouched: this is much cheaper than a chip reset
+// Our poll function must start again from the beginning of the ring too
+void r8139dn_hw_reset_rx ( struct r8139dn_priv * priv )
+{
+    u8 cr = r8139dn_r8 ( CR );
+    unsigned long flags;
+
+    r8139dn_w8 ( CR, cr & ~ CR_RE );
+
+    // The ring is empty: we've read everything up to its beginning
+    priv -> rx_ring.cpu = 0;
+    r8139dn_w16 ( CAPR, priv -> rx_ring.cpu - R8139DN_RX_PAD );
+    r8139dn_w32 ( RBSTART, priv -> rx_ring.dma );
+
+    r8139dn_w8 ( CR, cr | CR_RE );
+
+    // RCR is only taken into account while the receiver is on
+    // The IRQ handler may update it at the same time (FIFO tuning)
+    spin_lock_irqsave ( & priv -> lock, flags );
+    r8139dn_w32 ( RCR, priv -> rcr );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Restart the transmitter only, after it stopped completing our frames
+// Turning the transmitter off clears the TX FIFO and aborts the frame being sent
+// Warning: the hardware keeps its position in the TX descriptors (only a chip reset brings it back to TSAD0)
+// The frames the hardware hasn't completed must be handed to the same descriptors again
+void r8139dn_hw_restart_tx ( struct r8139dn_priv * priv )
+{
+    u8 cr = r8139dn_r8 ( CR );
+    unsigned long flags;
+
+    r8139dn_w8 ( CR, cr & ~ CR_TE );
+    r8139dn_w8 ( CR, cr | CR_TE );
+
+    // TCR is only taken into account while the transmitter is on
+    // The IRQ handler may update it at the same time (FIFO tuning)
+    spin_lock_irqsave ( & priv -> lock, flags );
+    r8139dn_w32 ( TCR, priv -> tcr );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Turn the internal loopback on or off (TCR_LBK_ENABLE) while the transmitter is on
+// Frames already in the TX FIFO may still go the old way
+void r8139dn_hw_set_loopback ( struct r8139dn_priv * priv, bool enable )
+{
+    unsigned long flags;
+
+    // The IRQ handler may update TCR at the same time (FIFO tuning)
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> tcr = ( priv -> tcr & ~ TCR_LBK_ENABLE ) | ( enable ? TCR_LBK_ENABLE : 0 );
+    r8139dn_w32 ( TCR, priv -> tcr );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Start the RTL8139C+ in C+ mode: the hardware walks through our descriptor rings (see cp.c)
+// C+ mode is entered by writing CPCR, which must come first: the other C+ registers are ignored until then
+void r8139dn_hw_setup_cp ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_cp * cp = & priv -> cp;
+    dma_addr_t rx = cp -> dma;
+    dma_addr_t tx = cp -> dma + R8139DN_CP_RX_RING_SIZE * sizeof ( struct r8139dn_cp_desc );
+
+    r8139dn_w16 ( CPCR, cp -> cpcr );
+
+    // We only use the normal priority TX ring
+    r8139dn_w32 ( THPDS, 0 );
+    r8139dn_w32 ( THPDS + 4, 0 );
+
+    // Tell the hardware where the rings are before turning the transceiver on
+    r8139dn_w32 ( RDSAR, lower_32_bits ( rx ) );
+    r8139dn_w32 ( RDSAR + 4, upper_32_bits ( rx ) );
+    r8139dn_w32 ( TNPDS, lower_32_bits ( tx ) );
+    r8139dn_w32 ( TNPDS + 4, upper_32_bits ( tx ) );
+
+    // TCR and RCR are only taken into account while the transceiver is on
+    r8139dn_w8 ( CR, CR_RE | CR_TE );
+    r8139dn_w32 ( TCR, priv -> tcr );
+    r8139dn_w32 ( RCR, priv -> rcr );
+
+    // Same early TX threshold as r8139dn_hw_setup_tx, but the C+ mode has its own register for it
+    r8139dn_w8 ( ETTHR, priv -> fifo.ertxth );
+
+    // No early RX, no hardware interrupt mitigation
+    r8139dn_w16 ( MULINT, 0 );
+    r8139dn_w16 ( INTRMIT, 0 );
 }
 
 // Disable transceiver (TX & RX)
@@ -202,13 +407,223 @@ void r8139dn_hw_disable_transceiver ( struct r8139dn_priv * priv )
 // Ask the device to enable interrupts
 void r8139dn_hw_enable_irq ( struct r8139dn_priv * priv )
 {
+    unsigned long flags;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> masked = 0;
     r8139dn_w16 ( IMR, priv -> interrupts );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Temporarily stop the device from raising some interrupts
+// They are still reported in ISR, so nothing is lost: the interrupt
+// will fire as soon as they get unmasked if the event is still pending
+void r8139dn_hw_mask_irq ( struct r8139dn_priv * priv, u16 irqs )
+{
+    unsigned long flags;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> masked |= irqs;
+    r8139dn_w16 ( IMR, priv -> interrupts & ~ priv -> masked );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Allow the device to raise again interrupts masked by r8139dn_hw_mask_irq
+void r8139dn_hw_unmask_irq ( struct r8139dn_priv * priv, u16 irqs )
+{
+    unsigned long flags;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> masked &= ~ irqs;
+    r8139dn_w16 ( IMR, priv -> interrupts & ~ priv -> masked );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
 }
 
 // Ask the device to disable interrupts
+// We are no longer interested in any: a poll function still running can't unmask them again
+// (r8139dn_hw_unmask_irq only writes back the interrupts we are interested in)
 void r8139dn_hw_disable_irq ( struct r8139dn_priv * priv )
 {
+    unsigned long flags;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> interrupts = 0;
     r8139dn_w16 ( IMR, 0 );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Arm the general purpose timer: INT_TIMEOUT will be raised in usecs microseconds
+// Writing any value to TCTR resets the counter, which then counts up until TIMERINT is reached
+void r8139dn_hw_arm_timer ( struct r8139dn_priv * priv, u32 usecs )
+{
+    r8139dn_w32 ( TIMERINT, usecs * R8139DN_TIMER_MHZ );
+    r8139dn_w32 ( TCTR, 0 );
+}
+
+// Disarm the general purpose timer: INT_TIMEOUT is never raised while TIMERINT is 0
+void r8139dn_hw_disarm_timer ( struct r8139dn_priv * priv )
+{
+    r8139dn_w32 ( TIMERINT, 0 );
+}
+
+// A frame has been sent: adapt the early TX threshold to underruns (TSD_TUN)
+// An underrun means the hardware started sending a frame, but couldn't fetch the rest of it from memory in time
+// Make it wait for more bytes in its FIFO, and if it's already waiting for the whole frame, use longer DMA bursts
+// After a long run without any underrun, slowly lower the threshold again: waiting delays every frame we send
+// Called from the TX IRQ handler only
+void r8139dn_hw_tune_tx ( struct r8139dn_priv * priv, bool underrun )
+{
+    struct r8139dn_fifo * fifo = & priv -> fifo;
+    unsigned long flags;
+
+    if ( ! underrun )
+    {
+        if ( fifo -> ertxth > R8139DN_ERTXTH_DEFAULT && ++ fifo -> tx_clean >= R8139DN_ERTXTH_CLEAN_RUN )
+        {
+            fifo -> tx_clean = 0;
+            fifo -> ertxth--;
+            fifo -> tx_lowered++;
+            WRITE_ONCE ( priv -> tx_flags, fifo -> ertxth << TSD_ERTXTH_SHIFT );
+        }
+        return;
+    }
+
+    fifo -> tx_clean = 0;
+
+    if ( fifo -> ertxth < R8139DN_ERTXTH_MAX )
+    {
+        // Next frames given to the hardware will use the new threshold
+        fifo -> ertxth = min_t ( u8, fifo -> ertxth + R8139DN_ERTXTH_STEP, R8139DN_ERTXTH_MAX );
+        fifo -> tx_raised++;
+        WRITE_ONCE ( priv -> tx_flags, fifo -> ertxth << TSD_ERTXTH_SHIFT );
+    }
+    else if ( ( fifo -> tcr & TCR_MXDMA ) != TCR_MXDMA_2048 )
+    {
+        fifo -> tcr += ( 1 << TCR_MXDMA_SHIFT );
+        fifo -> tx_raised++;
+
+        spin_lock_irqsave ( & priv -> lock, flags );
+        priv -> tcr = ( priv -> tcr & ~ TCR_MXDMA ) | fifo -> tcr;
+        r8139dn_w32 ( TCR, priv -> tcr );
+        spin_unlock_irqrestore ( & priv -> lock, flags );
+    }
+}
+
+// The RX FIFO overflowed (INT_FOVW): the hardware couldn't move the frames to our RX ring as fast as they came in
+// Use longer DMA bursts. The RX FIFO threshold is already the lowest (16 bytes): frames can't be moved any earlier
+// Nothing tells us when the bus would be happier with shorter bursts again, so we never go back
+// Called from the IRQ handler only
+void r8139dn_hw_tune_rx ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_fifo * fifo = & priv -> fifo;
+    unsigned long flags;
+
+    // Let the previous adjustment show its effect first
+    if ( time_before ( jiffies, fifo -> rx_next ) )
+    {
+        return;
+    }
+
+    // Nothing left to tune
+    if ( ( fifo -> rcr & RCR_MXDMA ) == RCR_MXDMA_NOLIM )
+    {
+        return;
+    }
+
+    fifo -> rcr += ( 1 << RCR_MXDMA_SHIFT );
+
+    fifo -> rx_next = jiffies + R8139DN_RX_TUNE_HOLDOFF;
+    fifo -> rx_tuned++;
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    priv -> rcr = ( priv -> rcr & ~ ( RCR_MXDMA | RCR_RXFTH ) ) | fifo -> rcr;
+    r8139dn_w32 ( RCR, priv -> rcr );
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+
+// Advertise (or not) our PAUSE ability to the link partner (ANAR), for the auto-negotiation to resolve
+// We only support symmetric flow control: we don't advertise ADVERTISE_PAUSE_ASYM
+// Auto-negotiation only restarts if the advertisement changed: the link will go down and up again
+// Goes through r8139dn_hw_mdio_write: BMCR is write protected
+void r8139dn_hw_advertise_pause ( struct r8139dn_priv * priv, bool pause )
+{
+    struct net_device * ndev = priv -> mii.dev;
+    int anar = r8139dn_hw_mdio_read ( ndev, priv -> mii.phy_id, MII_ADVERTISE );
+    int new = pause ? anar | ADVERTISE_PAUSE_CAP : anar & ~ ADVERTISE_PAUSE_CAP;
+    int bmcr;
+
+    if ( new == anar )
+    {
+        return;
+    }
+
+    r8139dn_hw_mdio_write ( ndev, priv -> mii.phy_id, MII_ADVERTISE, new );
+
+    bmcr = r8139dn_hw_mdio_read ( ndev, priv -> mii.phy_id, MII_BMCR );
+    if ( bmcr & BMCR_ANENABLE )
+    {
+        r8139dn_hw_mdio_write ( ndev, priv -> mii.phy_id, MII_BMCR, bmcr | BMCR_ANRESTART );
+    }
+}
+
+// Enable flow control on the current link
+// RX: we stop sending when the link partner asks us to (MSR_RXPF tells we are holding off)
+// TX: the hardware sends PAUSE frames when its own buffers fill up (MSR_TXPF tells the link partner is held off)
+// Only valid in full duplex. With auto-negotiation, MSR_TXFCE is read-only: the hardware sets it from the result
+void r8139dn_hw_set_pause ( struct r8139dn_priv * priv, bool rx, bool tx )
+{
+    u8 msr = r8139dn_r8 ( MSR ) & ~ ( MSR_RXFCE | MSR_TXFCE );
+
+    if ( rx )
+    {
+        msr |= MSR_RXFCE;
+    }
+
+    if ( tx )
+    {
+        msr |= MSR_TXFCE;
+    }
+
+    r8139dn_w8 ( MSR, msr );
+}
+
+// MII register read, for the generic MII library (mii_if_info)
+// There's only one PHY: phy_id doesn't matter
+int r8139dn_hw_mdio_read ( struct net_device * ndev, int phy_id, int location )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    if ( location >= ARRAY_SIZE ( _r8139dn_hw_mii_regs ) || ! _r8139dn_hw_mii_regs [ location ] )
+    {
+        return 0;
+    }
+
+    return r8139dn_r16 ( _r8139dn_hw_mii_regs [ location ] );
+}
+
+// MII register write, for the generic MII library (mii_if_info)
+void r8139dn_hw_mdio_write ( struct net_device * ndev, int phy_id, int location, int val )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    if ( location >= ARRAY_SIZE ( _r8139dn_hw_mii_regs ) || ! _r8139dn_hw_mii_regs [ location ] )
+    {
+        return;
+    }
+
+    // Speed, auto-negotiation enable and duplex bits of BMCR are write protected, just like CONFIG1
+    if ( location == MII_BMCR )
+    {
+        r8139dn_w8 ( EE_CR, EE_CR_CFG_WRITE_ENABLE );
+        {
+            r8139dn_w16 ( BMCR, val );
+        }
+        r8139dn_w8 ( EE_CR, EE_CR_NORMAL );
+        return;
+    }
+
+    r8139dn_w16 ( _r8139dn_hw_mii_regs [ location ], val );
 }
 
 // Configure the leds
@@ -231,6 +646,26 @@ void r8139dn_hw_configure_leds ( struct r8139dn_priv * priv, u8 led_cfg )
     r8139dn_w8 ( EE_CR, EE_CR_NORMAL );
 }
 
+// Is this one of the chipset versions we know about?
+bool r8139dn_hw_version_known ( u32 version )
+{
+    switch ( version )
+    {
+        case RTL8139:
+        case RTL8139A:
+        case RTL8139AG_C:
+        case RTL8139B_8130:
+        case RTL8100:
+        case RTL8100B_8139D:
+        case RTL8139CP:
+        case RTL8101:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
 // Convert the chipset version number to an understandable string
 const char * r8139dn_hw_version_str ( u32 version )
 {
@@ -9,15 +9,34 @@
 struct r8139dn_priv;
 
 int r8139dn_hw_reset ( struct r8139dn_priv * priv );
+void r8139dn_hw_eeprom_load ( struct r8139dn_priv * priv );
 void r8139dn_hw_eeprom_mac_to_kernel ( struct net_device * ndev );
+int r8139dn_hw_test_eeprom ( struct r8139dn_priv * priv, bool reread );
+int r8139dn_hw_test_regs ( struct r8139dn_priv * priv );
 void r8139dn_hw_kernel_mac_to_regs ( struct net_device * ndev );
 void r8139dn_hw_setup_tx ( struct r8139dn_priv * priv );
 void r8139dn_hw_setup_rx ( struct r8139dn_priv * priv );
+void r8139dn_hw_set_rx_filter ( struct r8139dn_priv * priv, u32 rx_mode, const u32 * mc );
+void r8139dn_hw_reset_rx ( struct r8139dn_priv * priv );
+void r8139dn_hw_restart_tx ( struct r8139dn_priv * priv );
+void r8139dn_hw_set_loopback ( struct r8139dn_priv * priv, bool enable );
+void r8139dn_hw_setup_cp ( struct r8139dn_priv * priv );
 void r8139dn_hw_disable_transceiver ( struct r8139dn_priv * priv );
 void r8139dn_hw_enable_irq ( struct r8139dn_priv * priv );
 void r8139dn_hw_ack_irq ( struct r8139dn_priv * priv );
 void r8139dn_hw_disable_irq ( struct r8139dn_priv * priv );
+void r8139dn_hw_mask_irq ( struct r8139dn_priv * priv, u16 irqs );
+void r8139dn_hw_unmask_irq ( struct r8139dn_priv * priv, u16 irqs );
+void r8139dn_hw_arm_timer ( struct r8139dn_priv * priv, u32 usecs );
+void r8139dn_hw_disarm_timer ( struct r8139dn_priv * priv );
+void r8139dn_hw_tune_tx ( struct r8139dn_priv * priv, bool underrun );
+void r8139dn_hw_tune_rx ( struct r8139dn_priv * priv );
+void r8139dn_hw_advertise_pause ( struct r8139dn_priv * priv, bool pause );
+void r8139dn_hw_set_pause ( struct r8139dn_priv * priv, bool rx, bool tx );
+int r8139dn_hw_mdio_read ( struct net_device * ndev, int phy_id, int location );
+void r8139dn_hw_mdio_write ( struct net_device * ndev, int phy_id, int location, int val );
 void r8139dn_hw_configure_leds ( struct r8139dn_priv * priv, u8 led_cfg );
+bool r8139dn_hw_version_known ( u32 version );
 const char * r8139dn_hw_version_str ( u32 version );
 
 // BAR, Base Address Registers in the PCI Configuration Space
@@ -31,6 +50,21 @@ enum
 // IOAR or MEMAR each need at least 256 bytes
 #define R8139DN_IO_SIZE 256
 
+// Software reset: how often we check whether it is complete, and how long we wait for it (in us)
+#define R8139DN_RESET_POLL_US 10
+#define R8139DN_RESET_TIMEOUT_US 1000
+
+// Our 93C46 EEPROM holds 64 words of 16 bits
+// The first one is an ID, always the same on the RTL8139 family
+#define R8139DN_EEPROM_WORDS 64
+#define R8139DN_EEPROM_ID 0x8129
+
+// The general purpose timer (TCTR) counts PCI clock cycles (33 MHz)
+#define R8139DN_TIMER_MHZ 33
+
+// Longest interrupt coalescing delay we accept (in us)
+#define R8139DN_COAL_MAX_USECS 100000
+
 // Maximum Ethernet frame size that can be handled by the device
 #define R8139DN_MAX_ETH_SIZE 1792
 #define R8139DN_MAX_MTU ( R8139DN_MAX_ETH_SIZE - ETH_HLEN - ETH_FCS_LEN )
@@ -38,13 +72,56 @@ enum
 // Number and size of TX descriptors
 #define R8139DN_TX_DESC_NB 4 // Warning: we use a property requiring this to be a power of 2
 #define R8139DN_TX_DESC_SIZE R8139DN_MAX_ETH_SIZE
-#define R8139DN_TX_DMA_SIZE ( R8139DN_TX_DESC_SIZE * R8139DN_TX_DESC_NB )
+
+// Number of slots of the TX staging ring (ethtool -G tx), in front of the TX descriptors
+// Warning: must be a power of 2, and a multiple of R8139DN_TX_DESC_NB
+#define R8139DN_TX_RING_MIN R8139DN_TX_DESC_NB
+#define R8139DN_TX_RING_MAX 256
+#define R8139DN_TX_RING_DEFAULT 64
+#define R8139DN_TX_DMA_SIZE(slots) ( R8139DN_TX_DESC_SIZE * ( slots ) )
+
+// How long the TX queue may stay stopped before the kernel calls our TX watchdog
+#define R8139DN_TX_TIMEOUT ( 5 * HZ )
+
+// Above this number of multicast groups, we accept all multicast frames rather than hashing them
+#define R8139DN_MC_FILTER_LIMIT 32
+
+// Adaptive FIFO tuning (ethtool --set-priv-flags eth0 adaptive-fifo on)
+// TX early threshold (TSD_ERTXTH), in 32 bytes units: the hardware starts sending once that many bytes are in its FIFO
+#define R8139DN_ERTXTH_DEFAULT 3    // 96 bytes
+#define R8139DN_ERTXTH_STEP 2       // Raised by 64 bytes on each underrun
+#define R8139DN_ERTXTH_MAX 48       // 1536 bytes: the whole frame (store and forward)
+// Frames sent without underrun before the TX early threshold is lowered again (by 32 bytes)
+#define R8139DN_ERTXTH_CLEAN_RUN 4096
+// Shortest delay between two RX adjustments (INT_FOVW tends to fire in bursts)
+#define R8139DN_RX_TUNE_HOLDOFF ( HZ / 10 )
+
+// Flow control (ethtool -A): we ask the link partner to hold off once our RX ring is 3/4 full (XOFF),
+// and let it go on once it is back under 1/4 (XON). Pause time of the XOFF, in 512 bit times: as long as possible
+#define R8139DN_PAUSE_XOFF(buflen) ( ( buflen ) / 4 * 3 )
+#define R8139DN_PAUSE_XON(buflen) ( ( buflen ) / 4 )
+#define R8139DN_PAUSE_QUANTA 0xffff
+
+// Frames at least this big are DMAed right from the sk_buff rather than copied (when possible)
+#define R8139DN_TX_COPYBREAK_DEFAULT 512
+
+// RX ring sizes (ethtool -G rx), see RCR_RBLEN
+#define R8139DN_RX_BUFLEN_MIN 8192
+#define R8139DN_RX_BUFLEN_MAX 65536
+#define R8139DN_RX_BUFLEN_DEFAULT 16384
+
+// Frames up to this size are copied to small sk_buffs, bigger ones to page fragments of our page pool
+#define R8139DN_RX_COPYBREAK_DEFAULT 256
+#define R8139DN_RX_POOL_SIZE 256
+#define R8139DN_RX_HEADROOM ( NET_SKB_PAD + NET_IP_ALIGN )
 
 // RX DMA size
+// With RCR_WRAP, the hardware doesn't wrap a frame to the beginning of the ring: it keeps moving it
+// after the end. We need some spare room there (unused by hardware with a 64K ring, which doesn't support RCR_WRAP)
 #define R8139DN_RX_PAD 16
-#define R8139DN_RX_BUFLEN 16384
-#define R8139DN_RX_DMA_SIZE ( R8139DN_RX_BUFLEN + R8139DN_RX_PAD )
 #define R8139DN_RX_HEADER_SIZE 4
+#define R8139DN_RX_WRAP_SIZE ( R8139DN_RX_HEADER_SIZE + R8139DN_MAX_ETH_SIZE )
+#define R8139DN_RX_DMA_SIZE(buflen) ( ( buflen ) + R8139DN_RX_PAD + R8139DN_RX_WRAP_SIZE )
 #define R8139DN_RX_ALIGN_ADD 3
 #define R8139DN_RX_ALIGN_MASK ( ~R8139DN_RX_ALIGN_ADD )
 #define R8139DN_RX_ALIGN(val) ( ( ( val ) + R8139DN_RX_ALIGN_ADD ) & R8139DN_RX_ALIGN_MASK )
@@ -55,6 +132,9 @@ struct r8139dn_rx_header
     u16 size;
 };
 
+// Size the hardware writes in the RTL RX header of a frame it is still moving to the RX ring (early RX mode)
+#define R8139DN_RX_SIZE_UNFINISHED 0xfff0
+
 
 // Macros to read / write the network card registers
 #define r8139dn_r8(reg)  ioread8  ( priv->mmio + ( reg ) )
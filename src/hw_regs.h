@@ -112,6 +112,16 @@ enum r8139dn_hw_regs
 
     CONFIG5   = 0xd8, // B/M/U-cast Wakeup frames, FIFO test, Link Down Power Saving, LW, PME_STS
 
+    // RTL8139C+ only, in C+ mode (descriptor rings, see cp.c)
+    // TSD0 -> TSD3 and TSAD0 -> TSAD3 are not used in C+ mode: the descriptor rings addresses take their place
+    TNPDS     = 0x20, // Transmit Normal Priority Descriptors Start address (64 bits, 256 bytes aligned)
+    THPDS     = 0x28, // Transmit High Priority Descriptors Start address (64 bits, 256 bytes aligned)
+    TPPOLL    = 0xd9, // Transmit Priority Polling (tell the hardware new TX descriptors are ready)
+    CPCR      = 0xe0, // C+ Command Register
+    INTRMIT   = 0xe2, // Interrupt Mitigate
+    RDSAR     = 0xe4, // Receive Descriptors Start Address Register (64 bits, 256 bytes aligned)
+    ETTHR     = 0xec, // Early TX Threshold (C+ mode), in 32 bytes units
+
     // Reserved until 0xff
 };
 
@@ -123,7 +133,8 @@ enum TSDx
         TSD_TABT   = ( 1 << 30 ),       // TX Abort, because TX Retry Count has been reached
         TSD_OWC    = ( 1 << 29 ),       // Out of Window Collision during TX
         TSD_CDH    = ( 1 << 28 ),       // NIC failed to send CD Heart Beat
-        TSD_NCC    = ( 0xff << 24 ),    // Number of Collision Count
+        TSD_NCC_SHIFT = 24,             // Number of Collision Count
+            TSD_NCC = ( 0xf << TSD_NCC_SHIFT ),
         // Reserved 23 -> 22
         TSD_ERTXTH_SHIFT = 16,          // Early TX Threshold (TX FIFO Threshold)
             TSD_ERTXTH = ( 0x3f << TSD_ERTXTH_SHIFT ),
@@ -223,6 +234,7 @@ enum TCR
         TCR_MXDMA_512   = ( 5 << TCR_MXDMA_SHIFT ),
         TCR_MXDMA_1024  = ( 6 << TCR_MXDMA_SHIFT ),
         TCR_MXDMA_2048  = ( 7 << TCR_MXDMA_SHIFT ),
+        TCR_MXDMA       = ( 7 << TCR_MXDMA_SHIFT ),
 };
 
 // RX Configuration Register
@@ -256,6 +268,7 @@ enum RCR
         RCR_MXDMA_512   = ( 5 << RCR_MXDMA_SHIFT ),
         RCR_MXDMA_1024  = ( 6 << RCR_MXDMA_SHIFT ),
         RCR_MXDMA_NOLIM = ( 7 << RCR_MXDMA_SHIFT ),
+        RCR_MXDMA       = ( 7 << RCR_MXDMA_SHIFT ),
     RCR_WRAP        = ( 1 << 7 ),
     // Reserved              6
     RCR_AER         = ( 1 << 5 ), // Accept ERror packets (CRC, align, collided)
@@ -314,6 +327,79 @@ enum EE
     EE_CR_CFG_WRITE_ENABLE = 0xc0, // Unlock write access to IDR0~5, CONFIG0~4 and bit 13,12,8 of BCMR
 };
 
+// Transmit Priority Polling Register (C+ mode)
+enum TPPOLL
+{
+    TPPOLL_HPQ    = ( 1 << 7 ), // High priority queue polling
+    TPPOLL_NPQ    = ( 1 << 6 ), // Normal priority queue polling
+    TPPOLL_FSWINT = ( 1 << 0 ), // Forced software interrupt
+};
+
+// C+ Command Register
+enum CPCR
+{
+    CPCR_RX_VLAN   = ( 1 << 6 ), // Strip the 802.1Q tag of received frames (to the RX descriptor)
+    CPCR_RX_CHKSUM = ( 1 << 5 ), // Check the IP / TCP / UDP checksums of received frames
+    CPCR_DAC       = ( 1 << 4 ), // PCI Dual Address Cycle (64 bit DMA)
+    CPCR_MULRW     = ( 1 << 3 ), // PCI Multiple Read / Write
+    CPCR_RX_ENABLE = ( 1 << 1 ), // C+ mode receiver
+    CPCR_TX_ENABLE = ( 1 << 0 ), // C+ mode transmitter
+};
+
+// C+ mode descriptors (opts1)
+// Bits 12 -> 0 are the size of the buffer (given to the hardware), or the size of the received frame
+enum CP_DESC
+{
+    CP_DESC_OWN        = ( 1 << 31 ), // The hardware owns the descriptor
+    CP_DESC_EOR        = ( 1 << 30 ), // End Of Ring: the hardware goes back to the first descriptor after this one
+    CP_DESC_FS         = ( 1 << 29 ), // First Segment of a frame
+    CP_DESC_LS         = ( 1 << 28 ), // Last Segment of a frame
+    CP_DESC_SIZE       = 0x1fff,
+
+    // TX descriptors offloads, given to the hardware with the frame (same in every descriptor of the frame)
+    CP_TX_LARGE_SEND   = ( 1 << 27 ), // TCP segmentation: the hardware cuts the frame in MSS sized segments
+    CP_TX_MSS_SHIFT    = 16,          // MSS of the segments (with CP_TX_LARGE_SEND only)
+        CP_TX_MSS_MAX  = 0x7ff,
+    CP_TX_IPCS         = ( 1 << 18 ), // Compute the IP checksum (without CP_TX_LARGE_SEND only)
+    CP_TX_UDPCS        = ( 1 << 17 ), // Compute the UDP checksum (without CP_TX_LARGE_SEND only)
+    CP_TX_TCPCS        = ( 1 << 16 ), // Compute the TCP checksum (without CP_TX_LARGE_SEND only)
+
+    // TX descriptors status, when the hardware gives them back
+    CP_TX_FIFO_UNDER   = ( 1 << 25 ), // TX FIFO underrun
+    CP_TX_ERROR        = ( 1 << 23 ), // Error summary
+    CP_TX_OWC          = ( 1 << 22 ), // Out of Window Collision
+    CP_TX_LINK_FAIL    = ( 1 << 21 ), // Link failed while sending (carrier lost)
+    CP_TX_EXCESS_COLL  = ( 1 << 20 ), // Aborted after 16 collisions
+    CP_TX_COLL_SHIFT   = 16,          // Number of collisions
+        CP_TX_COLL     = ( 0xf << CP_TX_COLL_SHIFT ),
+
+    // RX descriptors status, when the hardware gives them back
+    CP_RX_MAR          = ( 1 << 26 ), // Multicast frame
+    CP_RX_FAE          = ( 1 << 27 ), // Frame Alignment Error
+    CP_RX_FIFO_OVW     = ( 1 << 22 ), // RX FIFO overflow, the frame is incomplete
+    CP_RX_LONG         = ( 1 << 21 ), // Frame longer than 4096 bytes
+    CP_RX_ERROR        = ( 1 << 20 ), // Error summary
+    CP_RX_RUNT         = ( 1 << 19 ), // Frame shorter than 64 bytes
+    CP_RX_CRC          = ( 1 << 18 ), // CRC error
+    CP_RX_PROTO_SHIFT  = 16,          // Protocol of the frame, when CPCR_RX_CHKSUM is on
+        CP_RX_PROTO    = ( 3 << CP_RX_PROTO_SHIFT ),
+        CP_RX_PROTO_TCP = ( 1 << CP_RX_PROTO_SHIFT ), // TCP over IPv4
+        CP_RX_PROTO_UDP = ( 2 << CP_RX_PROTO_SHIFT ), // UDP over IPv4
+        CP_RX_PROTO_IP = ( 3 << CP_RX_PROTO_SHIFT ),  // Other IPv4
+    CP_RX_IP_FAIL      = ( 1 << 15 ), // Bad IPv4 header checksum
+    CP_RX_UDP_FAIL     = ( 1 << 14 ), // Bad UDP checksum
+    CP_RX_TCP_FAIL     = ( 1 << 13 ), // Bad TCP checksum
+};
+
+// C+ mode descriptors (opts2): 802.1Q tags
+// The TCI is stored big endian (network order) in the 16 low bits
+enum CP_DESC_OPTS2
+{
+    CP_TX_VLAN_TAG     = ( 1 << 17 ), // Insert this tag in the frame (CPCR has nothing to turn on)
+    CP_RX_VLAN_TAGGED  = ( 1 << 16 ), // The hardware stripped this tag from the frame (CPCR_RX_VLAN)
+    CP_VLAN_TCI        = 0xffff,
+};
+
 // Configuration Register 1
 enum CONFIG1
 {
@@ -327,11 +413,17 @@ enum CONFIG1
         CFG1_LEDS_MASK              = CFG1_LEDS_TX_LNK100_LNK10,
 };
 
+// Configuration Register 4
+enum CONFIG4
+{
+    CFG4_RX_FIFO_AUTO_CLR = ( 1 << 7 ), // Clear the RX FIFO by itself on RX FIFO overflow
+};
+
 // Media Status Register
 enum MSR
 {
     MSR_TXFCE      = ( 1 << 7 ), // TX Flow Control Enable
-    MSR_RXFCE      = ( 1 << 6 ), // TX Flow Control Enable
+    MSR_RXFCE      = ( 1 << 6 ), // RX Flow Control Enable
     // Reserved             5
     MSR_AUX_STATUS = ( 1 << 4 ), // Auxiliary Power Present Status
     MSR_SPD_10     = ( 1 << 3 ), // 0: 100Mps, 1: 10Mps
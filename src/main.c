@@ -1,5 +1,6 @@
 #include "common.h"
 #include "pci.h"
+#include "debugfs.h"
 
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -13,9 +14,19 @@ MODULE_DESCRIPTION ( "A learning-purpose naive Realtek 8139D driver implementati
 // This will happen no matter if there is a device on the PCI bus or not.
 static int __init r8139dn_mod_init ( void )
 {
+    int err;
+
     pr_info ( "Hello!\n" );
+    r8139dn_debugfs_mod_init ( );
+
     // Our module informs the kernel that there is a new PCI driver
-    return pci_register_driver ( & r8139dn_pci_driver );
+    err = pci_register_driver ( & r8139dn_pci_driver );
+    if ( err )
+    {
+        r8139dn_debugfs_mod_exit ( );
+    }
+
+    return err;
 }
 
 // r8139dn_mod_exit will be called whenever our module is unloaded from kernel memory.
@@ -23,6 +34,7 @@ static void __exit r8139dn_mod_exit ( void )
 {
     // Remove the PCI driver from the kernel list so that we won't be a driver candidate anymore.
     pci_unregister_driver ( & r8139dn_pci_driver );
+    r8139dn_debugfs_mod_exit ( );
     pr_info ( "Bye!\n" );
 }
 
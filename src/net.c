@@ -1,26 +1,60 @@
 #include "common.h"
 #include "net.h"
 #include "hw.h"
+#include "ethtool.h"
+#include "trace.h"
 
 #include <linux/module.h>       // MODULE_PARM_DESC
 #include <linux/moduleparam.h>  // module_param
 #include <linux/interrupt.h>    // IRQF_SHARED, irqreturn_t, request_irq, free_irq
+#include <linux/crc32.h>        // ether_crc
+#include <linux/filter.h>       // bpf_prog_run_xdp
+#include <linux/rtnetlink.h>    // rtnl_lock
+#include <linux/mii.h>          // BMCR_*, ADVERTISE_*, LPA_*, mii_nway_result, mii_check_media
+#include <linux/bpf_trace.h>    // trace_xdp_exception
 
 static irqreturn_t r8139dn_net_interrupt ( int irq, void * dev );
 static void _r8139dn_net_interrupt_tx ( struct net_device * ndev );
-static void _r8139dn_net_interrupt_rx ( struct net_device * ndev );
-static void _r8139dn_net_check_link ( struct net_device * ndev );
+static u16 _r8139dn_net_interrupt_early_rx ( struct net_device * ndev );
+static void _r8139dn_net_tx_stats ( struct r8139dn_priv * priv, u32 tsd );
+static int r8139dn_net_poll ( struct napi_struct * napi, int budget );
+static int _r8139dn_net_poll_rx ( struct net_device * ndev, int budget );
+static void _r8139dn_net_rx_error_stats ( struct r8139dn_priv * priv, u16 status );
+static bool _r8139dn_net_rx_header_ok ( u16 size, u16 status );
+static void _r8139dn_net_rx_resync ( struct r8139dn_priv * priv );
+static bool _r8139dn_net_rx_flow_control ( struct net_device * ndev );
+static bool _r8139dn_net_rx_pause ( struct net_device * ndev, u16 quanta );
+static void _r8139dn_net_coalesce ( struct r8139dn_priv * priv, u16 irq, u32 usecs );
+static u16 _r8139dn_net_coalesce_expired ( struct r8139dn_priv * priv );
+static void _r8139dn_net_dim_work ( struct work_struct * work );
+static void _r8139dn_net_check_link ( struct net_device * ndev, bool init );
+static void _r8139dn_net_link_work ( struct work_struct * work );
 
-static int r8139dn_net_open ( struct net_device * ndev );
 static netdev_tx_t r8139dn_net_start_xmit ( struct sk_buff * skb, struct net_device * ndev );
-static int r8139dn_net_close ( struct net_device * ndev );
+static void r8139dn_net_tx_timeout ( struct net_device * ndev, unsigned int txqueue );
+static void _r8139dn_net_tx_timeout_work ( struct work_struct * work );
 
 static int r8139dn_net_set_mac_addr ( struct net_device * ndev, void * addr );
+static void r8139dn_net_set_rx_mode ( struct net_device * ndev );
 static int r8139dn_net_set_mtu ( struct net_device * ndev, int mtu );
+static int r8139dn_net_set_features ( struct net_device * ndev, netdev_features_t features );
+static netdev_features_t r8139dn_net_features_check ( struct sk_buff * skb, struct net_device * ndev,
+                                                      netdev_features_t features );
 
 static int _r8139dn_net_init_tx_ring ( struct r8139dn_priv * priv );
 static int _r8139dn_net_init_rx_ring ( struct r8139dn_priv * priv );
 static void _r8139dn_net_release_rings ( struct r8139dn_priv * priv );
+static bool _r8139dn_net_tx_map ( struct r8139dn_priv * priv, struct sk_buff * skb, int slot );
+static struct sk_buff * _r8139dn_net_tx_unmap ( struct r8139dn_priv * priv, int slot );
+static void _r8139dn_net_tx_kick ( struct r8139dn_priv * priv );
+static void _r8139dn_net_tx_maybe_stop ( struct net_device * ndev );
+static bool _r8139dn_net_tx_stage ( struct net_device * ndev, const void * data, u32 len );
+static bool _r8139dn_net_tx_stage_first ( struct net_device * ndev, const void * data, u32 len );
+static bool _r8139dn_net_rx_frame ( struct net_device * ndev, struct bpf_prog * prog, void * data, int len );
+static bool _r8139dn_net_xdp_tx ( struct net_device * ndev, void * data, u32 len );
+static struct sk_buff * _r8139dn_net_rx_build_skb ( struct r8139dn_priv * priv, const void * data, int len );
+static int r8139dn_net_bpf ( struct net_device * ndev, struct netdev_bpf * bpf );
+static int r8139dn_net_xdp_xmit ( struct net_device * ndev, int n, struct xdp_frame ** frames, u32 flags );
 
 static int debug = -1;
 module_param ( debug, int, 0 );
@@ -29,7 +63,11 @@ MODULE_PARM_DESC ( debug, "Debug setting" );
 enum { TX = 1, RX = 2, LBK = 4 };
 static int txrx = ( TX | RX );
 module_param ( txrx, int, 0 );
-MODULE_PARM_DESC ( txrx, "TXRX Mode: TX (0x1) | RX (0x2) | Loopback (0x4)" );
+MODULE_PARM_DESC ( txrx, "TXRX Mode: TX (0x1) | RX (0x2) | Loopback (0x4, default of ethtool -K loopback)" );
+
+static int early_rx = 0;
+module_param ( early_rx, int, 0 );
+MODULE_PARM_DESC ( early_rx, "Early RX threshold, in 16th of the frame (1 -> 15). Default: 0 (disabled)" );
 
 
 // r8139dn_ops stores functors to our driver actions,
@@ -39,9 +77,16 @@ static struct net_device_ops r8139dn_ops =
     .ndo_open = r8139dn_net_open,
     .ndo_start_xmit = r8139dn_net_start_xmit,
     .ndo_stop = r8139dn_net_close,
+    .ndo_tx_timeout = r8139dn_net_tx_timeout,
 
     .ndo_set_mac_address = r8139dn_net_set_mac_addr,
+    .ndo_set_rx_mode     = r8139dn_net_set_rx_mode,
     .ndo_change_mtu      = r8139dn_net_set_mtu,
+    .ndo_set_features    = r8139dn_net_set_features,
+    .ndo_features_check  = r8139dn_net_features_check,
+    .ndo_get_stats64     = r8139dn_stats_get64,
+    .ndo_bpf             = r8139dn_net_bpf,
+    .ndo_xdp_xmit        = r8139dn_net_xdp_xmit,
 };
 
 int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio )
@@ -63,9 +108,90 @@ int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio )
     priv -> msg_enable = netif_msg_init ( debug, R8139DN_MSG_ENABLE );
     priv -> pdev = pdev;
     priv -> mmio = mmio;
+    spin_lock_init ( & priv -> lock );
+    spin_lock_init ( & priv -> tx_ring.lock );
 
     // Bind our driver functors struct to our net device
     ndev -> netdev_ops = & r8139dn_ops;
+    ndev -> ethtool_ops = & r8139dn_ethtool_ops;
+
+    // Our PHY is reached through our own registers, see r8139dn_hw_mdio_read
+    // MII PHY address 32 is what the chip answers to on a real MDIO bus: it doesn't matter to us
+    priv -> mii.dev = ndev;
+    priv -> mii.phy_id = 32;
+    priv -> mii.phy_id_mask = 0x3f;
+    priv -> mii.reg_num_mask = 0x1f;
+    priv -> mii.mdio_read = r8139dn_hw_mdio_read;
+    priv -> mii.mdio_write = r8139dn_hw_mdio_write;
+    INIT_WORK ( & priv -> link_work, _r8139dn_net_link_work );
+
+    // TX watchdog: the kernel calls ndo_tx_timeout if our TX queue stays stopped that long
+    ndev -> watchdog_timeo = R8139DN_TX_TIMEOUT;
+    INIT_WORK ( & priv -> tx_timeout.work, _r8139dn_net_tx_timeout_work );
+
+    // Interrupt coalescing is off until asked with ethtool -C
+    priv -> coal.rx_frames = 1;
+    priv -> coal.dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+    INIT_WORK ( & priv -> coal.dim.work, _r8139dn_net_dim_work );
+
+    // RTL8139C+: rather than the RTL8139 rings, use the descriptor rings of C+ mode (see cp.c)
+    priv -> cplus = ( ioread32 ( mmio + TCR ) & TCR_HWVERID_MASK ) == RTL8139CP;
+
+    // Every frame we send is copied to our TX buffers, and skb_copy_and_csum_dev can gather
+    // the fragments and compute the checksum (any protocol) in that very same pass for free
+    // Fragments are never DMAed, so they can live in high memory too
+    // TSO is left to the kernel (software GSO, on by default): the segments it builds are fragments
+    // of the original sk_buff, that our copy gathers for free
+    // In C+ mode: scatter-gather, IPv4 TCP / UDP checksums on TX and RX, large send (TSO),
+    // and 802.1Q tag insertion / stripping. VLAN devices on top of us get the same TX offloads
+    if ( priv -> cplus )
+    {
+        ndev -> hw_features = NETIF_F_SG | NETIF_F_IP_CSUM | NETIF_F_TSO | NETIF_F_RXCSUM |
+                              NETIF_F_HW_VLAN_CTAG_RX | NETIF_F_HW_VLAN_CTAG_TX;
+        ndev -> vlan_features = NETIF_F_SG | NETIF_F_IP_CSUM | NETIF_F_TSO | NETIF_F_HIGHDMA;
+    }
+    else
+    {
+        ndev -> hw_features = NETIF_F_SG | NETIF_F_HW_CSUM;
+    }
+    ndev -> features = ndev -> hw_features | NETIF_F_HIGHDMA;
+
+    // Internal loopback can be turned on and off at any time (ethtool -K eth0 loopback on)
+    // It starts as the txrx module parameter says
+    ndev -> hw_features |= NETIF_F_LOOPBACK;
+    if ( txrx & LBK )
+    {
+        ndev -> features |= NETIF_F_LOOPBACK;
+    }
+
+    priv -> rx_ring.len = R8139DN_RX_BUFLEN_DEFAULT;
+    priv -> tx_ring.len = R8139DN_TX_RING_DEFAULT;
+    priv -> tx_ring.copybreak = R8139DN_TX_COPYBREAK_DEFAULT;
+    priv -> rx_ring.copybreak = R8139DN_RX_COPYBREAK_DEFAULT;
+
+    // Start from the settings that suit most PCI buses, and let the FIFO tuning adapt them to ours
+    // RX FIFO threshold is 16 bytes (RXFTH 0): already the earliest transfer possible
+    priv -> fifo.adaptive = true;
+    priv -> fifo.ertxth = R8139DN_ERTXTH_DEFAULT;
+    priv -> fifo.tcr = TCR_MXDMA_1024;
+    priv -> fifo.rcr = RCR_MXDMA_1024;
+
+    // Not 0: jiffies starts 5 minutes before wrapping (INITIAL_JIFFIES), 0 would be in the future until then
+    priv -> fifo.rx_next = jiffies;
+
+    // Flow control is negotiated with the link partner, in both directions
+    priv -> pause.autoneg = true;
+    priv -> pause.rx = true;
+    priv -> pause.tx = true;
+
+    err = r8139dn_stats_init ( priv );
+    if ( err )
+    {
+        goto err_init_stats;
+    }
+
+    // RX frames will be processed by our poll function, in softirq context
+    netif_napi_add ( ndev, & priv -> napi, priv -> cplus ? r8139dn_cp_poll : r8139dn_net_poll, NAPI_POLL_WEIGHT );
 
     // Add our net device as a leaf to our PCI device in /sys tree
     SET_NETDEV_DEV ( ndev, & ( pdev -> dev ) );
@@ -78,6 +204,7 @@ int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio )
     }
 
     // Retrieve MAC address from device's EEPROM and tell the kernel
+    r8139dn_hw_eeprom_load ( priv );
     r8139dn_hw_eeprom_mac_to_kernel ( ndev );
 
     // Make RX activity also noticeable together with TX on LED0, we have no LED2 :'(
@@ -94,6 +221,12 @@ int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio )
     // So we store it. Later we can retrieve it with pci_get_drvdata
     pci_set_drvdata ( pdev, ndev );
 
+    // Our histograms are only a debugging aid: we can live without them
+    if ( r8139dn_debugfs_init ( priv ) )
+    {
+        netdev_warn ( ndev, "Unable to set up the debugfs histograms\n" );
+    }
+
     if ( ! ( txrx & ( TX | RX ) ) )
     {
         netdev_warn ( ndev, "Neither TX nor RX is activated. Is this really what you want?\n" );
@@ -106,6 +239,7 @@ int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio )
 
     return 0;
 
+err_init_stats:
 err_init_hw_reset:
 err_init_register_netdev:
     free_netdev ( ndev );
@@ -114,7 +248,7 @@ err_init_register_netdev:
 
 // The kernel calls this when interface is set up
 // ip link set up dev eth0
-static int r8139dn_net_open ( struct net_device * ndev )
+int r8139dn_net_open ( struct net_device * ndev )
 {
     struct r8139dn_priv * priv = netdev_priv ( ndev );
     int irq = priv -> pdev -> irq;
@@ -126,14 +260,41 @@ static int r8139dn_net_open ( struct net_device * ndev )
     }
 
     // Reserve an shared IRQ line and hook our handler on it
-    err = request_irq ( irq, r8139dn_net_interrupt, IRQF_SHARED, ndev -> name, ndev );
+    err = request_irq ( irq, priv -> cplus ? r8139dn_cp_interrupt : r8139dn_net_interrupt,
+                        IRQF_SHARED, ndev -> name, ndev );
     if ( err )
     {
         return err;
     }
     ndev -> irq = irq;
     priv -> interrupts = INT_LNKCHG_PUN | INT_TIMEOUT;
-    priv -> tcr = TCR_IFG_DEFAULT | TCR_MXDMA_1024;
+    priv -> coal.waiting = 0;
+    priv -> coal.rx_batch = 0;
+    priv -> rx_ring.overflow = false;
+    priv -> pause.tx_active = false;
+    priv -> pause.xoff = false;
+    priv -> pause.retry = false;
+    priv -> tx_timeout.restarted_at = -1;
+    priv -> tcr = TCR_IFG_DEFAULT | priv -> fifo.tcr;
+
+    // Internal loopback: what we send comes back to our own RX ring (or rings, in C+ mode), never reaching the wire
+    if ( ndev -> features & NETIF_F_LOOPBACK )
+    {
+        netdev_info ( ndev, "Enabling Loopback mode\n" );
+        priv -> tcr |= TCR_LBK_ENABLE;
+    }
+
+    // We want to receive broadcast frames as well as frames for our own MAC
+    // RBLEN is 0 for a 8K ring, 1 for 16K, 2 for 32K and 3 for 64K
+    priv -> rcr = priv -> fifo.rcr | RCR_APM | RCR_AB |
+        ( ilog2 ( priv -> rx_ring.len / R8139DN_RX_BUFLEN_MIN ) << RCR_RBLEN_SHIFT );
+
+    // Ask the hardware not to wrap frames reaching the end of the RX ring: we always get them in one piece
+    // Unfortunately, this is not supported with a 64K ring
+    if ( priv -> rx_ring.len < R8139DN_RX_BUFLEN_MAX )
+    {
+        priv -> rcr |= RCR_WRAP;
+    }
 
     // Issue a software reset
     err = r8139dn_hw_reset ( priv );
@@ -142,27 +303,43 @@ static int r8139dn_net_open ( struct net_device * ndev )
         goto err_open_hw_reset;
     }
 
+    // The TX ring is now empty: forget about the bytes BQL thinks are in flight
+    netdev_reset_queue ( ndev );
+
     // Restore what the kernel thinks our MAC is to our IDR registers
     r8139dn_hw_kernel_mac_to_regs ( ndev );
 
+    // Tell the link partner whether we can do flow control (only restarts auto-negotiation if this changed)
+    r8139dn_hw_advertise_pause ( priv, priv -> pause.autoneg && priv -> pause.rx );
+
     // Assume link is down unless proven otherwise
     // Then, make an initial link check to find out
     netif_carrier_off ( ndev );
-    _r8139dn_net_check_link ( ndev );
+    _r8139dn_net_check_link ( ndev, true );
 
-    if ( txrx & TX )
+    if ( priv -> cplus )
     {
-        // Allocate TX DMA and initialize TX ring
-        err = _r8139dn_net_init_tx_ring ( priv );
+        // Allocate the descriptor rings and start the C+ mode engine
+        err = r8139dn_cp_open ( ndev );
         if ( err )
         {
             goto err_open_init_ring;
         }
 
-        if ( txrx & LBK )
+        netif_addr_lock_bh ( ndev );
+        r8139dn_net_set_rx_mode ( ndev );
+        netif_addr_unlock_bh ( ndev );
+
+        goto open_done;
+    }
+
+    if ( txrx & TX )
+    {
+        // Allocate TX DMA and initialize TX ring
+        err = _r8139dn_net_init_tx_ring ( priv );
+        if ( err )
         {
-            netdev_info ( ndev, "Enabling Loopback mode\n" );
-            priv -> tcr |= TCR_LBK_ENABLE;
+            goto err_open_init_ring;
         }
 
         // Enable TX, load default TX settings
@@ -190,20 +367,53 @@ static int r8139dn_net_open ( struct net_device * ndev )
             goto err_open_init_ring;
         }
 
+        // Tell XDP about our RX queue: XDP programs see it in their context
+        err = xdp_rxq_info_reg ( & priv -> xdp_rxq, ndev, 0, priv -> napi.napi_id );
+        if ( err )
+        {
+            goto err_open_init_ring;
+        }
+
+        // Early RX mode: we get an interrupt when early_rx / 16 of the frame has been DMAed to the RX ring
+        // We can then start looking at the frame while the hardware is still moving its tail
+        if ( early_rx > 0 && early_rx < 16 )
+        {
+            netdev_info ( ndev, "Enabling Early RX mode (%d/16)\n", early_rx );
+            priv -> rcr |= early_rx << RCR_ERTH_SHIFT;
+        }
+
         // Enable RX, load default RX settings and inform hardware where to DMA
         r8139dn_hw_setup_rx ( priv );
 
+        // The kernel sets our RX filters up after bringing us up, but not when we reopen ourselves (ethtool -G)
+        netif_addr_lock_bh ( ndev );
+        r8139dn_net_set_rx_mode ( ndev );
+        netif_addr_unlock_bh ( ndev );
+
         priv -> interrupts |= INT_RX;
     }
 
+open_done:
+    // Start harvesting the hardware counters (MPC...)
+    r8139dn_stats_start ( priv );
+
+    // From now on, our poll function can be scheduled
+    napi_enable ( & priv -> napi );
+
     // Enable interrupts so that hardware can notify us about important events
     r8139dn_hw_enable_irq ( priv );
 
+    priv -> up = true;
+
     return 0;
 
 err_open_hw_reset:
 err_open_init_ring:
     _r8139dn_net_release_rings ( priv );
+    if ( xdp_rxq_info_is_reg ( & priv -> xdp_rxq ) )
+    {
+        xdp_rxq_info_unreg ( & priv -> xdp_rxq );
+    }
     free_irq ( irq, ndev );
 
     return err;
@@ -216,10 +426,17 @@ static netdev_tx_t r8139dn_net_start_xmit ( struct sk_buff * skb, struct net_dev
 {
     struct r8139dn_priv * priv = netdev_priv ( ndev );
     struct r8139dn_tx_ring * ring = & priv -> tx_ring;
-    u32 flags;
+    struct r8139dn_tx_slot * slot;
+    void * buf;
     u16 len;
     int cpu, hw;
 
+    // RTL8139C+: the descriptor rings have their own start_xmit
+    if ( priv -> cplus )
+    {
+        return r8139dn_cp_start_xmit ( skb, ndev );
+    }
+
     // We can safely read our cpu position without any protection
     // Nobody except us (start_xmit) will ever update this variable
     cpu = ring -> cpu;
@@ -242,61 +459,235 @@ static netdev_tx_t r8139dn_net_start_xmit ( struct sk_buff * skb, struct net_dev
             netdev_err ( ndev, "TX dropped! (%d bytes is too big for me)\n", len + ETH_FCS_LEN );
         }
         dev_kfree_skb ( skb );
-        ndev -> stats.tx_errors++;
-        ndev -> stats.tx_dropped++;
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_ERRORS, 1 );
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_DROPPED, 1 );
         return NETDEV_TX_OK;
     }
 
-    // We need to implement padding if the frame is too short
-    // Our hardware doesn't handle this
-    if ( len < ETH_ZLEN )
+    slot = & ring -> slots [ cpu ];
+    buf = ring -> data + cpu * R8139DN_TX_DESC_SIZE;
+
+    // Big frames: copying them costs more than mapping them
+    // Let the hardware read them right from the sk_buff, which will be released once TX is done
+    if ( len >= ring -> copybreak && _r8139dn_net_tx_map ( priv, skb, cpu ) )
     {
-        memset ( ring -> data [ cpu ] + len, 0, ETH_ZLEN - len );
-        len = ETH_ZLEN;
+        netdev_dbg ( ndev, "  Zero-copy TX\n" );
     }
+    else
+    {
+        // We need to implement padding if the frame is too short
+        // Our hardware doesn't handle this
+        if ( len < ETH_ZLEN )
+        {
+            memset ( buf + len, 0, ETH_ZLEN - len );
+            len = ETH_ZLEN;
+        }
 
-    // Copy the packet to the shared memory with the hardware
-    // This also adds the CRC FCS (computed by the software)
-    skb_copy_and_csum_dev ( skb, ring -> data [ cpu ] );
+        // Copy the packet to the shared memory with the hardware
+        // This also adds the CRC FCS (computed by the software)
+        skb_copy_and_csum_dev ( skb, buf );
 
-    // Get rid of the now useless sk_buff :'(
-    // Yes, it's the deep down bottom of the TCP/IP stack here :-)
-    dev_kfree_skb ( skb );
+        // Get rid of the now useless sk_buff :'(
+        // Yes, it's the deep down bottom of the TCP/IP stack here :-)
+        // (It's not a drop: "consume" it, it goes back to the per-CPU sk_buff cache)
+        dev_consume_skb_any ( skb );
+    }
 
-    // The last missing info in the flags is the length of this frame
-    flags = priv -> tx_flags | len;
+    slot -> len = len;
+    slot -> queued = READ_ONCE ( priv -> hist_enable ) ? ktime_get_ns ( ) : 0;
+    trace_r8139dn_tx_queue ( ndev, cpu, len, slot -> skb );
 
-    // Transmit frame to the world, to __THE INTERNET__!
-    r8139dn_w32 ( TSD0 + cpu * TSD_GAP, flags );
+    // Byte Queue Limits: account for the bytes we give to the hardware
+    // This must happen before the hardware gets the frame, as it could complete it right away
+    netdev_sent_queue ( ndev, len );
 
-    // Move our own position (and modulo it)
+    // Move our own position (and modulo it): the frame is now staged
     // TX IRQ handler is going to read the cpu pos, be careful when updating it
     // Make sure TX IRQ handler will see the new value upon next load_acquire
-    BUILD_BUG_ON_NOT_POWER_OF_2 ( R8139DN_TX_DESC_NB );
-    smp_store_release ( & ring -> cpu, ( cpu + 1 ) & ( R8139DN_TX_DESC_NB - 1 ) );
+    smp_store_release ( & ring -> cpu, ( cpu + 1 ) & ( ring -> len - 1 ) );
+
+    // Transmit frame to the world, to __THE INTERNET__!
+    // (If all the hardware descriptors are busy, the TX IRQ handler will do it as soon as one completes)
+    _r8139dn_net_tx_kick ( priv );
+
+    _r8139dn_net_tx_maybe_stop ( ndev );
+
+    return NETDEV_TX_OK;
+}
+
+// If our network card is overwhelmed with packets to transmit
+// We need to tell the kernel to stop giving us packets
+// That way, we don't overwrite packets that haven't been processed yet
+// Called with the TX queue lock held, after staging a frame
+static void _r8139dn_net_tx_maybe_stop ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
 
-    // If our network card is overwhelmed with packets to transmit
-    // We need to tell the kernel to stop giving us packets
-    // That way, we don't overwrite packets that haven't been processed yet
-    // TX buffer is full when abs(hw - cpu) is 1. Because when 0, it means empty
-    if ( ( ( hw - ring -> cpu ) & ( R8139DN_TX_DESC_NB - 1 ) ) == 1 )
+    // TX ring is full when abs(hw - cpu) is 1. Because when 0, it means empty
+    if ( ( ( smp_load_acquire ( & ring -> hw ) - ring -> cpu ) & ( ring -> len - 1 ) ) == 1 )
     {
         netdev_dbg ( ndev, "  TX ring buffer full, stopping queue\n" );
         netif_stop_queue ( ndev );
+
+        // The TX IRQ handler may have freed some slots since we've read the hw position
+        // If it has done so before seeing the queue stopped, it didn't wake it up: do it ourselves
+        // Pairs with the barrier in the TX IRQ handler
+        smp_mb ( );
+        if ( ( ( smp_load_acquire ( & ring -> hw ) - ring -> cpu ) & ( ring -> len - 1 ) ) != 1 )
+        {
+            netif_wake_queue ( ndev );
+        }
     }
+}
 
-    return NETDEV_TX_OK;
+// Stage a copy of a frame (without FCS) in the next TX slot, for XDP_TX and ndo_xdp_xmit
+// It will be sent by the next _r8139dn_net_tx_kick
+// Called with the TX queue lock held, as start_xmit would be
+// Returns false if the TX ring is full
+static bool _r8139dn_net_tx_stage ( struct net_device * ndev, const void * data, u32 len )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    struct r8139dn_tx_slot * slot;
+    void * buf;
+    int cpu = ring -> cpu;
+
+    if ( ( ( smp_load_acquire ( & ring -> hw ) - cpu ) & ( ring -> len - 1 ) ) == 1 ||
+         len + ETH_FCS_LEN > R8139DN_MAX_ETH_SIZE )
+    {
+        return false;
+    }
+
+    slot = & ring -> slots [ cpu ];
+    buf = ring -> data + cpu * R8139DN_TX_DESC_SIZE;
+
+    memcpy ( buf, data, len );
+    if ( len < ETH_ZLEN )
+    {
+        memset ( buf + len, 0, ETH_ZLEN - len );
+        len = ETH_ZLEN;
+    }
+
+    slot -> len = len;
+    slot -> queued = READ_ONCE ( priv -> hist_enable ) ? ktime_get_ns ( ) : 0;
+    trace_r8139dn_tx_queue ( ndev, cpu, len, false );
+
+    // Same as start_xmit: the TX IRQ handler will report these bytes as completed to BQL
+    netdev_sent_queue ( ndev, len );
+    smp_store_release ( & ring -> cpu, ( cpu + 1 ) & ( ring -> len - 1 ) );
+
+    _r8139dn_net_tx_maybe_stop ( ndev );
+
+    return true;
+}
+
+// Stage a frame ahead of the staged frames the hardware hasn't been given yet: it is the next one on the wire
+// For PAUSE frames, which would come too late behind a full TX ring of data frames
+// These staged frames move one slot further, slot i is still sent by descriptor i % 4
+// Called under the TX lock, like _r8139dn_net_tx_stage. Frames are short: no zero-copy
+static bool _r8139dn_net_tx_stage_first ( struct net_device * ndev, const void * data, u32 len )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    struct r8139dn_tx_slot * slot;
+    u32 mask = ring -> len - 1;
+    unsigned long flags;
+    int cpu = ring -> cpu;
+    int i, prev;
+    void * buf;
+
+    if ( ( ( smp_load_acquire ( & ring -> hw ) - cpu ) & mask ) == 1 || len > ETH_ZLEN )
+    {
+        return false;
+    }
+
+    // Keep _r8139dn_net_tx_kick from handing the slots we move to the hardware meanwhile
+    spin_lock_irqsave ( & ring -> lock, flags );
+
+    for ( i = cpu ; i != ring -> sent ; i = prev )
+    {
+        prev = ( i - 1 ) & mask;
+        ring -> slots [ i ] = ring -> slots [ prev ];
+
+        // Zero-copy slots only move their sk_buff
+        if ( ! ring -> slots [ i ].skb )
+        {
+            memcpy ( ring -> data + i * R8139DN_TX_DESC_SIZE, ring -> data + prev * R8139DN_TX_DESC_SIZE,
+                    ring -> slots [ i ].len );
+        }
+    }
+
+    slot = & ring -> slots [ ring -> sent ];
+    buf = ring -> data + ring -> sent * R8139DN_TX_DESC_SIZE;
+    memcpy ( buf, data, len );
+    memset ( buf + len, 0, ETH_ZLEN - len );
+
+    slot -> skb = NULL;
+    slot -> len = ETH_ZLEN;
+    slot -> queued = READ_ONCE ( priv -> hist_enable ) ? ktime_get_ns ( ) : 0;
+    trace_r8139dn_tx_queue ( ndev, ring -> sent, ETH_ZLEN, false );
+
+    netdev_sent_queue ( ndev, ETH_ZLEN );
+    smp_store_release ( & ring -> cpu, ( cpu + 1 ) & mask );
+
+    spin_unlock_irqrestore ( & ring -> lock, flags );
+
+    _r8139dn_net_tx_maybe_stop ( ndev );
+
+    return true;
+}
+
+// Hand the next staged slots to the hardware, as long as some of its TX descriptors are free
+// Called both from start_xmit (new frame) and from the TX IRQ handler (some descriptors completed)
+static void _r8139dn_net_tx_kick ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    struct r8139dn_tx_slot * slot;
+    unsigned long flags;
+    int cpu, hw, desc;
+    dma_addr_t dma;
+
+    spin_lock_irqsave ( & ring -> lock, flags );
+
+    cpu = smp_load_acquire ( & ring -> cpu );
+    hw = smp_load_acquire ( & ring -> hw );
+
+    // While there are staged slots, and fewer slots than descriptors in the hands of the hardware
+    while ( ring -> sent != cpu && ( ( ring -> sent - hw ) & ( ring -> len - 1 ) ) < R8139DN_TX_DESC_NB )
+    {
+        slot = & ring -> slots [ ring -> sent ];
+        desc = ring -> sent & ( R8139DN_TX_DESC_NB - 1 );
+
+        // Point the descriptor to the frame: either the sk_buff itself (zero-copy) or our slot buffer
+        dma = slot -> skb ? slot -> skb_dma : ring -> dma + ring -> sent * R8139DN_TX_DESC_SIZE;
+        r8139dn_w32 ( TSAD0 + desc * TSAD_GAP, dma );
+
+        // The last missing info in the flags is the length of this frame
+        // Writing TSD starts the transmission
+        r8139dn_w32 ( TSD0 + desc * TSD_GAP, READ_ONCE ( priv -> tx_flags ) | slot -> len );
+        trace_r8139dn_tx_kick ( pci_get_drvdata ( priv -> pdev ), ring -> sent, desc );
+
+        // The TX IRQ handler reads the staged position locklessly, to know which slots it can check
+        smp_store_release ( & ring -> sent, ( ring -> sent + 1 ) & ( ring -> len - 1 ) );
+    }
+
+    spin_unlock_irqrestore ( & ring -> lock, flags );
 }
 
 static irqreturn_t r8139dn_net_interrupt ( int irq, void * dev )
 {
     struct net_device * ndev = ( struct net_device * ) dev;
     struct r8139dn_priv * priv = netdev_priv ( ndev );
+    u64 start = READ_ONCE ( priv -> hist_enable ) ? ktime_get_ns ( ) : 0;
     u16 isr = r8139dn_r16 ( ISR );
 
+    // RX interrupts masked by NAPI or by the coalescing timer: our poll function acknowledges them (see r8139dn_net_poll)
+    u16 rx_masked = READ_ONCE ( priv -> masked ) & ( INT_ROK | INT_RER );
+
     // Shared IRQ... Return immediately if we have actually nothing to do
     // Tell the kernel our device was not the trigger for this interrupt
-    if ( ! isr )
+    if ( ! ( isr & ~ rx_masked ) )
     {
         netdev_dbg ( ndev, "IRQ_NONE\n" );
 
@@ -314,6 +705,7 @@ static irqreturn_t r8139dn_net_interrupt ( int irq, void * dev )
     }
 
     netdev_dbg ( ndev, "IRQ (ISR: %04x)\n", isr );
+    trace_r8139dn_irq ( ndev, isr, priv -> masked );
 
 #ifdef ASM1083_LOST_INTx_DEASSERT_FIX
     // If we are fixing the spurious interrupt
@@ -323,25 +715,63 @@ static irqreturn_t r8139dn_net_interrupt ( int irq, void * dev )
     }
 #endif
 
-    // Acknowledge IRQ as fast as possible
-    r8139dn_w16 ( ISR, isr );
+    // Acknowledge IRQ as fast as possible, but leave the masked RX interrupts pending
+    // Should a frame come in after our poll function last looked at the RX ring, acknowledging its INT_ROK here
+    // would lose it: unmasking wouldn't raise anything, and the frame would wait for the next one
+    r8139dn_w16 ( ISR, isr & ~ rx_masked );
 
     // Only care about interrupts we are interested in
-    isr &= priv -> interrupts;
+    isr &= priv -> interrupts & ~ rx_masked;
+
+    // In early RX mode, INT_ROK / INT_RER may only mean a frame is still on its way to our RX ring
+    if ( isr & ( INT_ROK | INT_RER ) && priv -> rcr & RCR_ERTH )
+    {
+        isr &= ~ _r8139dn_net_interrupt_early_rx ( ndev );
+    }
+
+    // The coalescing timer expired: time to do the homework it was delaying
+    // Pretend the interrupts that were waiting for it just fired
+    if ( isr & INT_TIMEOUT )
+    {
+        isr |= _r8139dn_net_coalesce_expired ( priv );
+    }
 
     // The link status changed.
     if ( isr & INT_LNKCHG_PUN )
     {
         netdev_dbg ( ndev, "  Link Changed\n" );
 
-        // Let's check and inform the kernel about the change
-        _r8139dn_net_check_link ( ndev );
+        // Reading the PHY registers and telling the kernel can wait: leave it to our link work
+        schedule_work ( & priv -> link_work );
+    }
+
+    // The RX ring is full: the hardware drops the frames that don't fit
+    // Our poll function will give the whole ring back to the hardware (it is scheduled right below)
+    if ( isr & INT_RXOVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_OVER_ERRORS, 1 );
+        WRITE_ONCE ( priv -> rx_ring.overflow, true );
+    }
+
+    // The RX FIFO overflowed: the hardware doesn't move the frames to our RX ring fast enough
+    // It has already cleared the FIFO by itself (CFG4_RX_FIFO_AUTO_CLR), there's nothing to recover
+    if ( isr & INT_FOVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_FIFO_ERRORS, 1 );
+
+        if ( priv -> fifo.adaptive )
+        {
+            r8139dn_hw_tune_rx ( priv );
+        }
     }
 
     // We have some RX homework to do!
-    if ( isr & INT_RX )
+    // Don't do it here: mask RX interrupts and let NAPI poll the RX ring in softirq context
+    // Our poll function will unmask them once the RX ring is empty
+    if ( isr & INT_RX && napi_schedule_prep ( & priv -> napi ) )
     {
-        _r8139dn_net_interrupt_rx ( ndev );
+        r8139dn_hw_mask_irq ( priv, INT_RX );
+        __napi_schedule ( & priv -> napi );
     }
 
     // We have some TX homework to do :)
@@ -350,6 +780,11 @@ static irqreturn_t r8139dn_net_interrupt ( int irq, void * dev )
         _r8139dn_net_interrupt_tx ( ndev );
     }
 
+    if ( start )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_ISR_NS, ktime_get_ns ( ) - start );
+    }
+
     return IRQ_HANDLED;
 }
 
@@ -359,8 +794,10 @@ static void _r8139dn_net_interrupt_tx ( struct net_device * ndev )
 {
     struct r8139dn_priv * priv = netdev_priv ( ndev );
     struct r8139dn_tx_ring * tx_ring = & priv -> tx_ring;
-    int cpu, * hw, hw_old;
-    u32 tsd;
+    struct r8139dn_tx_slot * slot;
+    int sent, * hw, hw_old, desc;
+    unsigned int pkts = 0, bytes = 0;
+    u32 tsd, usecs;
 
     netdev_dbg ( ndev, "  TX homework!\n" );
 
@@ -369,18 +806,20 @@ static void _r8139dn_net_interrupt_tx ( struct net_device * ndev )
     hw = & tx_ring -> hw;
     hw_old = * hw;
 
-    // Care must be taken when retrieving cpu pos as start_xmit may update it on another CPU
-    // Make sure our CPU sees the updated value made by the last store_release in start_xmit
-    cpu = smp_load_acquire ( & tx_ring -> cpu );
+    // Care must be taken when retrieving the staged pos as it may be updated on another CPU
+    // Make sure our CPU sees the updated value made by the last store_release in _r8139dn_net_tx_kick
+    // Only the slots before this position have been handed to the hardware
+    sent = smp_load_acquire ( & tx_ring -> sent );
 
     // Empty as many buffers as possible in only one interrupt
-    // While the TX ring buffer is not empty
-    while ( * hw != cpu )
+    // While the hardware still has some of our slots
+    while ( * hw != sent )
     {
         // Fetch the transmit status of current TX buffer
         // (Network card fills this for us to report TX result for each buffer)
-        tsd = r8139dn_r32 ( TSD0 + * hw * TSD_GAP );
-        netdev_dbg ( ndev, "    TSD%d: %08x\n", * hw, tsd & ~ ( TSD_ERTXTH | TSD_SIZE ) );
+        desc = * hw & ( R8139DN_TX_DESC_NB - 1 );
+        tsd = r8139dn_r32 ( TSD0 + desc * TSD_GAP );
+        netdev_dbg ( ndev, "    TSD%d: %08x\n", desc, tsd & ~ ( TSD_ERTXTH | TSD_SIZE ) );
 
         // Hardware hasn't given any feedback on the transmission of this buffer
         // This means it hasn't been TX yet. It's still in the FIFO, moving to line
@@ -389,15 +828,9 @@ static void _r8139dn_net_interrupt_tx ( struct net_device * ndev )
             break;
         }
 
-        if ( tsd & TSD_TOK )
-        {
-            // Packet has been moved to line successfuly!
-            ndev -> stats.tx_packets++;
-            ndev -> stats.tx_bytes += ( tsd & TSD_SIZE );
-        }
-        else
+        if ( ! ( tsd & TSD_TOK ) )
         {
-            // There was some TX error, first log it
+            // There was some TX error, log it
             if ( netif_msg_tx_err ( priv ) )
             {
                 netdev_err ( ndev, "TX error (buf %d): %08x\n", * hw, tsd );
@@ -405,171 +838,1067 @@ static void _r8139dn_net_interrupt_tx ( struct net_device * ndev )
 
             // We've cleared TER at beginning of IRQ but it might have been set again
             r8139dn_w16 ( ISR, INT_TER );
-            ndev -> stats.tx_errors++;
+        }
 
-            if ( tsd & TSD_TABT )
-            {
-                ndev -> stats.tx_aborted_errors++;
-            }
+        _r8139dn_net_tx_stats ( priv, tsd );
+        trace_r8139dn_tx_done ( ndev, * hw, desc, tsd );
 
-            if ( tsd & TSD_TUN )
-            {
-                ndev -> stats.tx_fifo_errors++;
-            }
+        slot = & tx_ring -> slots [ * hw ];
+        if ( slot -> queued && tsd & TSD_TOK )
+        {
+            r8139dn_hist_add ( priv -> hists, R8139DN_HIST_TX_LATENCY_NS, ktime_get_ns ( ) - slot -> queued );
+        }
+        slot -> queued = 0;
+
+        // An underrun may come with TSD_TOK too (the frame still made it to the wire)
+        if ( priv -> fifo.adaptive )
+        {
+            r8139dn_hw_tune_tx ( priv, tsd & TSD_TUN );
+        }
+
+        // Whatever the result, the hardware is done with these bytes
+        pkts++;
+        bytes += tsd & TSD_SIZE;
+
+        // Zero-copy frame: the hardware is done with the sk_buff, release it
+        if ( slot -> skb )
+        {
+            // The sk_buff is only queued here: the TX softirq frees all of them at once, in bulk
+            dev_consume_skb_irq ( _r8139dn_net_tx_unmap ( priv, * hw ) );
         }
 
         // Increment hw position (marks current buffer as free for start_xmit)
-        BUILD_BUG_ON_NOT_POWER_OF_2 ( R8139DN_TX_DESC_NB );
-        smp_store_release ( hw, ( * hw + 1 ) & ( R8139DN_TX_DESC_NB - 1 ) );
+        smp_store_release ( hw, ( * hw + 1 ) & ( tx_ring -> len - 1 ) );
+    }
+
+    // Byte Queue Limits: report what has left the TX ring, this may wake the queue up too
+    netdev_completed_queue ( ndev, pkts, bytes );
+
+    if ( READ_ONCE ( priv -> hist_enable ) )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_TX_FRAMES, pkts );
     }
 
+    // Some hardware descriptors are free again: give them the next staged frames
+    _r8139dn_net_tx_kick ( priv );
+
     // If the queue was stopped (buffer full) and we've just freed some space, awake queue!
     // Kernel will resume calling start_xmit callback
+    // Pairs with the barrier in start_xmit: either we see the queue stopped, or start_xmit sees our new hw position
+    smp_mb ( );
     if ( netif_queue_stopped ( ndev ) && * hw != hw_old )
     {
         netdev_dbg ( ndev, "    TX ring buffer has free space, awaking queue\n" );
         netif_wake_queue ( ndev );
     }
+
+    // Interrupt coalescing: while frames are still in flight, don't take one interrupt per TX completion
+    // We'll reclaim all of them at once when the timer expires
+    usecs = READ_ONCE ( priv -> coal.tx_usecs );
+    if ( usecs && * hw != smp_load_acquire ( & tx_ring -> sent ) )
+    {
+        _r8139dn_net_coalesce ( priv, INT_TOK, usecs );
+    }
+    else if ( priv -> masked & INT_TOK )
+    {
+        r8139dn_hw_unmask_irq ( priv, INT_TOK );
+    }
 }
 
-// This function does the RX homework during interruption
-// The NIC retrieves packets from the cable and put them into a buffer.
-// We retrieve them from the buffer, create a skbbuf and give them to the kernel.
-static void _r8139dn_net_interrupt_rx ( struct net_device * ndev )
+// Account for a frame the hardware is done with, according to its transmit status
+// All the counters of this frame are updated at once
+static void _r8139dn_net_tx_stats ( struct r8139dn_priv * priv, u32 tsd )
 {
-    struct r8139dn_priv * priv = netdev_priv ( ndev );
-    struct r8139dn_rx_ring * rx_ring = & priv -> rx_ring;
-    struct r8139dn_rx_header * rxh;
-    struct sk_buff * skb;
-    int len, tail_frag_size;
-    u16 rx_offset;
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( priv -> stats );
+    unsigned int size = tsd & TSD_SIZE;
+    unsigned long flags;
 
-    // Let's break the build if the assumptions we heavily rely on are wrong
-    BUILD_BUG_ON ( sizeof ( struct r8139dn_rx_header ) != R8139DN_RX_HEADER_SIZE );
-    BUILD_BUG_ON_NOT_POWER_OF_2 ( R8139DN_RX_BUFLEN );
+    flags = u64_stats_update_begin_irqsave ( & stats -> irq_syncp );
 
-    netdev_dbg ( ndev, "  RX homework!\n" );
+    // Collisions happen on the way to success too, they are just retried
+    u64_stats_add ( & stats -> irq [ R8139DN_TX_COLLISIONS ], ( tsd & TSD_NCC ) >> TSD_NCC_SHIFT );
 
-    // While the RX Buffer is not empty
-    while ( ! ( r8139dn_r8 ( CR ) & CR_BUFE ) )
+    // An underrun may come with TSD_TOK
+    if ( tsd & TSD_TUN )
     {
-        /*   RTL RX Header          802.3 Ethernet Frame          32 bit Align
-         * <---------------><------------------------------------><---------->
-         *  -----------------------------------------------------------------
-         * | STATUS | SIZE | DMAC | SMAC | LEN/TYPE | DATA | FCS | ALIGNMENT |
-         *  -----------------------------------------------------------------
-         *     2       2       6      6       2       /~/     4      [0;3]
-         */
-
-        // Compute our position in the RX ring buffer
-        // Avoid expensive % operator (equivalent to cpu % R8139DN_RX_BUFLEN)
-        rx_offset = ( rx_ring -> cpu ) & ( R8139DN_RX_BUFLEN - 1 );
-
-        // Fetch the RX Header to get the status and the size of the frame
-        rxh = ( struct r8139dn_rx_header * ) ( rx_ring -> data + rx_offset );
-
-        netdev_dbg ( ndev, "    CBR: %u, CAPR: %u, Offset: %u, Size: %u, Status: 0x%04x\n",
-                r8139dn_r16 ( CBR ), r8139dn_r16 ( CAPR ), rx_offset, rxh -> size, rxh -> status );
-
-        // Don't give the Ethernet checksum to the kernel
-        len = rxh -> size - ETH_FCS_LEN;
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_UNDERRUNS ] );
+    }
 
-        // Allocate an skbuff and add 2 bytes at the beginning to align for IP header
-        skb = netdev_alloc_skb_ip_align ( ndev, len );
+    if ( tsd & TSD_TOK )
+    {
+        // Packet has been moved to line successfuly!
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_PACKETS ] );
+        u64_stats_add ( & stats -> irq [ R8139DN_TX_BYTES ], size );
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_SIZE + r8139dn_stats_size_bucket ( size + ETH_FCS_LEN ) ] );
+    }
+    else
+    {
+        u64_stats_inc ( & stats -> irq [ R8139DN_TX_ERRORS ] );
 
-        // Copy the Ethernet frame to the skbuff
-        if ( skb )
+        if ( tsd & TSD_TABT )
         {
-            // The frame spans the end of the buffer, we need to copy the two parts separately
-            if ( rx_offset + R8139DN_RX_HEADER_SIZE + len > R8139DN_RX_BUFLEN )
-            {
-                tail_frag_size = R8139DN_RX_BUFLEN - ( rx_offset + R8139DN_RX_HEADER_SIZE );
-                skb_copy_to_linear_data ( skb, rxh + 1, tail_frag_size );
-                skb_copy_to_linear_data_offset ( skb, tail_frag_size, rx_ring -> data, len - tail_frag_size );
-            }
-            // The frame doesn't span the end of the buffer: it is in one piece
-            else
-            {
-                skb_copy_to_linear_data ( skb, rxh + 1, len );
-            }
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_ABORTED ] );
+        }
 
-            skb_put ( skb, len );
-            skb -> protocol = eth_type_trans ( skb, ndev );
+        if ( tsd & TSD_CRS )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_CARRIER_ERRORS ] );
+        }
 
-            // Feed the kernel's IP stack with our freshly RXed Ethernet frame!
-            netif_rx ( skb );
+        if ( tsd & TSD_OWC )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_WINDOW_ERRORS ] );
         }
 
-        // Commit to the hardware our new position in the ring buffer
-        rx_ring -> cpu += R8139DN_RX_ALIGN ( rxh -> size + R8139DN_RX_HEADER_SIZE );
-        r8139dn_w16 ( CAPR, rx_ring -> cpu - R8139DN_RX_PAD );
+        if ( tsd & TSD_CDH )
+        {
+            u64_stats_inc ( & stats -> irq [ R8139DN_TX_HEARTBEAT_ERRORS ] );
+        }
     }
+
+    u64_stats_update_end_irqrestore ( & stats -> irq_syncp, flags );
 }
 
-// The kernel calls this when interface is set down
-// ip link set down dev eth0
-static int r8139dn_net_close ( struct net_device * ndev )
+// The kernel calls this from its TX watchdog, when our TX queue has been stopped for too long
+// We are in softirq context, with the TX queue locked: leave the recovery to our work
+static void r8139dn_net_tx_timeout ( struct net_device * ndev, unsigned int txqueue )
 {
     struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    int hw = READ_ONCE ( ring -> hw );
+    int desc = hw & ( R8139DN_TX_DESC_NB - 1 );
 
-    if ( netif_msg_ifdown ( priv ) )
+    r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_TIMEOUTS, 1 );
+
+    if ( priv -> cplus && netif_msg_tx_err ( priv ) )
     {
-        netdev_info ( ndev, "Bringing interface down...\n" );
+        netdev_err ( ndev, "TX timeout (C+ cpu: %d, hw: %d, ISR: %04x)\n",
+                READ_ONCE ( priv -> cp.tx_cpu ), READ_ONCE ( priv -> cp.tx_hw ), r8139dn_r16 ( ISR ) );
     }
-
-    if ( txrx & ( TX | RX ) )
+    else if ( netif_msg_tx_err ( priv ) )
     {
-        // Disable TX and RX
-        r8139dn_hw_disable_transceiver ( priv );
+        netdev_err ( ndev, "TX timeout (cpu: %d, sent: %d, hw: %d, TSD%d: %08x, ISR: %04x)\n",
+                READ_ONCE ( ring -> cpu ), READ_ONCE ( ring -> sent ), hw, desc,
+                r8139dn_r32 ( TSD0 + desc * TSD_GAP ), r8139dn_r16 ( ISR ) );
     }
 
-    // Disable IRQ
-    r8139dn_hw_disable_irq ( priv );
-
-    // Free all allocated DMA memory
-    _r8139dn_net_release_rings ( priv );
-
-    // Unhook our handler from the IRQ line
-    free_irq ( ndev -> irq, ndev );
-
-    return 0;
+    schedule_work ( & priv -> tx_timeout.work );
 }
 
-static void _r8139dn_net_check_link ( struct net_device * ndev )
+// Recover from a TX timeout, touching nothing but the transmitter
+// Either we only missed some TX interrupts and reclaiming the completed frames is enough,
+// or the transmitter is stuck on a frame and we restart it. The RX side keeps running
+// Only if a restart didn't get the hardware any further, we fall back to a full chip reset
+static void _r8139dn_net_tx_timeout_work ( struct work_struct * work )
 {
-    struct r8139dn_priv * priv = netdev_priv ( ndev );
-    // Fetch the Media Status Register
-    u8 msr = r8139dn_r8 ( MSR );
+    struct r8139dn_priv * priv = container_of ( work, struct r8139dn_priv, tx_timeout.work );
+    struct net_device * ndev = pci_get_drvdata ( priv -> pdev );
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    unsigned long flags;
+    bool reset = false;
+
+    rtnl_lock ( );
 
-    // If the link was down but is now up, tell the kernel
-    if ( ! netif_carrier_ok ( ndev ) && ! ( msr & MSR_LINK_BAD ) )
+    // The interface went down meanwhile: nothing is stuck anymore
+    if ( ! netif_running ( ndev ) )
     {
-        if ( netif_msg_link ( priv ) )
-        {
-            netdev_info ( ndev, "Link is now up!\n" );
-        }
-        netif_carrier_on ( ndev );
+        goto out;
     }
 
-    // If the link was up but is now down, tell the kernel
-    else if ( netif_carrier_ok ( ndev ) && ( msr & MSR_LINK_BAD ) )
+    // C+ mode: the transmitter can't be restarted in place yet, reset the chip
+    if ( priv -> cplus )
     {
-        if ( netif_msg_link ( priv ) )
-        {
-            netdev_info ( ndev, "Link is now down!\n" );
-        }
-        netif_carrier_off ( ndev );
+        reset = true;
+        goto tx_timeout_reset;
     }
-}
 
-// Called when user wants to change the MAC address
-// ip link set address 05:04:03:02:01:00 dev eth0
-static int r8139dn_net_set_mac_addr ( struct net_device * ndev, void * addr )
-{
-    struct sockaddr * mac_sa = addr;
+    // Keep everybody away from the TX ring: our poll function (XDP_TX), start_xmit, ndo_xdp_xmit and our IRQ handler
+    // The IRQ line may be shared: masking our interrupts in IMR wouldn't prevent our handler from running
+    napi_disable ( & priv -> napi );
+    netif_tx_lock_bh ( ndev );
+    disable_irq ( ndev -> irq );
 
-    // If the MAC address is not valid, just stop here
-    if ( ! is_valid_ether_addr ( mac_sa -> sa_data ) )
+    // Maybe we only missed a TX interrupt: reclaim what the hardware completed
+    _r8139dn_net_interrupt_tx ( ndev );
+
+    if ( ring -> hw != ring -> sent )
+    {
+        if ( ring -> hw == priv -> tx_timeout.restarted_at )
+        {
+            reset = true;
+        }
+        else
+        {
+            // The hardware stays on the same descriptor: hand it the frames it hasn't completed again, in order
+            spin_lock_irqsave ( & ring -> lock, flags );
+            r8139dn_hw_restart_tx ( priv );
+            smp_store_release ( & ring -> sent, ring -> hw );
+            spin_unlock_irqrestore ( & ring -> lock, flags );
+
+            _r8139dn_net_tx_kick ( priv );
+
+            priv -> tx_timeout.restarted_at = ring -> hw;
+            r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_RESTARTS, 1 );
+        }
+    }
+
+    // Give the hardware a whole period to complete something before the watchdog looks at us again
+    netif_trans_update ( ndev );
+
+    enable_irq ( ndev -> irq );
+    netif_tx_unlock_bh ( ndev );
+    napi_enable ( & priv -> napi );
+
+tx_timeout_reset:
+    if ( reset )
+    {
+        netdev_warn ( ndev, "Transmitter still stuck, resetting the chip\n" );
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_RESETS, 1 );
+
+        // The stack keeps sending meanwhile: r8139dn_net_detach keeps it away from the rings we release
+        // If the chip doesn't come back, r8139dn_net_reopen shuts the interface down rather than leave it half open
+        r8139dn_net_detach ( ndev );
+        r8139dn_net_reopen ( ndev );
+    }
+
+out:
+    rtnl_unlock ( );
+}
+
+// This function handles early RX interrupts
+// In early RX mode, INT_ROK is raised a first time when a part of the frame is in our RX ring (ERSR_EROK)
+// and a second time when the whole frame has been received (ERSR_ERGOOD or ERSR_ERBAD)
+// Returns the interrupts that must be ignored because they were early RX interrupts
+static u16 _r8139dn_net_interrupt_early_rx ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_rx_ring * rx_ring = & priv -> rx_ring;
+    u8 ersr = r8139dn_r8 ( ERSR );
+    u16 rx_offset;
+
+    // Acknowledge the completion bits (EROK is cleared automatically)
+    r8139dn_w8 ( ERSR, ersr & ( ERSR_ERGOOD | ERSR_ERBAD | ERSR_EROVW ) );
+
+    netdev_dbg ( ndev, "  Early RX (ERSR: %02x, ERBCR: %u)\n", ersr, r8139dn_r16 ( ERBCR ) );
+
+    // The hardware caught up with CAPR while moving the frame: the RX ring is full
+    if ( ersr & ERSR_EROVW )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_OVER_ERRORS, 1 );
+    }
+
+    // The frame was bad: the hardware has already rewound to its beginning
+    // There's no header and nothing to read for us in the RX ring
+    if ( ersr & ERSR_ERBAD )
+    {
+        r8139dn_stats_irq_add ( priv -> stats, R8139DN_RX_EARLY_BAD, 1 );
+    }
+
+    // The frame is complete and good, the usual RX homework can take place
+    if ( ersr & ERSR_ERGOOD )
+    {
+        return 0;
+    }
+
+    // The frame is still being moved to the RX ring, its RTL RX header hasn't been written yet
+    // CBR is where the hardware is writing, already past the start of the frame: the frame starts where our
+    // poll function will look next. Bring its Ethernet header into our cache right now,
+    // so that our poll function finds it hot when the whole frame is there
+    if ( ersr & ERSR_EROK )
+    {
+        rx_offset = READ_ONCE ( rx_ring -> cpu ) & ( rx_ring -> len - 1 );
+        net_prefetch ( rx_ring -> data + rx_offset + R8139DN_RX_HEADER_SIZE );
+    }
+
+    // Nothing has been completed: don't bother NAPI
+    return INT_ROK | INT_RER;
+}
+
+// NAPI poll function, called by the kernel in softirq context after we scheduled it from our IRQ handler
+// We must not process more than budget frames. If we processed less, the RX ring is empty:
+// we tell NAPI we're done and we can unmask RX interrupts again.
+static int r8139dn_net_poll ( struct napi_struct * napi, int budget )
+{
+    struct r8139dn_priv * priv = container_of ( napi, struct r8139dn_priv, napi );
+    struct net_device * ndev = napi -> dev;
+    struct dim_sample sample;
+    int work_done;
+    u32 batch, usecs;
+
+    // The IRQ handler leaves the RX interrupts to us while they are masked
+    // Acknowledge them before looking at the RX ring: a frame coming in from now on raises them again
+    r8139dn_w16 ( ISR, INT_ROK | INT_RER );
+
+    work_done = _r8139dn_net_poll_rx ( ndev, budget );
+
+    if ( READ_ONCE ( priv -> hist_enable ) )
+    {
+        r8139dn_hist_add ( priv -> hists, R8139DN_HIST_RX_FRAMES, work_done );
+    }
+    priv -> coal.rx_batch += work_done;
+
+    // A PAUSE frame didn't fit in our TX ring: stay scheduled, the next poll tries again
+    if ( unlikely ( priv -> pause.retry ) )
+    {
+        return budget;
+    }
+
+    // napi_complete_done returns false when the kernel wants to keep polling us
+    // (busy polling, or napi_defer_hard_irqs / gro_flush_timeout are in use)
+    // In that case, RX interrupts must stay masked: we will be polled again anyway
+    if ( work_done < budget && napi_complete_done ( napi, work_done ) )
+    {
+        batch = priv -> coal.rx_batch;
+        priv -> coal.rx_batch = 0;
+
+        // Adaptive coalescing: let net_dim look at the traffic, it will update rx_usecs if needed
+        if ( READ_ONCE ( priv -> coal.adaptive_rx ) )
+        {
+            dim_update_sample ( priv -> coal.dim_events++, priv -> coal.dim_packets,
+                    priv -> coal.dim_bytes, & sample );
+            net_dim ( & priv -> coal.dim, sample );
+        }
+
+        // We're busy: rather than taking one interrupt per frame, keep INT_ROK masked
+        // and come back for the next batch when the coalescing timer expires
+        // Otherwise, the traffic is light: go back to one interrupt per frame for a better latency
+        usecs = READ_ONCE ( priv -> coal.rx_usecs );
+        if ( usecs && batch >= READ_ONCE ( priv -> coal.rx_frames ) )
+        {
+            _r8139dn_net_coalesce ( priv, INT_ROK, usecs );
+            r8139dn_hw_unmask_irq ( priv, INT_RX & ~ INT_ROK );
+        }
+        else
+        {
+            r8139dn_hw_unmask_irq ( priv, INT_RX );
+        }
+    }
+
+    return work_done;
+}
+
+// Delay an interrupt (INT_ROK or INT_TOK) with the coalescing timer
+// The interrupt is masked until the timer expires (see _r8139dn_net_coalesce_expired)
+// If the timer is already armed, we don't rearm it: we'll share the earliest deadline
+static void _r8139dn_net_coalesce ( struct r8139dn_priv * priv, u16 irq, u32 usecs )
+{
+    unsigned long flags;
+
+    // Mask before arming: should the timer expire in between, the IRQ handler
+    // would not see us in waiting, and our interrupt would stay masked forever
+    r8139dn_hw_mask_irq ( priv, irq );
+
+    spin_lock_irqsave ( & priv -> lock, flags );
+    if ( ! priv -> coal.waiting )
+    {
+        r8139dn_hw_arm_timer ( priv, usecs );
+    }
+    priv -> coal.waiting |= irq;
+    spin_unlock_irqrestore ( & priv -> lock, flags );
+}
+
+// Called from the IRQ handler when the coalescing timer expired
+// Disarm it, and return the interrupts that were waiting for it
+// The IRQ handler has to do their homework, and then decide whether to delay them again
+static u16 _r8139dn_net_coalesce_expired ( struct r8139dn_priv * priv )
+{
+    u16 waiting;
+
+    spin_lock ( & priv -> lock );
+    waiting = priv -> coal.waiting;
+    priv -> coal.waiting = 0;
+    r8139dn_hw_disarm_timer ( priv );
+    spin_unlock ( & priv -> lock );
+
+    return waiting;
+}
+
+// net_dim decided that another RX moderation profile suits the traffic better
+// We only take the delay from the profile: its frame counts are well above
+// what a 100 Mbps link brings in a single window, and would never let moderation start
+static void _r8139dn_net_dim_work ( struct work_struct * work )
+{
+    struct dim * dim = container_of ( work, struct dim, work );
+    struct r8139dn_priv * priv = container_of ( dim, struct r8139dn_priv, coal.dim );
+    struct dim_cq_moder moder;
+
+    // Adaptive coalescing may have been turned off since (ethtool -C): rx-usecs is the user's again
+    moder = net_dim_get_rx_moderation ( dim -> mode, dim -> profile_ix );
+    if ( READ_ONCE ( priv -> coal.adaptive_rx ) )
+    {
+        WRITE_ONCE ( priv -> coal.rx_usecs, moder.usec );
+    }
+
+    dim -> state = DIM_START_MEASURE;
+}
+
+// Account for a bad frame, according to its receive status (RTL RX header)
+static void _r8139dn_net_rx_error_stats ( struct r8139dn_priv * priv, u16 status )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( priv -> stats );
+
+    u64_stats_update_begin ( & stats -> rx_syncp );
+
+    if ( status & RSR_CRC )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_CRC_ERRORS ] );
+    }
+
+    if ( status & RSR_FAE )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_FRAME_ERRORS ] );
+    }
+
+    if ( status & ( RSR_RUNT | RSR_LONG ) )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_LENGTH_ERRORS ] );
+    }
+
+    if ( status & RSR_ISE )
+    {
+        u64_stats_inc ( & stats -> rx [ R8139DN_RX_SYMBOL_ERRORS ] );
+    }
+
+    u64_stats_update_end ( & stats -> rx_syncp );
+}
+
+// Check the RTL RX header of a frame makes sense, before we believe its size
+// A good frame holds at least a minimum size Ethernet frame, a bad one at least its FCS,
+// and the hardware must have reported something about it
+static bool _r8139dn_net_rx_header_ok ( u16 size, u16 status )
+{
+    if ( ! ( status & ( RSR_ROK | RSR_ISE | RSR_RUNT | RSR_LONG | RSR_CRC | RSR_FAE ) ) )
+    {
+        return false;
+    }
+
+    if ( size > R8139DN_MAX_ETH_SIZE )
+    {
+        return false;
+    }
+
+    return size >= ( status & RSR_ROK ? ETH_ZLEN + ETH_FCS_LEN : ETH_FCS_LEN );
+}
+
+// Give the whole RX ring back to the hardware after it overflowed (INT_RXOVW), without resetting anything
+// The frames still in the ring are old by now: drop them rather than walking through them,
+// the hardware can receive again right away. Just as if we had read everything up to CBR
+static void _r8139dn_net_rx_resync ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_rx_ring * rx_ring = & priv -> rx_ring;
+
+    rx_ring -> cpu = r8139dn_r16 ( CBR );
+    r8139dn_w16 ( CAPR, rx_ring -> cpu - R8139DN_RX_PAD );
+
+    r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_RESYNCS, 1 );
+}
+
+// This function does the RX homework from our NAPI poll function
+// The NIC retrieves packets from the cable and put them into a buffer.
+// We retrieve them from the buffer, create a skbbuf and give them to the kernel.
+// Returns the number of frames we've processed (never more than budget)
+static int _r8139dn_net_poll_rx ( struct net_device * ndev, int budget )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_rx_ring * rx_ring = & priv -> rx_ring;
+    struct r8139dn_rx_header * rxh;
+    struct bpf_prog * prog;
+    int len, wrapped;
+    int work_done = 0;
+    bool xdp_tx = false;
+    u16 rx_offset, size, status;
+
+    // Let's break the build if the assumptions we heavily rely on are wrong
+    BUILD_BUG_ON ( sizeof ( struct r8139dn_rx_header ) != R8139DN_RX_HEADER_SIZE );
+
+    netdev_dbg ( ndev, "  RX homework!\n" );
+
+    // The XDP program can be replaced at any time, stick to one for the whole batch
+    // (An old program is only released once we're out of the softirq)
+    prog = READ_ONCE ( priv -> xdp_prog );
+
+    // The RX ring overflowed: the hardware is dropping frames until we make room
+    if ( unlikely ( READ_ONCE ( rx_ring -> overflow ) ) )
+    {
+        WRITE_ONCE ( rx_ring -> overflow, false );
+        _r8139dn_net_rx_resync ( priv );
+    }
+
+    // While the RX Buffer is not empty and we still have some budget
+    while ( work_done < budget && ! ( r8139dn_r8 ( CR ) & CR_BUFE ) )
+    {
+        /*   RTL RX Header          802.3 Ethernet Frame          32 bit Align
+         * <---------------><------------------------------------><---------->
+         *  -----------------------------------------------------------------
+         * | STATUS | SIZE | DMAC | SMAC | LEN/TYPE | DATA | FCS | ALIGNMENT |
+         *  -----------------------------------------------------------------
+         *     2       2       6      6       2       /~/     4      [0;3]
+         */
+
+        // Compute our position in the RX ring buffer
+        // Avoid expensive % operator (equivalent to cpu % len, len is a power of 2)
+        rx_offset = ( rx_ring -> cpu ) & ( rx_ring -> len - 1 );
+
+        // Fetch the RX Header to get the status and the size of the frame
+        rxh = ( struct r8139dn_rx_header * ) ( rx_ring -> data + rx_offset );
+
+        // The XDP program is allowed to overwrite the RTL RX header: keep what we need from it
+        size = rxh -> size;
+        status = rxh -> status;
+
+        netdev_dbg ( ndev, "    CBR: %u, CAPR: %u, Offset: %u, Size: %u, Status: 0x%04x\n",
+                r8139dn_r16 ( CBR ), r8139dn_r16 ( CAPR ), rx_offset, size, status );
+
+        // Reading CBR costs a PCI read: only do it when someone is listening
+        if ( trace_r8139dn_rx_enabled ( ) )
+        {
+            trace_r8139dn_rx ( ndev, rx_offset, ( r8139dn_r16 ( CBR ) - rx_ring -> cpu ) & ( rx_ring -> len - 1 ),
+                    size, status );
+        }
+
+        // Early RX mode: the hardware is still moving this frame to the RX ring, we'll get another interrupt
+        if ( unlikely ( size == R8139DN_RX_SIZE_UNFINISHED ) )
+        {
+            break;
+        }
+
+        // We must not trust a size we would read past the end of the ring with
+        // When the header is garbage, so is our position in the ring: start again from scratch
+        if ( unlikely ( ! _r8139dn_net_rx_header_ok ( size, status ) ) )
+        {
+            if ( netif_msg_rx_err ( priv ) )
+            {
+                netdev_err ( ndev, "Corrupted RX header (offset %u, size %u, status %04x), resetting the receiver\n",
+                        rx_offset, size, status );
+            }
+
+            r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_RESETS, 1 );
+            r8139dn_hw_reset_rx ( priv );
+            break;
+        }
+
+        // Don't give the Ethernet checksum to the kernel
+        len = size - ETH_FCS_LEN;
+
+        // Without RCR_WRAP (64K ring), the hardware moved the end of the frame to the beginning of the ring
+        // Copy it to the spare room right after the end of the ring: the frame is now in one piece,
+        // just as if the hardware had done it for us with RCR_WRAP
+        wrapped = rx_offset + R8139DN_RX_HEADER_SIZE + size - rx_ring -> len;
+        if ( unlikely ( wrapped > 0 ) && ! ( priv -> rcr & RCR_WRAP ) )
+        {
+            memcpy ( rx_ring -> data + rx_ring -> len, rx_ring -> data, wrapped );
+        }
+
+        // The hardware only gives us bad frames when asked to (RCR_AER, RCR_AR): count them and skip them
+        if ( unlikely ( ! ( status & RSR_ROK ) ) )
+        {
+            _r8139dn_net_rx_error_stats ( priv, status );
+        }
+        else
+        {
+            r8139dn_stats_rx_frame ( priv -> stats, size );
+            priv -> coal.dim_packets++;
+            priv -> coal.dim_bytes += len;
+
+            xdp_tx |= _r8139dn_net_rx_frame ( ndev, prog, rxh + 1, len );
+        }
+
+        // Commit to the hardware our new position in the ring buffer
+        rx_ring -> cpu += R8139DN_RX_ALIGN ( size + R8139DN_RX_HEADER_SIZE );
+        r8139dn_w16 ( CAPR, rx_ring -> cpu - R8139DN_RX_PAD );
+
+        work_done++;
+    }
+
+    // Flow control: tell the link partner to hold off (or to go on) depending on how full our RX ring is
+    priv -> pause.retry = false;
+    if ( READ_ONCE ( priv -> pause.tx_active ) )
+    {
+        xdp_tx |= _r8139dn_net_rx_flow_control ( ndev );
+    }
+
+    // XDP_TX (and PAUSE frames): send the whole batch at once
+    if ( xdp_tx )
+    {
+        _r8139dn_net_tx_kick ( priv );
+    }
+
+    return work_done;
+}
+
+// Software flow control, on top of what the hardware does when its own buffers fill up:
+// the hardware only looks at its RX FIFO, we also look at how far behind CBR our poll function is
+// We send one XOFF when the RX ring goes over the high watermark, and one XON once it's back under the low one
+// If our TX ring is full, the PAUSE frame is retried: our poll function stays scheduled until it gets through
+// Returns true if a PAUSE frame has been staged: the caller has to kick the hardware
+static bool _r8139dn_net_rx_flow_control ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_rx_ring * rx_ring = & priv -> rx_ring;
+    u32 used = ( r8139dn_r16 ( CBR ) - rx_ring -> cpu ) & ( rx_ring -> len - 1 );
+
+    if ( ! priv -> pause.xoff && used >= R8139DN_PAUSE_XOFF ( rx_ring -> len ) )
+    {
+        if ( _r8139dn_net_rx_pause ( ndev, R8139DN_PAUSE_QUANTA ) )
+        {
+            priv -> pause.xoff = true;
+            r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_PAUSE_XOFF, 1 );
+            return true;
+        }
+        priv -> pause.retry = true;
+    }
+    else if ( priv -> pause.xoff && used <= R8139DN_PAUSE_XON ( rx_ring -> len ) )
+    {
+        if ( _r8139dn_net_rx_pause ( ndev, 0 ) )
+        {
+            priv -> pause.xoff = false;
+            r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_PAUSE_XON, 1 );
+            return true;
+        }
+        priv -> pause.retry = true;
+    }
+
+    return false;
+}
+
+// Stage a PAUSE frame (MAC control frame) asking the link partner to hold off for quanta x 512 bit times
+// A zero pause time lets it go on right away
+// It goes ahead of the data frames waiting in our TX ring: behind them, it could come milliseconds too late
+static bool _r8139dn_net_rx_pause ( struct net_device * ndev, u16 quanta )
+{
+    static const u8 pause_addr [ ETH_ALEN ] = { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x01 };
+    struct netdev_queue * txq = netdev_get_tx_queue ( ndev, 0 );
+    u8 frame [ ETH_ZLEN ] = { 0 };
+    struct ethhdr * eth = ( struct ethhdr * ) frame;
+    __be16 * ctrl = ( __be16 * ) ( eth + 1 );
+    bool staged;
+
+    memcpy ( eth -> h_dest, pause_addr, ETH_ALEN );
+    memcpy ( eth -> h_source, ndev -> dev_addr, ETH_ALEN );
+    eth -> h_proto = htons ( ETH_P_PAUSE );
+
+    // Opcode (PAUSE), then the pause time
+    ctrl [ 0 ] = htons ( 0x0001 );
+    ctrl [ 1 ] = htons ( quanta );
+
+    // No TX ring to send it through
+    if ( ! ( txrx & TX ) )
+    {
+        return false;
+    }
+
+    // start_xmit may be running on another CPU: serialize with it on its own lock
+    __netif_tx_lock ( txq, smp_processor_id ( ) );
+    staged = _r8139dn_net_tx_stage_first ( ndev, frame, sizeof ( frame ) );
+    __netif_tx_unlock ( txq );
+
+    return staged;
+}
+
+// Give a good frame of the RX ring (data, without FCS) to the XDP program if any, and then to the kernel
+// The program sees the frame right in the RX ring: no copy, no sk_buff, that's the whole point
+// It can't grow the frame (what's after it belongs to the next frames), nor its head beyond the RTL RX header
+// (what's before it may already be overwritten by the hardware)
+// Returns true if the frame has been staged for XDP_TX
+static bool _r8139dn_net_rx_frame ( struct net_device * ndev, struct bpf_prog * prog, void * data, int len )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct sk_buff * skb;
+    struct xdp_buff xdp;
+    u32 act;
+
+    if ( prog )
+    {
+        xdp_init_buff ( & xdp, R8139DN_RX_HEADER_SIZE + len + SKB_DATA_ALIGN ( sizeof ( struct skb_shared_info ) ),
+                & priv -> xdp_rxq );
+        xdp_prepare_buff ( & xdp, data - R8139DN_RX_HEADER_SIZE, R8139DN_RX_HEADER_SIZE, len, false );
+
+        act = bpf_prog_run_xdp ( prog, & xdp );
+
+        // The program may have moved the frame boundaries
+        data = xdp.data;
+        len = xdp.data_end - xdp.data;
+
+        switch ( act )
+        {
+            case XDP_PASS:
+                break;
+
+            case XDP_TX:
+                if ( _r8139dn_net_xdp_tx ( ndev, data, len ) )
+                {
+                    r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_XDP_TX, 1 );
+                    return true;
+                }
+                r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_XDP_TX_ERRORS, 1 );
+                trace_xdp_exception ( ndev, prog, act );
+                return false;
+
+            default:
+                bpf_warn_invalid_xdp_action ( act );
+                fallthrough;
+
+            case XDP_ABORTED:
+                trace_xdp_exception ( ndev, prog, act );
+                fallthrough;
+
+            case XDP_DROP:
+                // Dropping costs nothing more than moving CAPR
+                r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_XDP_DROP, 1 );
+                return false;
+        }
+    }
+
+    // Small frames: a small sk_buff, from the per-CPU NAPI caches
+    // (It has 2 bytes at the beginning to align for IP header)
+    // Bigger frames: a recycled page from our page pool
+    if ( len <= priv -> rx_ring.copybreak )
+    {
+        skb = napi_alloc_skb ( & priv -> napi, len );
+        if ( skb )
+        {
+            skb_copy_to_linear_data ( skb, data, len );
+            skb_put ( skb, len );
+        }
+    }
+    else
+    {
+        skb = _r8139dn_net_rx_build_skb ( priv, data, len );
+    }
+
+    if ( unlikely ( ! skb ) )
+    {
+        r8139dn_stats_rx_add ( priv -> stats, R8139DN_RX_ALLOC_FAILED, 1 );
+        return false;
+    }
+
+    skb -> protocol = eth_type_trans ( skb, ndev );
+
+    // Feed the kernel's IP stack with our freshly RXed Ethernet frame!
+    // GRO may merge it with other frames of the same flow before going up the stack
+    napi_gro_receive ( & priv -> napi, skb );
+
+    return false;
+}
+
+// Copy a frame of the RX ring to a fragment of a page of our page pool, and build an sk_buff around it
+// The fragment is only as big as the frame needs (a 1514 bytes frame takes 2K), several frames share a page:
+// the sk_buff truesize, charged to the socket receive buffer, is what the frame really uses, not a whole page
+// Neither the sk_buff data nor the page come from the slab allocator
+// The page comes back to our pool once the kernel is done with the sk_buffs of all its fragments
+static struct sk_buff * _r8139dn_net_rx_build_skb ( struct r8139dn_priv * priv, const void * data, int len )
+{
+    unsigned int size = SKB_DATA_ALIGN ( R8139DN_RX_HEADROOM + len ) +
+        SKB_DATA_ALIGN ( sizeof ( struct skb_shared_info ) );
+    unsigned int offset;
+    struct sk_buff * skb;
+    struct page * page;
+    void * buf;
+
+    BUILD_BUG_ON ( R8139DN_RX_HEADROOM + R8139DN_MAX_ETH_SIZE +
+            SKB_DATA_ALIGN ( sizeof ( struct skb_shared_info ) ) > PAGE_SIZE );
+
+    page = page_pool_dev_alloc_frag ( priv -> rx_ring.pool, & offset, size );
+    if ( unlikely ( ! page ) )
+    {
+        return NULL;
+    }
+
+    buf = page_address ( page ) + offset;
+    memcpy ( buf + R8139DN_RX_HEADROOM, data, len );
+
+    skb = napi_build_skb ( buf, size );
+    if ( unlikely ( ! skb ) )
+    {
+        page_pool_put_full_page ( priv -> rx_ring.pool, page, true );
+        return NULL;
+    }
+
+    skb_reserve ( skb, R8139DN_RX_HEADROOM );
+    skb_put ( skb, len );
+    skb_mark_for_recycle ( skb );
+
+    return skb;
+}
+
+// XDP_TX: send a frame of the RX ring back to the wire, through our TX ring
+// It is copied: its room in the RX ring goes back to the hardware right away
+// Our poll function sends its PAUSE frames this way too
+// The caller kicks the hardware once it is done with its batch
+// Returns false if the TX ring is full
+static bool _r8139dn_net_xdp_tx ( struct net_device * ndev, void * data, u32 len )
+{
+    struct netdev_queue * txq = netdev_get_tx_queue ( ndev, 0 );
+    bool staged;
+
+    // No TX ring to send it through
+    if ( ! ( txrx & TX ) )
+    {
+        return false;
+    }
+
+    // start_xmit may be running on another CPU: serialize with it on its own lock
+    __netif_tx_lock ( txq, smp_processor_id ( ) );
+    staged = _r8139dn_net_tx_stage ( ndev, data, len );
+    __netif_tx_unlock ( txq );
+
+    return staged;
+}
+
+// The kernel calls this to send frames redirected to us (XDP_REDIRECT from another interface, AF_XDP)
+// The frames are copied to our TX ring, just like XDP_TX: we give them back right away rather than on completion
+// Returns the number of frames we took, the kernel frees the others
+static int r8139dn_net_xdp_xmit ( struct net_device * ndev, int n, struct xdp_frame ** frames, u32 flags )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct netdev_queue * txq = netdev_get_tx_queue ( ndev, 0 );
+    int i;
+
+    if ( unlikely ( flags & ~ XDP_XMIT_FLAGS_MASK ) )
+    {
+        return -EINVAL;
+    }
+
+    if ( unlikely ( ! netif_running ( ndev ) || ! ( txrx & TX ) ) )
+    {
+        return -ENETDOWN;
+    }
+
+    // No XDP in C+ mode (yet)
+    if ( priv -> cplus )
+    {
+        return -EOPNOTSUPP;
+    }
+
+    // start_xmit may be running on another CPU: serialize with it on its own lock
+    // Under it, we also know whether r8139dn_net_detach is about to release the TX ring
+    __netif_tx_lock ( txq, smp_processor_id ( ) );
+    if ( unlikely ( ! netif_device_present ( ndev ) ) )
+    {
+        __netif_tx_unlock ( txq );
+        return -ENETDOWN;
+    }
+
+    for ( i = 0; i < n ; ++i )
+    {
+        if ( ! _r8139dn_net_tx_stage ( ndev, frames [ i ] -> data, frames [ i ] -> len ) )
+        {
+            break;
+        }
+        xdp_return_frame ( frames [ i ] );
+    }
+    __netif_tx_unlock ( txq );
+
+    r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_XDP_XMIT, i );
+    r8139dn_stats_irq_add ( priv -> stats, R8139DN_TX_XDP_XMIT_ERRORS, n - i );
+
+    // End of the batch: send it
+    if ( flags & XDP_XMIT_FLUSH )
+    {
+        _r8139dn_net_tx_kick ( priv );
+    }
+
+    return i;
+}
+
+// The kernel calls this to install or remove an XDP program
+// ip link set dev eth0 xdp obj prog.o
+static int r8139dn_net_bpf ( struct net_device * ndev, struct netdev_bpf * bpf )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct bpf_prog * old;
+
+    switch ( bpf -> command )
+    {
+        case XDP_SETUP_PROG:
+            // Our XDP support is built on the RX ring of the RTL8139: not in C+ mode (yet)
+            if ( priv -> cplus )
+            {
+                NL_SET_ERR_MSG_MOD ( bpf -> extack, "XDP is not supported in C+ mode" );
+                return -EOPNOTSUPP;
+            }
+
+            // The RX ring stays as it is: our poll function picks the new program up on its next run
+            // The kernel gives us its reference on the new program, we give back the one on the old program
+            old = xchg ( & priv -> xdp_prog, bpf -> prog );
+            if ( old )
+            {
+                bpf_prog_put ( old );
+            }
+            return 0;
+
+        default:
+            return -EINVAL;
+    }
+}
+
+// The kernel calls this when interface is set down
+// ip link set down dev eth0
+int r8139dn_net_close ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    // We closed ourselves and couldn't open again: the IRQ, the rings and NAPI are already gone
+    if ( ! priv -> up )
+    {
+        return 0;
+    }
+    priv -> up = false;
+
+    if ( netif_msg_ifdown ( priv ) )
+    {
+        netdev_info ( ndev, "Bringing interface down...\n" );
+    }
+
+    if ( priv -> cplus || txrx & ( TX | RX ) )
+    {
+        // Disable TX and RX
+        r8139dn_hw_disable_transceiver ( priv );
+    }
+
+    // Disable IRQ, and wait for our handler if it is running on another CPU
+    // From now on, it ignores everything: the line may be shared, it can still be called
+    r8139dn_hw_disable_irq ( priv );
+    synchronize_irq ( ndev -> irq );
+
+    // Wait for our poll function to complete, and prevent it from being scheduled again
+    napi_disable ( & priv -> napi );
+    cancel_work_sync ( & priv -> coal.dim.work );
+
+    // Our IRQ handler can't schedule the link work anymore: wait for it
+    cancel_work_sync ( & priv -> link_work );
+
+    // Make sure the coalescing timer won't fire anymore
+    r8139dn_hw_disarm_timer ( priv );
+
+    // Stop harvesting the hardware counters, after collecting their last values
+    r8139dn_stats_stop ( priv );
+
+    // Free all allocated DMA memory
+    if ( priv -> cplus )
+    {
+        r8139dn_cp_release_rings ( priv );
+    }
+    else
+    {
+        _r8139dn_net_release_rings ( priv );
+    }
+
+    if ( xdp_rxq_info_is_reg ( & priv -> xdp_rxq ) )
+    {
+        xdp_rxq_info_unreg ( & priv -> xdp_rxq );
+    }
+
+    // Frames still in the TX ring will never complete
+    netdev_reset_queue ( ndev );
+
+    // Unhook our handler from the IRQ line
+    free_irq ( ndev -> irq, ndev );
+
+    return 0;
+}
+
+// Close the interface ourselves, to bring it up again with r8139dn_net_reopen (ethtool -G, TX timeout, self-test)
+// Under rtnl. The kernel still believes we are running: keep it away from the rings before we release them
+void r8139dn_net_detach ( struct net_device * ndev )
+{
+    // No more frames from the stack or from ndo_xdp_xmit, and wait for those being sent on other CPUs (TX lock)
+    netif_device_detach ( ndev );
+    netif_tx_disable ( ndev );
+
+    r8139dn_net_close ( ndev );
+}
+
+// Bring the interface up again after r8139dn_net_detach, under rtnl
+// If we can't, the kernel must know we are down: it still believes we are running, and would give us frames
+int r8139dn_net_reopen ( struct net_device * ndev )
+{
+    int err;
+
+    err = r8139dn_net_open ( ndev );
+    if ( err )
+    {
+        netdev_err ( ndev, "Unable to bring the interface back up (%d), shutting it down\n", err );
+        dev_close ( ndev );
+    }
+
+    // Whether we're up or down, the interface is back: the kernel may open it or give us frames again
+    netif_device_attach ( ndev );
+
+    return err;
+}
+
+// Find out whether the link is up, at what speed and duplex, and tell the kernel
+// The MII library compares the PHY link status (BMSR) to our carrier, and resolves the duplex from ANAR and ANLPAR
+// init: report the link state even if it didn't change (ifup)
+static void _r8139dn_net_check_link ( struct net_device * ndev, bool init )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    mii_check_media ( & priv -> mii, netif_msg_link ( priv ), init );
+
+    if ( netif_carrier_ok ( ndev ) )
+    {
+        // Flow control depends on what the link partner can do
+        // The link may have gone down and up again since we last looked: always check
+        r8139dn_net_update_pause ( ndev );
+    }
+    else
+    {
+        WRITE_ONCE ( priv -> pause.tx_active, false );
+    }
+}
+
+// Our IRQ handler saw the link change (INT_LNKCHG_PUN)
+static void _r8139dn_net_link_work ( struct work_struct * work )
+{
+    struct r8139dn_priv * priv = container_of ( work, struct r8139dn_priv, link_work );
+
+    _r8139dn_net_check_link ( pci_get_drvdata ( priv -> pdev ), false );
+}
+
+// Apply our flow control settings to the current link
+// With auto-negotiation, flow control is on if both ends advertised it (symmetric PAUSE), otherwise it is forced
+// Either way, PAUSE frames only exist in full duplex
+void r8139dn_net_update_pause ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_pause * pause = & priv -> pause;
+    u16 bmcr = r8139dn_r16 ( BMCR );
+    u16 adv, lpa;
+    bool full, rx, tx;
+
+    if ( pause -> autoneg && bmcr & BMCR_ANENABLE )
+    {
+        adv = r8139dn_r16 ( ANAR );
+        lpa = r8139dn_r16 ( ANLPAR );
+        full = mii_nway_result ( adv & lpa ) & ( LPA_100FULL | LPA_10FULL );
+        rx = tx = full && adv & ADVERTISE_PAUSE_CAP && lpa & LPA_PAUSE_CAP;
+    }
+    else
+    {
+        full = bmcr & BMCR_FULLDPLX;
+        rx = full && pause -> rx;
+        tx = full && pause -> tx;
+    }
+
+    r8139dn_hw_set_pause ( priv, rx, tx );
+    WRITE_ONCE ( pause -> tx_active, tx );
+
+    if ( netif_msg_link ( priv ) )
+    {
+        netdev_info ( ndev, "Flow control: RX %s, TX %s\n", rx ? "on" : "off", tx ? "on" : "off" );
+    }
+}
+
+// Called when user wants to change the MAC address
+// ip link set address 05:04:03:02:01:00 dev eth0
+static int r8139dn_net_set_mac_addr ( struct net_device * ndev, void * addr )
+{
+    struct sockaddr * mac_sa = addr;
+
+    // If the MAC address is not valid, just stop here
+    if ( ! is_valid_ether_addr ( mac_sa -> sa_data ) )
     {
         return -EADDRNOTAVAIL;
     }
@@ -583,6 +1912,48 @@ static int r8139dn_net_set_mac_addr ( struct net_device * ndev, void * addr )
     return 0;
 }
 
+// Called when the kernel wants us to update our RX filters (with netif_addr_lock held)
+// ip link set promisc on dev eth0
+// ip maddr add 01:00:5e:00:00:01 dev eth0
+// Multicast frames are filtered by the hardware with a 64 bit hash table (MAR0 to MAR7):
+// a frame is accepted if the bit given by the 6 upper bits of the CRC of its destination address is set
+// Several groups may share a bit, the kernel drops the frames we let through by mistake
+static void r8139dn_net_set_rx_mode ( struct net_device * ndev )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct netdev_hw_addr * ha;
+    u32 rx_mode = RCR_APM | RCR_AB;
+    u32 mc [ 2 ] = { 0, 0 };
+    u32 bit;
+
+    if ( ndev -> flags & IFF_PROMISC )
+    {
+        rx_mode |= RCR_AAP | RCR_AM;
+        mc [ 0 ] = mc [ 1 ] = ~ 0;
+    }
+
+    // With that many groups, most of the bits would be set anyway
+    else if ( ndev -> flags & IFF_ALLMULTI || netdev_mc_count ( ndev ) > R8139DN_MC_FILTER_LIMIT )
+    {
+        rx_mode |= RCR_AM;
+        mc [ 0 ] = mc [ 1 ] = ~ 0;
+    }
+
+    else if ( ! netdev_mc_empty ( ndev ) )
+    {
+        rx_mode |= RCR_AM;
+        netdev_for_each_mc_addr ( ha, ndev )
+        {
+            bit = ether_crc ( ETH_ALEN, ha -> addr ) >> 26;
+            mc [ bit >> 5 ] |= 1 << ( bit & 31 );
+        }
+    }
+
+    netdev_dbg ( ndev, "RX mode: %08x, MAR: %08x %08x\n", rx_mode, mc [ 1 ], mc [ 0 ] );
+
+    r8139dn_hw_set_rx_filter ( priv, rx_mode, mc );
+}
+
 // Called when the user wants to change the MTU
 // ip link set mtu 1500 dev eth0
 static int r8139dn_net_set_mtu ( struct net_device * ndev, int mtu )
@@ -597,46 +1968,90 @@ static int r8139dn_net_set_mtu ( struct net_device * ndev, int mtu )
     return 0;
 }
 
+// The kernel calls this when offloads are turned on or off (ethtool -K eth0 rx off rxvlan off)
+// It updates ndev -> features itself once we return 0
+static int r8139dn_net_set_features ( struct net_device * ndev, netdev_features_t features )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    // Internal loopback: while we're up, the transmitter takes the new TCR right away. Otherwise, ifup will
+    if ( ( features ^ ndev -> features ) & NETIF_F_LOOPBACK && netif_running ( ndev ) )
+    {
+        r8139dn_hw_set_loopback ( priv, features & NETIF_F_LOOPBACK );
+    }
+
+    // RTL8139: our TX copy handles everything in software, there is nothing to tell the hardware
+    if ( priv -> cplus )
+    {
+        r8139dn_cp_set_features ( ndev, features );
+    }
+
+    return 0;
+}
+
+// The kernel asks which offloads it can use for this very frame
+// RTL8139: anything we advertised (our copy handles it all). C+ mode: see r8139dn_cp_features_check
+static netdev_features_t r8139dn_net_features_check ( struct sk_buff * skb, struct net_device * ndev,
+                                                      netdev_features_t features )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+
+    // What the kernel checks when we don't implement ndo_features_check
+    features = vlan_features_check ( skb, features );
+
+    if ( priv -> cplus )
+    {
+        features = r8139dn_cp_features_check ( skb, ndev, features );
+    }
+
+    return features;
+}
+
 // Allocate TX DMA memory and initialize TX ring
 static int _r8139dn_net_init_tx_ring ( struct r8139dn_priv * priv )
 {
     void * tx_buffer_cpu;
     dma_addr_t tx_buffer_dma;
-    int i;
 
     // Allocate a DMA buffer so that the hardware and the driver
     // share a common memory for packet transmission.
-    // Later we will pass the tx_buffer_dma address to the hardware
+    // Later we will pass the tx_buffer_dma address (+ slot offset) to the hardware
     tx_buffer_cpu = dma_alloc_coherent ( & ( priv -> pdev -> dev ),
-            R8139DN_TX_DMA_SIZE, & tx_buffer_dma, GFP_KERNEL );
+            R8139DN_TX_DMA_SIZE ( priv -> tx_ring.len ), & tx_buffer_dma, GFP_KERNEL );
 
     if ( ! tx_buffer_cpu )
     {
         return -ENOMEM;
     }
 
-    // Initialize the TX ring
-    // cpu and hw fields are reset by r8139dn_hw_reset
-    priv -> tx_ring.dma = tx_buffer_dma;
-    for ( i = 0; i < R8139DN_TX_DESC_NB ; ++i )
+    // The slots bookkeeping is never read by the hardware: regular memory is fine
+    priv -> tx_ring.slots = kcalloc ( priv -> tx_ring.len, sizeof ( * priv -> tx_ring.slots ), GFP_KERNEL );
+    if ( ! priv -> tx_ring.slots )
     {
-        // Initialize our index of TX buffers addresses
-        priv -> tx_ring.data [ i ] = tx_buffer_cpu + i * R8139DN_TX_DESC_SIZE;
+        dma_free_coherent ( & ( priv -> pdev -> dev ), R8139DN_TX_DMA_SIZE ( priv -> tx_ring.len ),
+                tx_buffer_cpu, tx_buffer_dma );
+        return -ENOMEM;
     }
 
+    // Initialize the TX ring
+    // cpu, sent and hw fields are reset by r8139dn_hw_reset
+    priv -> tx_ring.dma = tx_buffer_dma;
+    priv -> tx_ring.data = tx_buffer_cpu;
+
     return 0;
 }
 
 // Allocate RX DMA memory and initialize RX ring
 static int _r8139dn_net_init_rx_ring ( struct r8139dn_priv * priv )
 {
+    struct page_pool_params pp_params = { };
     void * rx_buffer_cpu;
     dma_addr_t rx_buffer_dma;
 
     // Allocate a DMA buffer so that hardware and driver share a common memory
     // for packet reception. Later we'll pass the rx_buffer_dma address to the hardware
     rx_buffer_cpu = dma_alloc_coherent ( & ( priv -> pdev -> dev ),
-            R8139DN_RX_DMA_SIZE, & rx_buffer_dma, GFP_KERNEL );
+            R8139DN_RX_DMA_SIZE ( priv -> rx_ring.len ), & rx_buffer_dma, GFP_KERNEL );
 
     if ( ! rx_buffer_cpu )
     {
@@ -646,6 +2061,22 @@ static int _r8139dn_net_init_rx_ring ( struct r8139dn_priv * priv )
     priv -> rx_ring.dma = rx_buffer_dma;
     priv -> rx_ring.data = rx_buffer_cpu;
 
+    // Pages for the frames above rx-copybreak. We copy the frames to them, the hardware never sees them:
+    // no DMA mapping. Each frame takes a fragment of a page (PP_FLAG_PAGE_FRAG), sized to the frame
+    // A page comes back to the pool when the kernel is done with the sk_buffs of all its fragments
+    pp_params.flags = PP_FLAG_PAGE_FRAG;
+    pp_params.order = 0;
+    pp_params.pool_size = R8139DN_RX_POOL_SIZE;
+    pp_params.nid = dev_to_node ( & ( priv -> pdev -> dev ) );
+    pp_params.dev = & ( priv -> pdev -> dev );
+
+    priv -> rx_ring.pool = page_pool_create ( & pp_params );
+    if ( IS_ERR ( priv -> rx_ring.pool ) )
+    {
+        priv -> rx_ring.pool = NULL;
+        return -ENOMEM;
+    }
+
     // When alloc_etherdev is called, our priv data struct is zeroed (kzalloc)
     // However we still need to reset this field (multiple ifup/ifdown)
     priv -> rx_ring.cpu = 0;
@@ -653,20 +2084,95 @@ static int _r8139dn_net_init_rx_ring ( struct r8139dn_priv * priv )
     return 0;
 }
 
+// Zero-copy TX: map the sk_buff so that the hardware can read it directly from TX slot i
+// This is only possible when the hardware can send the sk_buff data as is:
+// it can't pad frames, gather fragments or compute checksums, and it needs a 32 bit aligned buffer
+// Returns false if the frame has to be copied
+static bool _r8139dn_net_tx_map ( struct r8139dn_priv * priv, struct sk_buff * skb, int i )
+{
+    struct r8139dn_tx_ring * ring = & priv -> tx_ring;
+    struct device * dev = & priv -> pdev -> dev;
+    dma_addr_t dma;
+
+    if ( skb -> len < ETH_ZLEN || skb_is_nonlinear ( skb ) || skb -> ip_summed == CHECKSUM_PARTIAL ||
+         ! IS_ALIGNED ( ( unsigned long ) skb -> data, 4 ) )
+    {
+        return false;
+    }
+
+    dma = dma_map_single ( dev, skb -> data, skb -> len, DMA_TO_DEVICE );
+    if ( dma_mapping_error ( dev, dma ) )
+    {
+        return false;
+    }
+
+    // The mapping may have bounced the data somewhere else (swiotlb)
+    if ( ! IS_ALIGNED ( dma, 4 ) )
+    {
+        dma_unmap_single ( dev, dma, skb -> len, DMA_TO_DEVICE );
+        return false;
+    }
+
+    // _r8139dn_net_tx_kick will point the descriptor to the sk_buff rather than to our own buffer
+    ring -> slots [ i ].skb = skb;
+    ring -> slots [ i ].skb_dma = dma;
+
+    return true;
+}
+
+// Zero-copy TX: the hardware doesn't need the sk_buff of TX slot i anymore
+// Unmap it, and return it: the caller is responsible for freeing it
+static struct sk_buff * _r8139dn_net_tx_unmap ( struct r8139dn_priv * priv, int i )
+{
+    struct r8139dn_tx_slot * slot = & priv -> tx_ring.slots [ i ];
+    struct sk_buff * skb = slot -> skb;
+
+    dma_unmap_single ( & ( priv -> pdev -> dev ), slot -> skb_dma, skb -> len, DMA_TO_DEVICE );
+    slot -> skb = NULL;
+
+    return skb;
+}
+
 // Free all allocated DMA Memory (TX/RX)
 static void _r8139dn_net_release_rings ( struct r8139dn_priv * priv )
 {
+    u32 i;
+
+    // Release the zero-copy frames the hardware will never send
+    if ( priv -> tx_ring.slots )
+    {
+        for ( i = 0; i < priv -> tx_ring.len ; ++i )
+        {
+            if ( priv -> tx_ring.slots [ i ].skb )
+            {
+                dev_kfree_skb ( _r8139dn_net_tx_unmap ( priv, i ) );
+            }
+        }
+
+        kfree ( priv -> tx_ring.slots );
+        priv -> tx_ring.slots = NULL;
+    }
+
     // Free TX DMA memory
-    if ( priv -> tx_ring.data [ 0 ] )
+    if ( priv -> tx_ring.data )
     {
-        dma_free_coherent ( & ( priv -> pdev -> dev ), R8139DN_TX_DMA_SIZE,
-                priv -> tx_ring.data [ 0 ], priv -> tx_ring.dma );
+        dma_free_coherent ( & ( priv -> pdev -> dev ), R8139DN_TX_DMA_SIZE ( priv -> tx_ring.len ),
+                priv -> tx_ring.data, priv -> tx_ring.dma );
+        priv -> tx_ring.data = NULL;
     }
 
     // Free RX DMA Memory
     if ( priv -> rx_ring.data )
     {
-        dma_free_coherent ( & ( priv -> pdev -> dev ), R8139DN_RX_DMA_SIZE,
+        dma_free_coherent ( & ( priv -> pdev -> dev ), R8139DN_RX_DMA_SIZE ( priv -> rx_ring.len ),
                 priv -> rx_ring.data, priv -> rx_ring.dma );
+        priv -> rx_ring.data = NULL;
+    }
+
+    // Pages still used by sk_buffs go back to the page allocator when the kernel is done with them
+    if ( priv -> rx_ring.pool )
+    {
+        page_pool_destroy ( priv -> rx_ring.pool );
+        priv -> rx_ring.pool = NULL;
     }
 }
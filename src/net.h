@@ -2,10 +2,17 @@
 #define _R8139DN_NET_H
 
 #include "hw.h"
+#include "stats.h"
+#include "debugfs.h"
+#include "cp.h"
 
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/pci.h>
+#include <linux/dim.h>
+#include <linux/mii.h>
+#include <net/xdp.h>
+#include <net/page_pool.h>
 
 // r8139dn_priv is a struct we can always fetch from the network device
 // We can store anything that makes our life easier.
@@ -18,18 +25,77 @@ struct r8139dn_priv
     // Interrupts we are interested in
     u16 interrupts;
 
+    // Interrupts we are interested in, but which are temporarily masked in IMR
+    // (e.g. RX interrupts while NAPI is polling the RX ring)
+    u16 masked;
+
+    // Protects IMR and the masked field above
+    spinlock_t lock;
+
+    // r8139dn_net_open succeeded and r8139dn_net_close hasn't run since (rtnl)
+    // When we fail to reopen ourselves, the kernel still calls r8139dn_net_close once more: there is nothing to undo then
+    bool up;
+
+    // NAPI context: RX homework is done in softirq context by our poll function
+    struct napi_struct napi;
+
+    // Interrupt coalescing (ethtool -C), built on the general purpose timer (TCTR / TIMERINT)
+    // While the timer is armed, INT_ROK and/or INT_TOK are masked:
+    // a single INT_TIMEOUT will then complete the whole batch of frames
+    struct r8139dn_coalesce
+    {
+        u32 rx_usecs;       // How long to wait for more frames before processing an RX batch (0: off)
+        u32 rx_frames;      // RX moderation stays on while batches are at least this big
+        u32 tx_usecs;       // How long to wait for more TX completions before reclaiming (0: off)
+        bool adaptive_rx;   // Let net_dim choose rx_usecs according to the traffic
+
+        u16 waiting;        // Interrupts (INT_ROK / INT_TOK) waiting for the timer, protected by lock
+        u32 rx_batch;       // Frames processed since NAPI got scheduled
+        u16 dim_events;     // Number of NAPI completions, fed to net_dim
+        u64 dim_packets;    // Frames received, fed to net_dim
+        u64 dim_bytes;      // Bytes received, fed to net_dim
+        struct dim dim;
+    } coal;
+
+    // The hardware only has 4 TX descriptors. To keep the wire busy, start_xmit stages frames
+    // in a much deeper ring of slots, and we point the descriptors to the next staged slots as they complete
+    // We always hand slots to the hardware in order: slot i is always sent by descriptor i % 4
     struct r8139dn_tx_ring
     {
-        // Index of the ring's buffers addresses (in CPU virtual kernel memory space)
-        void * data [ R8139DN_TX_DESC_NB ];
+        // The slots buffers (in CPU virtual kernel memory space), slot i is at data + i * R8139DN_TX_DESC_SIZE
+        void * data;
 
         // Address hardware has to use in Bus Address Space to access our data buffers above
         dma_addr_t dma;
 
-        // These are the position of the CPU and of the hardware
-        // Position of the CPU is the next buffer we are going to write to
-        // Position of the hardware is the first un-acknowledged buffer (buffer we cannot write to)
-        int cpu, hw;
+        // Number of slots (power of 2). Can only change while the interface is down
+        u32 len;
+
+        struct r8139dn_tx_slot
+        {
+            // Zero-copy: frame the hardware reads right from the sk_buff, rather than from our buffer above
+            // NULL when the frame has been copied to our buffer
+            struct sk_buff * skb;
+            dma_addr_t skb_dma;
+
+            // Length of the frame (with padding)
+            u16 len;
+
+            // When start_xmit staged the frame (ns), for the TX latency histogram. 0 if not measured
+            u64 queued;
+        } * slots;
+
+        // Frames smaller than this are always copied (ethtool --set-tunable tx-copybreak)
+        u32 copybreak;
+
+        // These are the position of the CPU, of the staged frames and of the hardware
+        // Position of the CPU is the next slot we are going to write to
+        // Position of the staged frames is the next slot to hand to a hardware descriptor (protected by lock)
+        // Position of the hardware is the first un-acknowledged slot (slot we cannot write to)
+        int cpu, sent, hw;
+
+        // Both start_xmit and the TX IRQ handler hand staged slots to the hardware
+        spinlock_t lock;
     } tx_ring;
 
     struct r8139dn_rx_ring
@@ -37,14 +103,101 @@ struct r8139dn_priv
         unsigned char * data;
         dma_addr_t dma;
 
+        // Size of the ring (power of 2, from 8K to 64K). Can only change while the interface is down
+        u32 len;
+
         u16 cpu;
+
+        // The IRQ handler saw INT_RXOVW: the RX ring is full, our poll function must resync with the hardware
+        bool overflow;
+
+        // Frames bigger than this are copied to pages of the pool rather than to small sk_buffs
+        // (ethtool --set-tunable rx-copybreak)
+        u32 copybreak;
+        struct page_pool * pool;
     } rx_ring;
 
+    // RTL8139C+: the C+ mode engine (cp.c) takes the place of the TX and RX rings above
+    // Chosen at probe time, never changes afterwards
+    bool cplus;
+    struct r8139dn_cp cp;
+
+    // XDP program run on every frame of the RX ring (NULL: none), replaced with xchg
+    struct bpf_prog * xdp_prog;
+    struct xdp_rxq_info xdp_rxq;
+
+    // TX watchdog: the kernel found our TX queue stopped for too long (ndo_tx_timeout)
+    // The recovery has to sleep: it is done by this work, under rtnl
+    struct r8139dn_tx_timeout
+    {
+        struct work_struct work;
+
+        // Hardware position when we last restarted the transmitter (-1: not restarted since ifup)
+        // If it hasn't moved by the next timeout, restarting the transmitter is not enough
+        int restarted_at;
+    } tx_timeout;
+
+    // Adaptive FIFO tuning, driven by TX underruns (TSD_TUN) and RX FIFO overflows (INT_FOVW)
+    // Only the TX / RX IRQ handlers update it. The learned settings survive ifdown / ifup:
+    // what they depend on is how fast the PCI chipset serves our DMA, not the traffic
+    struct r8139dn_fifo
+    {
+        bool adaptive;          // ethtool --set-priv-flags eth0 adaptive-fifo on|off (off freezes the settings)
+        u8 ertxth;              // TX early threshold, in 32 bytes units (TSD_ERTXTH)
+        u32 tcr;                // TX DMA burst (TCR_MXDMA)
+        u32 rcr;                // RX FIFO threshold and DMA burst (RCR_RXFTH | RCR_MXDMA)
+        u32 tx_clean;           // Frames sent without underrun since the last TX adjustment
+        unsigned long rx_next;  // No RX adjustment before this time (jiffies)
+
+        // Number of adjustments (ethtool -S)
+        u32 tx_raised;
+        u32 tx_lowered;
+        u32 rx_tuned;
+    } fifo;
+
+    // Copy of the EEPROM, read once at probe time, in CPU byte order (ethtool -e)
+    u16 eeprom [ R8139DN_EEPROM_WORDS ];
+
+    // Our built-in PHY, for the generic MII library (link state, speed, duplex, ethtool link settings)
+    struct mii_if_info mii;
+
+    // Link changes are handled out of the IRQ handler, by this work
+    struct work_struct link_work;
+
+    // IEEE 802.3x flow control (ethtool -a / -A)
+    struct r8139dn_pause
+    {
+        bool autoneg;       // Let the auto-negotiation decide (we advertise rx && tx), rather than forcing rx and tx
+        bool rx;            // Hold off when the link partner asks us to
+        bool tx;            // Ask the link partner to hold off when we can't keep up
+        bool tx_active;     // TX flow control is in effect on the current link (read by our poll function)
+        bool xoff;          // We asked the link partner to hold off and haven't released it yet (NAPI only)
+        bool retry;         // A PAUSE frame is due but our TX ring was full: NAPI keeps polling (NAPI only)
+    } pause;
+
+    // Statistics (ip -s link, ethtool -S)
+    struct r8139dn_pcpu_stats __percpu * stats;
+    struct r8139dn_hw_stats hw_stats;
+
+    // Histograms (debugfs), only fed while hist_enable is set
+    struct dentry * debugfs;
+    struct r8139dn_hists __percpu * hists;
+    bool hist_enable;
+
+    // TCR and RCR are also updated by the FIFO tuning, under lock
     u32 tcr;
+    u32 rcr;
+
+    // Flags of every TSD write (early TX threshold). Updated by the FIFO tuning, read with READ_ONCE
     u32 tx_flags;
 };
 
 int r8139dn_net_init ( struct pci_dev * pdev, void __iomem * mmio );
+int r8139dn_net_open ( struct net_device * ndev );
+int r8139dn_net_close ( struct net_device * ndev );
+void r8139dn_net_detach ( struct net_device * ndev );
+int r8139dn_net_reopen ( struct net_device * ndev );
+void r8139dn_net_update_pause ( struct net_device * ndev );
 
 #define R8139DN_MSG_ENABLE \
     (NETIF_MSG_DRV       | \
@@ -24,6 +24,9 @@ struct pci_driver r8139dn_pci_driver =
     .id_table = r8139dn_pci_id_table,
     .probe = r8139dn_pci_probe,
     .remove = r8139dn_pci_remove,
+
+    // Nothing depends on us being probed before the next device: let the kernel probe us in parallel
+    .driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 };
 
 // r8139dn_pci_probe is called by the kernel when the device we want
@@ -84,7 +87,8 @@ int r8139dn_pci_probe ( struct pci_dev * pdev, const struct pci_device_id * id )
     // Get the chipset version, display it, and cancel the probe if we don't support it
     version = ioread32 ( mmio + TCR ) & TCR_HWVERID_MASK;
     dev_info ( dev, "Chipset detected: %s (rev %x)\n", r8139dn_hw_version_str ( version ), pdev -> revision );
-    if ( version != RTL8100B_8139D )
+    // The RTL8139C+ gets its own datapath (C+ mode descriptor rings, see cp.c)
+    if ( version != RTL8100B_8139D && version != RTL8139CP )
     {
         dev_err ( dev, "Sorry, this chipset is not supported yet. :(\n" );
         err = -ENODEV;
@@ -131,6 +135,12 @@ void r8139dn_pci_remove ( struct pci_dev * pdev )
     // Tell the kernel our eth interface doesn't exist anymore (will disappear from ifconfig -a)
     unregister_netdev ( ndev );
 
+    // The TX watchdog may have scheduled its recovery right before the interface went down
+    cancel_work_sync ( & priv -> tx_timeout.work );
+
+    // Remove our debugfs directory, before our private data goes away
+    r8139dn_debugfs_release ( priv );
+
     // Disable DMA by clearing master bit in PCI_COMMAND register
     pci_clear_master ( pdev );
 
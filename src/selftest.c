@@ -0,0 +1,289 @@
+#include "common.h"
+#include "selftest.h"
+#include "net.h"
+
+#include <linux/etherdevice.h>  // ether_addr_copy, ether_addr_equal
+#include <linux/completion.h>
+#include <linux/delay.h>        // usleep_range
+#include <linux/math64.h>       // div64_u64
+
+static int _r8139dn_selftest_loopback ( struct net_device * ndev, u64 * data );
+static struct sk_buff * _r8139dn_selftest_build ( struct net_device * ndev, u32 seq );
+static int _r8139dn_selftest_rcv ( struct sk_buff * skb, struct net_device * ndev, struct packet_type * pt,
+                                   struct net_device * orig_ndev );
+
+const char r8139dn_selftest_str [ R8139DN_TEST_NB ] [ ETH_GSTRING_LEN ] =
+{
+    [ R8139DN_TEST_REGS ] = "Register test     (offline)",
+    [ R8139DN_TEST_EEPROM ] = "EEPROM test       (on/offline)",
+    [ R8139DN_TEST_LOOPBACK ] = "Loopback test     (offline)",
+    [ R8139DN_TEST_LOOPBACK_PPS ] = "Loopback pps      (offline)",
+    [ R8139DN_TEST_LOOPBACK_MBPS ] = "Loopback Mbit/s   (offline)",
+};
+
+// Our loopback frames: to ourselves, from ourselves, with the local experimental EtherType
+// Then this header, and a pattern depending on the sequence number up to the end
+struct r8139dn_selftest_hdr
+{
+    __be32 magic;
+    __be32 seq;
+} __packed;
+
+#define R8139DN_TEST_MAGIC 0x8139d7e5
+
+// A loopback burst, shared with our packet handler (softirq)
+struct r8139dn_selftest
+{
+    struct packet_type pt;
+    struct completion done;
+
+    // Only our packet handler updates them, until done
+    u32 frames;     // Frames that came back
+    u32 bad;        // ... not exactly as we sent them, or out of order
+    u64 bytes;
+    u64 last_ns;    // When the last one came back
+};
+
+// Sizes go through the whole range, 60 to 1514 bytes (without FCS): DMA gets to see every length and alignment
+static inline unsigned int _r8139dn_selftest_size ( u32 seq )
+{
+    return ETH_ZLEN + ( seq * 97 ) % ( ETH_FRAME_LEN - ETH_ZLEN + 1 );
+}
+
+static inline u8 _r8139dn_selftest_pattern ( u32 seq, unsigned int offset )
+{
+    return seq + offset;
+}
+
+// ethtool -t eth0 [offline]
+// Online, traffic goes on: only our copy of the EEPROM is checked
+// Offline, the interface goes down for the time of the tests (if it was up): registers, EEPROM read again,
+// then a burst of frames through the internal loopback, checked byte for byte, which also tells how fast the card moves them
+void r8139dn_selftest_run ( struct net_device * ndev, struct ethtool_test * test, u64 * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    bool offline = test -> flags & ETH_TEST_FL_OFFLINE;
+    bool running = netif_running ( ndev );
+
+    memset ( data, 0, R8139DN_TEST_NB * sizeof ( * data ) );
+
+    if ( ! offline )
+    {
+        data [ R8139DN_TEST_EEPROM ] = !! r8139dn_hw_test_eeprom ( priv, false );
+        goto selftest_done;
+    }
+
+    // The stack won't give us frames until we're done (closing does nothing if the interface was down)
+    r8139dn_net_detach ( ndev );
+
+    // Both need a stopped chip
+    data [ R8139DN_TEST_EEPROM ] = !! r8139dn_hw_test_eeprom ( priv, true );
+    data [ R8139DN_TEST_REGS ] = r8139dn_hw_reset ( priv ) || r8139dn_hw_test_regs ( priv );
+
+    data [ R8139DN_TEST_LOOPBACK ] = !! _r8139dn_selftest_loopback ( ndev, data );
+
+    // If it doesn't come back up, r8139dn_net_reopen shuts it down
+    if ( ! running )
+    {
+        netif_device_attach ( ndev );
+    }
+    else if ( r8139dn_net_reopen ( ndev ) )
+    {
+        test -> flags |= ETH_TEST_FL_FAILED;
+    }
+
+selftest_done:
+    if ( data [ R8139DN_TEST_REGS ] || data [ R8139DN_TEST_EEPROM ] || data [ R8139DN_TEST_LOOPBACK ] )
+    {
+        test -> flags |= ETH_TEST_FL_FAILED;
+    }
+}
+
+// Bring the interface up in loopback mode, send our burst, and check every frame coming back from the RX ring (or rings)
+// We hand the frames to our start_xmit ourselves: the stack would drop them while the interface is down
+static int _r8139dn_selftest_loopback ( struct net_device * ndev, u64 * data )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_selftest st =
+    {
+        .pt =
+        {
+            .type = htons ( ETH_P_802_EX1 ),
+            .dev = ndev,
+            .func = _r8139dn_selftest_rcv,
+        },
+    };
+    struct sk_buff * skb;
+    unsigned long timeout;
+    netdev_tx_t ret;
+    u64 start;
+    u32 seq;
+    int err;
+
+    init_completion ( & st.done );
+
+    err = r8139dn_net_open ( ndev );
+    if ( err )
+    {
+        return err;
+    }
+    r8139dn_hw_set_loopback ( priv, true );
+
+    // Frames with our EtherType, received on our interface, go to _r8139dn_selftest_rcv
+    dev_add_pack ( & st.pt );
+
+    start = ktime_get_ns ( );
+    for ( seq = 0 ; seq < R8139DN_TEST_FRAMES ; ++seq )
+    {
+        skb = _r8139dn_selftest_build ( ndev, seq );
+        if ( ! skb )
+        {
+            err = -ENOMEM;
+            goto loopback_done;
+        }
+
+        // Like the stack: wait for room in our TX queue, and only then hand the frame over
+        timeout = jiffies + R8139DN_TEST_TIMEOUT;
+        for ( ;; )
+        {
+            netif_tx_lock_bh ( ndev );
+            ret = netif_queue_stopped ( ndev ) ? NETDEV_TX_BUSY : ndev -> netdev_ops -> ndo_start_xmit ( skb, ndev );
+            netif_tx_unlock_bh ( ndev );
+
+            if ( ret == NETDEV_TX_OK )
+            {
+                break;
+            }
+
+            if ( time_after ( jiffies, timeout ) )
+            {
+                kfree_skb ( skb );
+                err = -ETIMEDOUT;
+                goto loopback_done;
+            }
+
+            usleep_range ( 10, 100 );
+        }
+    }
+
+    if ( ! wait_for_completion_timeout ( & st.done, R8139DN_TEST_TIMEOUT ) )
+    {
+        err = -ETIMEDOUT;
+    }
+
+loopback_done:
+    // Once removed, our packet handler won't run anymore (dev_remove_pack waits for it)
+    // Stop the queue before releasing the rings: wait for a start_xmit that may still be running
+    dev_remove_pack ( & st.pt );
+    netif_tx_disable ( ndev );
+    r8139dn_net_close ( ndev );
+
+    if ( st.frames && st.last_ns > start )
+    {
+        data [ R8139DN_TEST_LOOPBACK_PPS ] = div64_u64 ( ( u64 ) st.frames * NSEC_PER_SEC, st.last_ns - start );
+        data [ R8139DN_TEST_LOOPBACK_MBPS ] = div64_u64 ( st.bytes * 8 * 1000, st.last_ns - start );
+    }
+
+    if ( netif_msg_hw ( priv ) )
+    {
+        netdev_info ( ndev, "Loopback: %u/%u frames back, %u bad\n", st.frames, R8139DN_TEST_FRAMES, st.bad );
+    }
+
+    if ( ! err && st.bad )
+    {
+        err = -EIO;
+    }
+
+    return err;
+}
+
+// Loopback frame number seq
+static struct sk_buff * _r8139dn_selftest_build ( struct net_device * ndev, u32 seq )
+{
+    unsigned int len = _r8139dn_selftest_size ( seq );
+    struct r8139dn_selftest_hdr * hdr;
+    struct sk_buff * skb;
+    struct ethhdr * eth;
+    unsigned int i;
+    u8 * data;
+
+    skb = netdev_alloc_skb ( ndev, len );
+    if ( ! skb )
+    {
+        return NULL;
+    }
+
+    data = skb_put ( skb, len );
+    eth = ( struct ethhdr * ) data;
+    ether_addr_copy ( eth -> h_dest, ndev -> dev_addr );
+    ether_addr_copy ( eth -> h_source, ndev -> dev_addr );
+    eth -> h_proto = htons ( ETH_P_802_EX1 );
+
+    hdr = ( struct r8139dn_selftest_hdr * ) ( eth + 1 );
+    hdr -> magic = htonl ( R8139DN_TEST_MAGIC );
+    hdr -> seq = htonl ( seq );
+
+    for ( i = ETH_HLEN + sizeof ( * hdr ) ; i < len ; ++i )
+    {
+        data [ i ] = _r8139dn_selftest_pattern ( seq, i );
+    }
+
+    skb -> protocol = eth -> h_proto;
+
+    return skb;
+}
+
+// A frame with our EtherType came in (softirq). Other frames with it (somebody else's) are ignored
+// eth_type_trans pulled the Ethernet header: offsets in the frame are ETH_HLEN more than in skb -> data
+static int _r8139dn_selftest_rcv ( struct sk_buff * skb, struct net_device * ndev, struct packet_type * pt,
+                                   struct net_device * orig_ndev )
+{
+    struct r8139dn_selftest * st = container_of ( pt, struct r8139dn_selftest, pt );
+    unsigned int len = skb -> len + ETH_HLEN;
+    struct r8139dn_selftest_hdr _hdr;
+    const struct r8139dn_selftest_hdr * hdr;
+    const struct ethhdr * eth = eth_hdr ( skb );
+    u8 buf [ 64 ];
+    const u8 * p;
+    unsigned int off, i, n;
+    bool good;
+    u32 seq;
+
+    hdr = skb_header_pointer ( skb, 0, sizeof ( _hdr ), & _hdr );
+    if ( ! hdr || hdr -> magic != htonl ( R8139DN_TEST_MAGIC ) || st -> frames == R8139DN_TEST_FRAMES )
+    {
+        goto rcv_done;
+    }
+
+    // The loopback keeps them in order
+    seq = ntohl ( hdr -> seq );
+    good = seq == st -> frames && len == _r8139dn_selftest_size ( seq ) &&
+           ether_addr_equal ( eth -> h_dest, ndev -> dev_addr ) && ether_addr_equal ( eth -> h_source, ndev -> dev_addr );
+
+    // The payload may not all be in the linear part: go through it in chunks
+    for ( off = sizeof ( * hdr ) ; good && off < skb -> len ; off += n )
+    {
+        n = min_t ( unsigned int, skb -> len - off, sizeof ( buf ) );
+        p = skb_header_pointer ( skb, off, n, buf );
+        for ( i = 0 ; p && i < n && p [ i ] == _r8139dn_selftest_pattern ( seq, ETH_HLEN + off + i ) ; ++i );
+        good = p && i == n;
+    }
+
+    if ( ! good )
+    {
+        st -> bad++;
+    }
+
+    st -> frames++;
+    st -> bytes += len;
+    st -> last_ns = ktime_get_ns ( );
+
+    if ( st -> frames == R8139DN_TEST_FRAMES )
+    {
+        complete ( & st -> done );
+    }
+
+rcv_done:
+    consume_skb ( skb );
+    return NET_RX_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#ifndef _R8139DN_SELFTEST_H
+#define _R8139DN_SELFTEST_H
+
+#include <linux/ethtool.h>
+#include <linux/netdevice.h>
+
+// Our self-tests (ethtool -t eth0 [offline]), in the order ethtool shows their results
+// 0 means passed. The loopback pps and Mbit/s are not results: they tell how fast the loopback burst went
+enum r8139dn_test
+{
+    R8139DN_TEST_REGS,
+    R8139DN_TEST_EEPROM,
+    R8139DN_TEST_LOOPBACK,
+    R8139DN_TEST_LOOPBACK_PPS,
+    R8139DN_TEST_LOOPBACK_MBPS,
+    R8139DN_TEST_NB
+};
+
+// Loopback burst: how many frames we send, and how long we wait for room in the TX queue or for the last frame
+#define R8139DN_TEST_FRAMES 1000
+#define R8139DN_TEST_TIMEOUT HZ
+
+extern const char r8139dn_selftest_str [ R8139DN_TEST_NB ] [ ETH_GSTRING_LEN ];
+
+void r8139dn_selftest_run ( struct net_device * ndev, struct ethtool_test * test, u64 * data );
+
+#endif
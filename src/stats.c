@@ -0,0 +1,182 @@
+#include "common.h"
+#include "stats.h"
+#include "net.h"
+
+static void _r8139dn_stats_harvest ( struct r8139dn_priv * priv );
+static void _r8139dn_stats_work ( struct work_struct * work );
+
+// Width of each hardware counter, they wrap around
+static const u32 r8139dn_hw_stats_mask [ R8139DN_HW_STAT_NB ] =
+{
+    [ R8139DN_HW_MISSED ] = 0xffffff,
+    [ R8139DN_HW_RX_ERRORS ] = 0xffff,
+    [ R8139DN_HW_FALSE_CARRIER ] = 0xffff,
+    [ R8139DN_HW_DISCONNECTS ] = 0xffff,
+};
+
+// Allocate the per-CPU counters. They are released along with the PCI device
+int r8139dn_stats_init ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_pcpu_stats * stats;
+    int cpu;
+
+    priv -> stats = devm_alloc_percpu ( & ( priv -> pdev -> dev ), struct r8139dn_pcpu_stats );
+    if ( ! priv -> stats )
+    {
+        return -ENOMEM;
+    }
+
+    for_each_possible_cpu ( cpu )
+    {
+        stats = per_cpu_ptr ( priv -> stats, cpu );
+        u64_stats_init ( & stats -> rx_syncp );
+        u64_stats_init ( & stats -> irq_syncp );
+    }
+
+    u64_stats_init ( & priv -> hw_stats.syncp );
+    INIT_DELAYED_WORK ( & priv -> hw_stats.work, _r8139dn_stats_work );
+
+    return 0;
+}
+
+// Read the raw hardware counters
+static void _r8139dn_stats_read_hw ( struct r8139dn_priv * priv, u32 * raw )
+{
+    raw [ R8139DN_HW_MISSED ] = r8139dn_r32 ( MPC ) & r8139dn_hw_stats_mask [ R8139DN_HW_MISSED ];
+    raw [ R8139DN_HW_RX_ERRORS ] = r8139dn_r16 ( RXERCNT );
+    raw [ R8139DN_HW_FALSE_CARRIER ] = r8139dn_r16 ( FCSC );
+    raw [ R8139DN_HW_DISCONNECTS ] = r8139dn_r16 ( DIS );
+}
+
+// Interface is going up: whatever the hardware counters hold now (a reset may or may not clear them)
+// is where we start counting from. Then harvest them periodically
+void r8139dn_stats_start ( struct r8139dn_priv * priv )
+{
+    _r8139dn_stats_read_hw ( priv, priv -> hw_stats.last );
+    schedule_delayed_work ( & priv -> hw_stats.work, R8139DN_HW_STATS_PERIOD );
+}
+
+// Interface is going down: stop harvesting, and collect what the hardware counted since last time
+void r8139dn_stats_stop ( struct r8139dn_priv * priv )
+{
+    cancel_delayed_work_sync ( & priv -> hw_stats.work );
+    _r8139dn_stats_harvest ( priv );
+}
+
+// Accumulate what the hardware counters gained since we last read them
+// We don't clear them: events happening between our read and our write would be lost
+// Instead, the unsigned difference (modulo the counter width) survives a wrap around
+static void _r8139dn_stats_harvest ( struct r8139dn_priv * priv )
+{
+    struct r8139dn_hw_stats * hw_stats = & priv -> hw_stats;
+    u32 raw [ R8139DN_HW_STAT_NB ];
+    int i;
+
+    _r8139dn_stats_read_hw ( priv, raw );
+
+    u64_stats_update_begin ( & hw_stats -> syncp );
+    for ( i = 0; i < R8139DN_HW_STAT_NB ; ++i )
+    {
+        u64_stats_add ( & hw_stats -> total [ i ], ( raw [ i ] - hw_stats -> last [ i ] ) & r8139dn_hw_stats_mask [ i ] );
+        hw_stats -> last [ i ] = raw [ i ];
+    }
+    u64_stats_update_end ( & hw_stats -> syncp );
+}
+
+static void _r8139dn_stats_work ( struct work_struct * work )
+{
+    struct r8139dn_priv * priv = container_of ( work, struct r8139dn_priv, hw_stats.work.work );
+
+    _r8139dn_stats_harvest ( priv );
+    schedule_delayed_work ( & priv -> hw_stats.work, R8139DN_HW_STATS_PERIOD );
+}
+
+// Sum the counters of all the CPUs
+// Each group is read consistently (even on 32 bit CPUs): we retry if a writer was updating it meanwhile
+void r8139dn_stats_fold ( struct r8139dn_priv * priv, struct r8139dn_stats * sum )
+{
+    struct r8139dn_pcpu_stats * stats;
+    struct r8139dn_hw_stats * hw_stats = & priv -> hw_stats;
+    u64 rx [ R8139DN_RX_STAT_NB ];
+    u64 irq [ R8139DN_IRQ_STAT_NB ];
+    unsigned int start;
+    int cpu, i;
+
+    memset ( sum, 0, sizeof ( * sum ) );
+
+    for_each_possible_cpu ( cpu )
+    {
+        stats = per_cpu_ptr ( priv -> stats, cpu );
+
+        do
+        {
+            start = u64_stats_fetch_begin_irq ( & stats -> rx_syncp );
+            for ( i = 0; i < R8139DN_RX_STAT_NB ; ++i )
+            {
+                rx [ i ] = u64_stats_read ( & stats -> rx [ i ] );
+            }
+        } while ( u64_stats_fetch_retry_irq ( & stats -> rx_syncp, start ) );
+
+        do
+        {
+            start = u64_stats_fetch_begin_irq ( & stats -> irq_syncp );
+            for ( i = 0; i < R8139DN_IRQ_STAT_NB ; ++i )
+            {
+                irq [ i ] = u64_stats_read ( & stats -> irq [ i ] );
+            }
+        } while ( u64_stats_fetch_retry_irq ( & stats -> irq_syncp, start ) );
+
+        for ( i = 0; i < R8139DN_RX_STAT_NB ; ++i )
+        {
+            sum -> rx [ i ] += rx [ i ];
+        }
+
+        for ( i = 0; i < R8139DN_IRQ_STAT_NB ; ++i )
+        {
+            sum -> irq [ i ] += irq [ i ];
+        }
+    }
+
+    do
+    {
+        start = u64_stats_fetch_begin_irq ( & hw_stats -> syncp );
+        for ( i = 0; i < R8139DN_HW_STAT_NB ; ++i )
+        {
+            sum -> hw [ i ] = u64_stats_read ( & hw_stats -> total [ i ] );
+        }
+    } while ( u64_stats_fetch_retry_irq ( & hw_stats -> syncp, start ) );
+}
+
+// ip -s link show dev eth0
+// The kernel calls this whenever it needs our statistics. It may do so from any context, and concurrently
+void r8139dn_stats_get64 ( struct net_device * ndev, struct rtnl_link_stats64 * s )
+{
+    struct r8139dn_priv * priv = netdev_priv ( ndev );
+    struct r8139dn_stats sum;
+
+    r8139dn_stats_fold ( priv, & sum );
+
+    s -> rx_packets = sum.rx [ R8139DN_RX_PACKETS ];
+    s -> rx_bytes = sum.rx [ R8139DN_RX_BYTES ];
+    s -> rx_dropped = sum.rx [ R8139DN_RX_ALLOC_FAILED ];
+    s -> rx_crc_errors = sum.rx [ R8139DN_RX_CRC_ERRORS ];
+    s -> rx_frame_errors = sum.rx [ R8139DN_RX_FRAME_ERRORS ];
+    s -> rx_length_errors = sum.rx [ R8139DN_RX_LENGTH_ERRORS ];
+    s -> rx_over_errors = sum.irq [ R8139DN_RX_OVER_ERRORS ];
+    s -> rx_fifo_errors = sum.irq [ R8139DN_RX_FIFO_ERRORS ];
+    s -> rx_missed_errors = sum.hw [ R8139DN_HW_MISSED ];
+    s -> rx_errors = s -> rx_crc_errors + s -> rx_frame_errors + s -> rx_length_errors +
+        sum.rx [ R8139DN_RX_SYMBOL_ERRORS ] + sum.rx [ R8139DN_RX_RESETS ] + sum.irq [ R8139DN_RX_EARLY_BAD ] +
+        s -> rx_over_errors + s -> rx_fifo_errors;
+
+    s -> tx_packets = sum.irq [ R8139DN_TX_PACKETS ];
+    s -> tx_bytes = sum.irq [ R8139DN_TX_BYTES ];
+    s -> tx_errors = sum.irq [ R8139DN_TX_ERRORS ];
+    s -> tx_dropped = sum.irq [ R8139DN_TX_DROPPED ];
+    s -> tx_aborted_errors = sum.irq [ R8139DN_TX_ABORTED ];
+    s -> tx_fifo_errors = sum.irq [ R8139DN_TX_UNDERRUNS ];
+    s -> tx_carrier_errors = sum.irq [ R8139DN_TX_CARRIER_ERRORS ];
+    s -> tx_window_errors = sum.irq [ R8139DN_TX_WINDOW_ERRORS ];
+    s -> tx_heartbeat_errors = sum.irq [ R8139DN_TX_HEARTBEAT_ERRORS ];
+    s -> collisions = sum.irq [ R8139DN_TX_COLLISIONS ];
+}
@@ -0,0 +1,164 @@
+#ifndef _R8139DN_STATS_H
+#define _R8139DN_STATS_H
+
+#include <linux/netdevice.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/workqueue.h>
+
+struct r8139dn_priv;
+
+// Frame size histogram buckets (size on the wire, FCS included)
+// 64, 65-127, 128-255, 256-511, 512-1023, 1024-1518, 1519+
+#define R8139DN_SIZE_BUCKETS 7
+
+// How often we harvest the hardware counters
+// The 16 bit ones must not increase by more than 65535 in between (wrap)
+#define R8139DN_HW_STATS_PERIOD HZ
+
+// Counters only updated by our NAPI poll function (softirq)
+enum r8139dn_rx_stat
+{
+    R8139DN_RX_PACKETS,
+    R8139DN_RX_BYTES,
+    R8139DN_RX_CRC_ERRORS,          // RSR_CRC
+    R8139DN_RX_FRAME_ERRORS,        // RSR_FAE
+    R8139DN_RX_LENGTH_ERRORS,       // RSR_RUNT or RSR_LONG
+    R8139DN_RX_SYMBOL_ERRORS,       // RSR_ISE
+    R8139DN_RX_ALLOC_FAILED,        // No sk_buff for the frame: dropped
+    R8139DN_RX_XDP_DROP,            // XDP_DROP, XDP_ABORTED or unknown action
+    R8139DN_RX_XDP_TX,              // XDP_TX
+    R8139DN_RX_XDP_TX_ERRORS,       // XDP_TX, but the TX ring was full
+    R8139DN_RX_RESYNCS,             // RX ring overflow (INT_RXOVW): CAPR resynced to CBR
+    R8139DN_RX_RESETS,              // Corrupted RTL RX header: receiver reset
+    R8139DN_RX_SIZE,                // Size histogram (R8139DN_SIZE_BUCKETS counters)
+    R8139DN_RX_STAT_NB = R8139DN_RX_SIZE + R8139DN_SIZE_BUCKETS
+};
+
+// Counters updated from the IRQ handler, or with IRQs disabled
+enum r8139dn_irq_stat
+{
+    R8139DN_TX_PACKETS,
+    R8139DN_TX_BYTES,
+    R8139DN_TX_ERRORS,              // Frames that didn't make it to the wire
+    R8139DN_TX_DROPPED,             // Frames too big for us
+    R8139DN_TX_ABORTED,             // TSD_TABT
+    R8139DN_TX_UNDERRUNS,           // TSD_TUN
+    R8139DN_TX_CARRIER_ERRORS,      // TSD_CRS
+    R8139DN_TX_WINDOW_ERRORS,       // TSD_OWC
+    R8139DN_TX_HEARTBEAT_ERRORS,    // TSD_CDH
+    R8139DN_TX_COLLISIONS,          // TSD_NCC
+    R8139DN_TX_XDP_XMIT,            // Frames redirected to us (ndo_xdp_xmit)
+    R8139DN_TX_XDP_XMIT_ERRORS,     // Frames redirected to us, but the TX ring was full
+    R8139DN_TX_PAUSE_XOFF,          // PAUSE frames sent because our RX ring was filling up
+    R8139DN_TX_PAUSE_XON,           // PAUSE frames (zero pause time) sent once our RX ring was drained
+    R8139DN_RX_OVER_ERRORS,         // INT_RXOVW or ERSR_EROVW: RX ring full
+    R8139DN_RX_FIFO_ERRORS,         // INT_FOVW: RX FIFO full
+    R8139DN_RX_EARLY_BAD,           // ERSR_ERBAD
+    R8139DN_TX_TIMEOUTS,            // TX watchdog fired (ndo_tx_timeout)
+    R8139DN_TX_RESTARTS,            // Transmitter restarted after a TX timeout
+    R8139DN_TX_RESETS,              // Chip reset after a TX timeout, when restarting the transmitter didn't help
+    R8139DN_TX_SIZE,                // Size histogram (R8139DN_SIZE_BUCKETS counters)
+    R8139DN_IRQ_STAT_NB = R8139DN_TX_SIZE + R8139DN_SIZE_BUCKETS
+};
+
+// Hardware counters, harvested periodically
+enum r8139dn_hw_stat
+{
+    R8139DN_HW_MISSED,              // MPC: frames lost because the RX FIFO was full (24 bits)
+    R8139DN_HW_RX_ERRORS,           // RXERCNT (16 bits)
+    R8139DN_HW_FALSE_CARRIER,       // FCSC (16 bits)
+    R8139DN_HW_DISCONNECTS,         // DIS (16 bits)
+    R8139DN_HW_STAT_NB
+};
+
+// Counters of one CPU
+// Each group has its own writers: they never need to wait for one another
+struct r8139dn_pcpu_stats
+{
+    struct u64_stats_sync rx_syncp;
+    u64_stats_t rx [ R8139DN_RX_STAT_NB ];
+
+    struct u64_stats_sync irq_syncp;
+    u64_stats_t irq [ R8139DN_IRQ_STAT_NB ];
+};
+
+// Hardware counters: they are never reset, we accumulate what they gained since we last read them
+// Only updated by the harvesting work
+struct r8139dn_hw_stats
+{
+    struct delayed_work work;
+    struct u64_stats_sync syncp;
+    u64_stats_t total [ R8139DN_HW_STAT_NB ];
+    u32 last [ R8139DN_HW_STAT_NB ];
+};
+
+// Sum of the counters of all the CPUs, plus the hardware counters
+struct r8139dn_stats
+{
+    u64 rx [ R8139DN_RX_STAT_NB ];
+    u64 irq [ R8139DN_IRQ_STAT_NB ];
+    u64 hw [ R8139DN_HW_STAT_NB ];
+};
+
+int r8139dn_stats_init ( struct r8139dn_priv * priv );
+void r8139dn_stats_start ( struct r8139dn_priv * priv );
+void r8139dn_stats_stop ( struct r8139dn_priv * priv );
+void r8139dn_stats_fold ( struct r8139dn_priv * priv, struct r8139dn_stats * sum );
+void r8139dn_stats_get64 ( struct net_device * ndev, struct rtnl_link_stats64 * s );
+
+// Histogram bucket of a frame of size bytes (FCS included)
+static inline int r8139dn_stats_size_bucket ( unsigned int size )
+{
+    if ( size <= 64 )
+    {
+        return 0;
+    }
+
+    if ( size > ETH_FRAME_LEN + ETH_FCS_LEN )
+    {
+        return R8139DN_SIZE_BUCKETS - 1;
+    }
+
+    if ( size >= 1024 )
+    {
+        return R8139DN_SIZE_BUCKETS - 2;
+    }
+
+    // 65-127: 1, 128-255: 2, 256-511: 3, 512-1023: 4
+    return ilog2 ( size ) - 5;
+}
+
+// Add val to an RX counter. NAPI poll function only
+static inline void r8139dn_stats_rx_add ( struct r8139dn_pcpu_stats __percpu * pcpu, int stat, u64 val )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( pcpu );
+
+    u64_stats_update_begin ( & stats -> rx_syncp );
+    u64_stats_add ( & stats -> rx [ stat ], val );
+    u64_stats_update_end ( & stats -> rx_syncp );
+}
+
+// Account for a frame we've received (size with FCS)
+static inline void r8139dn_stats_rx_frame ( struct r8139dn_pcpu_stats __percpu * pcpu, unsigned int size )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( pcpu );
+
+    u64_stats_update_begin ( & stats -> rx_syncp );
+    u64_stats_inc ( & stats -> rx [ R8139DN_RX_PACKETS ] );
+    u64_stats_add ( & stats -> rx [ R8139DN_RX_BYTES ], size - ETH_FCS_LEN );
+    u64_stats_inc ( & stats -> rx [ R8139DN_RX_SIZE + r8139dn_stats_size_bucket ( size ) ] );
+    u64_stats_update_end ( & stats -> rx_syncp );
+}
+
+// Add val to an IRQ counter. Any context: the IRQ handler may interrupt start_xmit on the same CPU
+static inline void r8139dn_stats_irq_add ( struct r8139dn_pcpu_stats __percpu * pcpu, int stat, u64 val )
+{
+    struct r8139dn_pcpu_stats * stats = this_cpu_ptr ( pcpu );
+    unsigned long flags;
+
+    flags = u64_stats_update_begin_irqsave ( & stats -> irq_syncp );
+    u64_stats_add ( & stats -> irq [ stat ], val );
+    u64_stats_update_end_irqrestore ( & stats -> irq_syncp, flags );
+}
+
+#endif
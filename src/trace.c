@@ -0,0 +1,4 @@
+// Instantiate our tracepoints (see trace.h)
+// This must happen in exactly one translation unit
+#define CREATE_TRACE_POINTS
+#include "trace.h"
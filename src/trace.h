@@ -0,0 +1,115 @@
+// Tracepoints of our hot paths, for perf / bpftrace / trace-cmd
+// They cost nothing until enabled: perf record -e 'r8139dn:*'
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM r8139dn
+
+#if ! defined ( _R8139DN_TRACE_H ) || defined ( TRACE_HEADER_MULTI_READ )
+#define _R8139DN_TRACE_H
+
+#include <linux/netdevice.h>
+#include <linux/tracepoint.h>
+
+// Our IRQ handler got an interrupt (ISR as read, before it gets filtered by what we're interested in)
+TRACE_EVENT ( r8139dn_irq,
+    TP_PROTO ( const struct net_device * ndev, u16 isr, u16 masked ),
+    TP_ARGS ( ndev, isr, masked ),
+    TP_STRUCT__entry (
+        __string ( name, ndev -> name )
+        __field ( u16, isr )
+        __field ( u16, masked )
+    ),
+    TP_fast_assign (
+        __assign_str ( name, ndev -> name );
+        __entry -> isr = isr;
+        __entry -> masked = masked;
+    ),
+    TP_printk ( "dev=%s isr=0x%04x masked=0x%04x", __get_str ( name ), __entry -> isr, __entry -> masked )
+);
+
+// Our poll function found a frame in the RX ring
+// pending is the distance from the frame to CBR: how many bytes of the RX ring the hardware has filled ahead of us
+TRACE_EVENT ( r8139dn_rx,
+    TP_PROTO ( const struct net_device * ndev, u16 offset, u16 pending, u16 size, u16 status ),
+    TP_ARGS ( ndev, offset, pending, size, status ),
+    TP_STRUCT__entry (
+        __string ( name, ndev -> name )
+        __field ( u16, offset )
+        __field ( u16, pending )
+        __field ( u16, size )
+        __field ( u16, status )
+    ),
+    TP_fast_assign (
+        __assign_str ( name, ndev -> name );
+        __entry -> offset = offset;
+        __entry -> pending = pending;
+        __entry -> size = size;
+        __entry -> status = status;
+    ),
+    TP_printk ( "dev=%s offset=%u pending=%u size=%u status=0x%04x", __get_str ( name ),
+        __entry -> offset, __entry -> pending, __entry -> size, __entry -> status )
+);
+
+// start_xmit staged a frame in a TX slot
+TRACE_EVENT ( r8139dn_tx_queue,
+    TP_PROTO ( const struct net_device * ndev, int slot, u16 len, bool zerocopy ),
+    TP_ARGS ( ndev, slot, len, zerocopy ),
+    TP_STRUCT__entry (
+        __string ( name, ndev -> name )
+        __field ( int, slot )
+        __field ( u16, len )
+        __field ( bool, zerocopy )
+    ),
+    TP_fast_assign (
+        __assign_str ( name, ndev -> name );
+        __entry -> slot = slot;
+        __entry -> len = len;
+        __entry -> zerocopy = zerocopy;
+    ),
+    TP_printk ( "dev=%s slot=%d len=%u zerocopy=%d", __get_str ( name ),
+        __entry -> slot, __entry -> len, __entry -> zerocopy )
+);
+
+// A staged TX slot has been handed to a hardware descriptor
+TRACE_EVENT ( r8139dn_tx_kick,
+    TP_PROTO ( const struct net_device * ndev, int slot, int desc ),
+    TP_ARGS ( ndev, slot, desc ),
+    TP_STRUCT__entry (
+        __string ( name, ndev -> name )
+        __field ( int, slot )
+        __field ( int, desc )
+    ),
+    TP_fast_assign (
+        __assign_str ( name, ndev -> name );
+        __entry -> slot = slot;
+        __entry -> desc = desc;
+    ),
+    TP_printk ( "dev=%s slot=%d desc=%d", __get_str ( name ), __entry -> slot, __entry -> desc )
+);
+
+// The hardware is done with a TX descriptor (tsd is its transmit status)
+TRACE_EVENT ( r8139dn_tx_done,
+    TP_PROTO ( const struct net_device * ndev, int slot, int desc, u32 tsd ),
+    TP_ARGS ( ndev, slot, desc, tsd ),
+    TP_STRUCT__entry (
+        __string ( name, ndev -> name )
+        __field ( int, slot )
+        __field ( int, desc )
+        __field ( u32, tsd )
+    ),
+    TP_fast_assign (
+        __assign_str ( name, ndev -> name );
+        __entry -> slot = slot;
+        __entry -> desc = desc;
+        __entry -> tsd = tsd;
+    ),
+    TP_printk ( "dev=%s slot=%d desc=%d tsd=0x%08x", __get_str ( name ),
+        __entry -> slot, __entry -> desc, __entry -> tsd )
+);
+
+#endif
+
+// This part must be outside the include guard
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE trace
+#include <trace/define_trace.h>